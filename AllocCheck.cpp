@@ -0,0 +1,215 @@
+/********************************
+
+AllocCheck.cpp
+Steady-state allocation checks for the MIDI path
+
+********************************/
+
+#include "AllocCheck.h"
+
+#if defined(NDNMIDI_ALLOC_CHECK)
+
+#include <new>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Plain TLS without a constructor, so counting works inside malloc
+// before the thread is fully set up
+static __thread unsigned long long allocationCount = 0;
+
+// Allocations that regions of this thread should ignore
+static __thread unsigned long long allowedCount = 0;
+
+static std::atomic<bool> fatalViolations(true);
+static std::atomic<unsigned long long> violations(0);
+
+// Sites are static objects that are never destroyed, linked at
+// construction
+static std::atomic<AllocSite *> sites(NULL);
+
+#if defined(__GLIBC__)
+
+// glibc's operator new calls malloc, so counting malloc covers both
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *p, size_t size);
+
+extern "C" void *
+malloc(size_t size)
+{
+	++allocationCount;
+	return __libc_malloc(size);
+}
+
+extern "C" void *
+calloc(size_t count, size_t size)
+{
+	++allocationCount;
+	return __libc_calloc(count, size);
+}
+
+extern "C" void *
+realloc(void *p, size_t size)
+{
+	++allocationCount;
+	return __libc_realloc(p, size);
+}
+
+#else
+
+void *
+operator new(size_t size)
+{
+	++allocationCount;
+	void *p = malloc(size ? size : 1);
+	if (p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+void *
+operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void
+operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+void
+operator delete[](void *p) noexcept
+{
+	free(p);
+}
+
+#endif
+
+AllocSite::AllocSite(const char *name)
+	: name(name)
+	, entries(0)
+	, warmups(0)
+	, allocated(0)
+	, allocations(0)
+	, next(sites.load())
+{
+	while (!sites.compare_exchange_weak(next, this))
+		;
+}
+
+AllocRegion::AllocRegion(AllocSite& site)
+	: m_site(site)
+	, m_start(allocationCount - allowedCount)
+{
+	m_site.entries.fetch_add(1, std::memory_order_relaxed);
+}
+
+AllocRegion::~AllocRegion()
+{
+	unsigned long long count = allocationCount - allowedCount - m_start;
+	if (count == 0)
+		return;
+	m_site.allocated.fetch_add(count, std::memory_order_relaxed);
+	if (m_site.warmups.fetch_add(1, std::memory_order_relaxed) < ALLOC_WARMUP)
+		return;
+
+	m_site.allocations.fetch_add(count, std::memory_order_relaxed);
+	violations.fetch_add(count, std::memory_order_relaxed);
+	if (fatalViolations)
+	{
+		// stdio, since iostreams may allocate
+		fprintf(stderr, "AllocCheck: %llu allocations in %s after warm-up\n", count, m_site.name);
+		abort();
+	}
+}
+
+AllocAllowed::AllocAllowed()
+	: m_start(allocationCount)
+	, m_allowed(allowedCount)
+{
+}
+
+// Set rather than added to, since blocks nested inside this one have
+// already counted their allocations
+AllocAllowed::~AllocAllowed()
+{
+	allowedCount = m_allowed + (allocationCount - m_start);
+}
+
+unsigned long long
+threadAllocations()
+{
+	return allocationCount;
+}
+
+void
+allocCheckFatal(bool fatal)
+{
+	fatalViolations = fatal;
+}
+
+unsigned long long
+allocViolations()
+{
+	return violations;
+}
+
+unsigned long long
+regionAllocations()
+{
+	unsigned long long total = 0;
+	for (AllocSite *site = sites; site != NULL; site = site->next)
+		total += site->allocated;
+	return total;
+}
+
+void
+printAllocReport(std::ostream& out)
+{
+	out << "{";
+	for (AllocSite *site = sites; site != NULL; site = site->next)
+	{
+		out << "\"" << site->name << "\": {\"entries\": " << site->entries
+			<< ", \"warmup_allocations\": " << site->warmups
+			<< ", \"allocated\": " << site->allocated
+			<< ", \"allocations\": " << site->allocations << "}"
+			<< (site->next != NULL ? ", " : "");
+	}
+	out << "}";
+}
+
+#else
+
+unsigned long long
+threadAllocations()
+{
+	return 0;
+}
+
+void
+allocCheckFatal(bool fatal)
+{
+}
+
+unsigned long long
+allocViolations()
+{
+	return 0;
+}
+
+unsigned long long
+regionAllocations()
+{
+	return 0;
+}
+
+void
+printAllocReport(std::ostream& out)
+{
+	out << "{}";
+}
+
+#endif
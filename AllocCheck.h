@@ -0,0 +1,96 @@
+/********************************
+
+AllocCheck.h
+Steady-state allocation checks for the MIDI path
+
+Built with NDNMIDI_ALLOC_CHECK (make ALLOC_CHECK=1, and always for the
+benchmarks), every heap allocation is counted per thread. Code that
+must not allocate once it is warmed up is marked with ALLOC_REGION().
+The first ALLOC_WARMUP times a region allocates are taken as warm-up,
+while rings, caches and per-thread state fill up. Any allocation after
+that is a violation: it is reported and the process aborts, or it is
+only counted after allocCheckFatal(false). Calls into ndn-cxx, which
+allocates for every packet it encodes, signs or expresses, are wrapped
+in ALLOC_ALLOWED() blocks inside the regions.
+
+Without NDNMIDI_ALLOC_CHECK the macros are empty.
+
+********************************/
+
+#ifndef NDNMIDI_ALLOC_CHECK_H
+#define NDNMIDI_ALLOC_CHECK_H
+
+#include <atomic>
+#include <ostream>
+
+// Times a region may allocate while warming up
+#define ALLOC_WARMUP 64
+
+#if defined(NDNMIDI_ALLOC_CHECK)
+
+// One ALLOC_REGION() in the source, with its totals
+struct AllocSite
+{
+	AllocSite(const char *name);
+
+	const char *name;
+	std::atomic<unsigned long long> entries;
+	std::atomic<unsigned long long> warmups;
+	std::atomic<unsigned long long> allocated;     // warm-up included
+	std::atomic<unsigned long long> allocations;   // after warm-up
+	AllocSite *next;
+};
+
+// Checks that the calling thread does not allocate in its lifetime
+class AllocRegion
+{
+public:
+	AllocRegion(AllocSite& site);
+	~AllocRegion();
+
+private:
+	AllocSite& m_site;
+	unsigned long long m_start;
+};
+
+// Allocations in its lifetime do not count against the regions
+class AllocAllowed
+{
+public:
+	AllocAllowed();
+	~AllocAllowed();
+
+private:
+	unsigned long long m_start;
+	unsigned long long m_allowed;
+};
+
+#define ALLOC_REGION(name) \
+	static AllocSite allocSite_(name); \
+	AllocRegion allocRegion_(allocSite_)
+#define ALLOC_ALLOWED() AllocAllowed allocAllowed_
+
+#else
+
+#define ALLOC_REGION(name) do {} while (0)
+#define ALLOC_ALLOWED() do {} while (0)
+
+#endif
+
+// Heap allocations made by the calling thread so far (0 without
+// NDNMIDI_ALLOC_CHECK)
+unsigned long long threadAllocations();
+
+// Whether a violation aborts (the default) or is only counted
+void allocCheckFatal(bool fatal);
+
+// Allocations inside regions after their warm-up, over all regions
+unsigned long long allocViolations();
+
+// Allocations inside regions, warm-up included, over all regions
+unsigned long long regionAllocations();
+
+// Writes a JSON object with the entries and allocations of each region
+void printAllocReport(std::ostream& out);
+
+#endif
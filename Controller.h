@@ -0,0 +1,778 @@
+/********************************
+
+Controller.h
+Requires NFD, ndn-cxx, RtMidi.cpp, and RtMidi.h to compile
+
+The controller side of NDN-MIDI: queues MIDI input from an RtMidiIn
+port and answers interests from PlaybackModuleMIDI with it
+
+Used by ControllerMIDI and the benchmarks
+
+********************************/
+
+#ifndef NDNMIDI_CONTROLLER_H
+#define NDNMIDI_CONTROLLER_H
+
+#include <ndn-cxx/face.hpp>
+#include <ndn-cxx/interest.hpp>
+#include <ndn-cxx/data.hpp>
+#include <ndn-cxx/security/key-chain.hpp>
+
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <sstream>
+
+#include <stdlib.h>
+#include "RtMidi.h"
+#include "Realtime.h"
+#include "Stats.h"
+#include "Histogram.h"
+#include "Trace.h"
+#include "Probes.h"
+#include "Logger.h"
+#include "AllocCheck.h"
+#include "Names.h"
+
+// Length in seconds between heartbeat probes
+#define HEARTBEAT_PERIOD_S 5
+
+// Maximum number of probes for reconnection
+#define MAX_HEARTBEAT_PROBE 3
+
+// MIDI messages waiting for interests; more are dropped
+#define INPUT_QUEUE_SIZE 1024
+
+// The controller has one connection, counted in this stats slot
+// (benchmarks that run a playback module in the same process move it)
+#ifndef CONTROLLER_STATS_SLOT
+#define CONTROLLER_STATS_SLOT 0
+#endif
+
+using sysclock = std::chrono::system_clock;
+using steadyclock = std::chrono::steady_clock;
+
+
+// Container for a single MIDI message of 3 bytes
+struct MIDIMessage
+{
+	char data[3];
+};
+
+// Prints a packet of MIDI messages as "[ type data1 data2] ..."
+inline void formatSentData(std::ostream& out, const LogRecord& record)
+{
+	out << "Sending Data: ";
+	for (unsigned int i = 0; i + 2 < record.size; i += 3)
+	{
+		out << "[";
+		out << " " << (((unsigned int)record.bytes[i] >> 4) & 15);
+		out << " " << (int)record.bytes[i + 1];
+		out << " " << (int)record.bytes[i + 2];
+		out << "] ";
+	}
+	out << std::endl;
+}
+
+// A MIDI message waiting for an interest, with the times it was
+// captured and queued on the RtMidi::getTime() clock
+struct QueuedMessage
+{
+	MIDIMessage message;
+	long long captured;
+	long long queued;
+	unsigned long long traceId;
+};
+
+// Queue of MIDI messages from the input thread to the output sender,
+// one producer and one consumer, in a fixed ring so that queueing never
+// allocates
+class InputQueue
+{
+public:
+	InputQueue()
+		: m_head(0)
+		, m_tail(0)
+	{
+	}
+
+	// Returns false if the queue is full
+	bool
+	push_back(const QueuedMessage& message)
+	{
+		unsigned int head = m_head.load(std::memory_order_relaxed);
+		if (head - m_tail.load(std::memory_order_acquire) >= INPUT_QUEUE_SIZE)
+			return false;
+		m_messages[head % INPUT_QUEUE_SIZE] = message;
+		m_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	unsigned int
+	size() const
+	{
+		unsigned int tail = m_tail.load(std::memory_order_acquire);
+		return m_head.load(std::memory_order_acquire) - tail;
+	}
+
+	bool
+	empty() const
+	{
+		return size() == 0;
+	}
+
+	const QueuedMessage&
+	front() const
+	{
+		return m_messages[m_tail.load(std::memory_order_relaxed) % INPUT_QUEUE_SIZE];
+	}
+
+	void
+	pop_front()
+	{
+		m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	// Consumer only, like front() and pop_front()
+	void
+	clear()
+	{
+		m_tail.store(m_head.load(std::memory_order_acquire), std::memory_order_release);
+	}
+
+private:
+	std::atomic<unsigned int> m_head;
+	std::atomic<unsigned int> m_tail;
+	QueuedMessage m_messages[INPUT_QUEUE_SIZE];
+};
+
+// Stages a MIDI message goes through in the controller, each with its
+// own latency histogram
+enum ControllerStage
+{
+	STAGE_CAPTURE_TO_QUEUE,
+	STAGE_QUEUE_TO_PUT,
+	STAGE_CAPTURE_TO_PUT,
+	CONTROLLER_STAGES
+};
+
+static const char *controllerStageNames[CONTROLLER_STAGES] = {
+	"capture_to_enqueue",
+	"enqueue_to_put",
+	"capture_to_put"
+};
+
+class Controller
+{
+public:
+	// Without heartbeatThread, heartbeat() must be called every
+	// HEARTBEAT_PERIOD_S instead, e.g. on a simulation's virtual clock
+	Controller(ndn::Face& face, const std::string& remoteName,
+	const std::string& devName, const std::string& projName,
+	bool heartbeatThread = true)
+		: m_face(face)
+		, m_baseName(ndn::Name("/topo-prefix/" + devName + "/midi-ndn/" + projName))
+		, m_remoteName(remoteName)
+		, m_devName(devName)
+		, m_projName(projName)
+		, m_heartbeatThread(heartbeatThread)
+	{
+		srand(sysclock::to_time_t(sysclock::now()));
+		m_connGood = false;
+		m_hbCount = 0;
+		m_hbSent = 0;
+		m_hbRtt = -1;
+		m_senderWaiting = false;
+		m_resetInput = false;
+		heartbeatNonce = rand();
+		m_face.setInterestFilter(m_baseName,
+								 std::bind(&Controller::onInterest, this, _2),
+								 std::bind(&Controller::onSuccess, this, _1),
+								 [] (const ndn::Name& prefix, const std::string& reason) {
+									std::cerr << "Failed to register prefix: " << reason << std::endl;
+								 });
+	}
+
+
+	// Add a MIDIMessage to the input queue
+	// captured is when it arrived, if known
+	void
+	addInput(MIDIMessage msg, long long captured = 0)
+	{
+		ALLOC_REGION("Controller::addInput");
+		countStat(CONTROLLER_STATS_SLOT, STAT_EVENTS_IN);
+		long long now = RtMidi::getTime();
+		if (captured == 0)
+			captured = now;
+		else
+			m_histograms[STAGE_CAPTURE_TO_QUEUE].record(now - captured);
+
+		// The note's flow starts in a slice from capture to enqueue
+		unsigned long long traceId = 0;
+		if (tracing())
+		{
+			traceId = newTraceId();
+			traceSlice("capture", captured, now, "note", traceId & 0xFFFFFFFF);
+			traceFlow('s', "controller", captured, traceId);
+		}
+		if (!m_inputQueue.push_back({msg, captured, now, traceId}))
+		{
+			countStat(CONTROLLER_STATS_SLOT, STAT_EVENTS_DROPPED);
+			return;
+		}
+		NDNMIDI_PROBE4(controller_enqueue, m_remoteName.c_str(), m_inputQueue.size(), captured, now);
+		wakeSender();
+	}
+
+	// Blocks the output sender until replyInterest() has work: MIDI
+	// messages and an interest to send them on, or messages to drop
+	// while disconnected
+	void
+	waitToSend()
+	{
+		std::unique_lock<std::mutex> lock(m_senderMutex);
+		m_senderWaiting.store(true, std::memory_order_relaxed);
+		// Pairs with the fence in wakeSender(): either this sees the
+		// message just queued, or addInput() sees that we wait
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		m_senderReady.wait(lock, [this] {
+			return m_resetInput || (!m_inputQueue.empty() && (!m_interestQueue.empty() || !m_connGood));
+		});
+		m_senderWaiting.store(false, std::memory_order_relaxed);
+	}
+
+	// Convert msg to a MIDIMessage
+	// Add the MIDIMessage to the input queue
+	void
+	addInput(std::string msg)
+	{
+		MIDIMessage midiMsg;
+		for (unsigned int i = 0; i < 3; ++i)
+		{
+			if (i >= msg.size())
+				midiMsg.data[i] = 0;
+			else
+				midiMsg.data[i] = msg[i];
+		}
+		addInput(midiMsg);
+	}
+
+	// Copy the first three bytes of a captured message
+	// Add the MIDIMessage to the input queue
+	void
+	addInput(const RtMidiMessage& msg)
+	{
+		MIDIMessage midiMsg;
+		for (unsigned int i = 0; i < 3; ++i)
+			midiMsg.data[i] = msg[i];
+		addInput(midiMsg, msg.absoluteTime);
+	}
+	
+	// If input and interest queues are not empty
+	// sends up to maxBufSize midi messages in a packet
+	void
+	replyInterest()
+	{
+		ALLOC_REGION("Controller::replyInterest");
+
+		// Only the sender, as the input queue's consumer, may empty it
+		if (m_resetInput.exchange(false))
+			m_inputQueue.clear();
+
+		// If not connected, queue will be cleared
+		if (!m_connGood)
+		{
+			if (!m_inputQueue.empty())
+				countStat(CONTROLLER_STATS_SLOT, STAT_EVENTS_DROPPED, m_inputQueue.size());
+			m_inputQueue.clear();
+			std::lock_guard<std::mutex> lock(m_senderMutex);
+			m_interestQueue.clear();
+		}
+
+		// Messages wait in the queue until an interest arrives
+		if (m_inputQueue.empty())
+			return;
+		ndn::Name interestName;
+		{
+			std::lock_guard<std::mutex> lock(m_senderMutex);
+			if (m_interestQueue.empty())
+				return;
+			// Moved, since copying a name allocates
+			interestName = std::move(m_interestQueue.front());
+			m_interestQueue.pop_front();
+		}
+
+		int midiBufSize = 0;
+		long long captured[10], queued[10];
+		unsigned long long traceIds[10];
+		// Send up to to max number of notes in a packet
+		while (!m_inputQueue.empty() && midiBufSize < 10){
+			midiBuf[midiBufSize] = m_inputQueue.front().message;
+			captured[midiBufSize] = m_inputQueue.front().captured;
+			queued[midiBufSize] = m_inputQueue.front().queued;
+			traceIds[midiBufSize] = m_inputQueue.front().traceId;
+			m_inputQueue.pop_front();
+			midiBufSize++;
+		}
+		// Printed later by the logger thread
+		logRecord(LOG_INFO, &formatSentData, NULL, midiBuf, midiBufSize*3);
+		
+		// Name data packet using interest sequence number
+		int seqNo;
+		long long start;
+		{
+			// ndn-cxx allocates to encode, sign and put the Data
+			ALLOC_ALLOWED();
+			seqNo = interestName.get(-1).toSequenceNumber();
+			start = RtMidi::getTime();
+			NDNMIDI_PROBE5(controller_dequeue, m_remoteName.c_str(), seqNo, midiBufSize, queued[0], start);
+			sendData(interestName, (char *)midiBuf, midiBufSize*3);
+		}
+		countStat(CONTROLLER_STATS_SLOT, STAT_PACKETS_OUT);
+		countStat(CONTROLLER_STATS_SLOT, STAT_EVENTS_OUT, midiBufSize);
+
+		long long put = RtMidi::getTime();
+		NDNMIDI_PROBE5(data_put, m_remoteName.c_str(), seqNo, midiBufSize, start, put);
+		for (int i = 0; i < midiBufSize; ++i)
+		{
+			m_histograms[STAGE_QUEUE_TO_PUT].record(put - queued[i]);
+			m_histograms[STAGE_CAPTURE_TO_PUT].record(put - captured[i]);
+		}
+
+		// Each note's flow ends here and one to the playback
+		// module starts, named by what both sides know
+		if (tracing())
+		{
+			traceSlice("sendData", start, put, "seq", seqNo);
+			for (int i = 0; i < midiBufSize; ++i)
+			{
+				if (traceIds[i] != 0)
+					traceFlow('f', "controller", start, traceIds[i]);
+				traceFlow('s', "network", start, traceFlowId(m_devName, seqNo, i));
+			}
+		}
+	}
+
+// Packet handlers are protected so the benchmarks can call them directly
+protected:
+	// Wakes the output sender if it waits in waitToSend()
+	void
+	wakeSender()
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (m_senderWaiting.load(std::memory_order_relaxed))
+		{
+			std::lock_guard<std::mutex> lock(m_senderMutex);
+			m_senderReady.notify_one();
+		}
+	}
+
+	size_t
+	interestQueueSize()
+	{
+		std::lock_guard<std::mutex> lock(m_senderMutex);
+		return m_interestQueue.size();
+	}
+
+	// Creates thread to send heartbeat message
+	void
+	onSuccess(const ndn::Name& prefix)
+	{
+		std::cerr << "Prefix registered" << std::endl;
+		if (m_heartbeatThread)
+			heartbeatProbe = std::thread(&Controller::sendHeartbeat, this);
+	}
+
+	// Add interest to interest queue or drop interest
+	void
+	onInterest(const ndn::Interest& interest)
+	{
+		// Interests for MIDI data end in a sequence number, anything
+		// else is a request by name
+		const ndn::Name& name = interest.getName();
+		if (!name.get(-1).isSequenceNumber())
+		{
+			onRequest(name);
+			return;
+		}
+
+		if (!m_connGood)
+		{
+			std::cerr << "Connection not set up yet!?" << std::endl;
+			return;
+		}
+
+		/*** send out data of keyboard input ***/
+
+		if (m_inputQueue.empty())
+		{
+			// std::cerr << "\nReceived interest but no more data to send."
+			// 		  << std::endl;
+		}
+
+		// Consider out-of-order or retransmitted interest
+		int seqNo = interest.getName().get(-1).toSequenceNumber();
+		countStat(CONTROLLER_STATS_SLOT, STAT_PACKETS_IN);
+		NDNMIDI_PROBE4(interest_received, m_remoteName.c_str(), seqNo, m_maxSeqNo, RtMidi::getTime());
+		
+		if (seqNo >= m_maxSeqNo)
+		{
+			std::lock_guard<std::mutex> lock(m_senderMutex);
+			m_interestQueue.push_back(interest.getName());
+			m_maxSeqNo = seqNo + 1;
+			m_senderReady.notify_one();
+		}
+		else
+		{
+			countStat(CONTROLLER_STATS_SLOT, STAT_REEXPRESSED);
+			logText(LOG_WARN, "Dropped out-of-order packet");
+		}
+	}
+
+	// Answers the interests that are not for MIDI data: the status
+	// requests and shutdown
+	void
+	onRequest(const ndn::Name& name)
+	{
+		if (name.size() > m_baseName.size() + 1 && name.get(m_baseName.size()) == COMPONENT_STATUS)
+		{
+			sendStatus(name);
+			return;
+		}
+
+		try 
+		{
+			if (name.get(-1) == COMPONENT_SHUTDOWN) 
+			{
+				std::cout << "Shutting Down" << std::endl;
+				throw "e";
+				return;
+			}
+		}
+		catch (const char* e) 
+		{
+		std::cerr << "Disconnected from Playback Module" << std::endl;
+		exit(1);
+		}
+	}
+
+	// Data should be heartbeat message or connection setup
+	void
+	onData(const ndn::Data& data)
+	{
+		// Exit if not a heartbeat message
+		if (data.getName().get(-1) != COMPONENT_HEARTBEAT)
+		{
+			return;
+		}
+
+		// Round trip of the latest heartbeat
+		countStat(CONTROLLER_STATS_SLOT, STAT_HEARTBEATS);
+		long long sent = m_hbSent;
+		if (sent != 0)
+			m_hbRtt = std::chrono::duration_cast<std::chrono::microseconds>(
+				steadyclock::now().time_since_epoch()).count() - sent;
+
+		if (m_connGood)
+		{
+			//std::cerr << "Heartbeat!" << std::endl;
+			m_hbCount = 0;
+			return;
+		}
+
+		// Set up connection
+		m_connGood = true;
+		m_hbCount = 0;
+		m_maxSeqNo = 0;	// reset seqNo tracking
+		{
+			std::lock_guard<std::mutex> lock(m_senderMutex);
+			m_interestQueue.clear();
+			m_resetInput = true;
+			m_senderReady.notify_one();
+		}
+
+		std::cout << "Received data: "
+				  << std::string(reinterpret_cast<const char*>(data.getContent().value()),
+															   data.getContent().value_size())
+				  << std::endl;
+
+		//std::cout << "Data name: " << data.getName().toUri() << std::endl;
+	}
+
+	// For future: Maybe implement at least a message
+	void
+	onTimeout(const ndn::Interest& interest)
+	{
+		countStat(CONTROLLER_STATS_SLOT, STAT_TIMEOUTS);
+		// re-express interest: no need to retransmit for this case (?)
+		//std::cerr << "Timeout for: " << interest << std::endl;
+		//m_face.expressInterest(interest.getName(),
+		//						std::bind(&Controller::onData, this, _2),
+		//						std::bind(&Controller::onTimeout, this, _1));
+	}
+	
+	// For future: Maybe implement at least a message
+	void
+	onNetworkNack(const ndn::Interest& interest)
+	{
+		countStat(CONTROLLER_STATS_SLOT, STAT_NACKS);
+	}
+
+	// Request heartbeat from playback module
+	void
+	requestNext()
+	{
+		heartbeatNonce = rand();
+		m_hbSent = std::chrono::duration_cast<std::chrono::microseconds>(
+			steadyclock::now().time_since_epoch()).count();
+		// Express interest for heartbeat message
+		m_face.expressInterest(ndn::Interest(ndn::Name(
+											"/topo-prefix/" + m_remoteName + "/midi-ndn/" + m_projName
+											).append(m_devName + "/heartbeat"))
+								.setMustBeFresh(true)
+								.setInterestLifetime(ndn::time::seconds(HEARTBEAT_PERIOD_S))
+								.setNonce(heartbeatNonce),
+								std::bind(&Controller::onData, this, _2),
+								std::bind(&Controller::onTimeout, this, _1),
+								std::bind(&Controller::onNetworkNack, this, _1));
+		
+		//std::cerr << "Sending out interest: " << m_baseName << std::endl;
+	}
+
+	// Respond to interest with data
+	void
+	sendData(const ndn::Name& dataName, const char *buf, size_t size)
+	{
+		// Create data packet with the same name as interest
+		std::shared_ptr<ndn::Data> data = std::make_shared<ndn::Data>(dataName);
+
+		// Prepare and assign content of the data packet
+		data->setContent(reinterpret_cast<const uint8_t*>(buf), size);
+
+		// Set metainfo parameters
+		data->setFreshnessPeriod(ndn::time::seconds(1));
+
+		// Sign data packet and make it available for fetching
+		std::lock_guard<std::mutex> lock(m_putMutex);
+		m_keyChain.sign(*data);
+		m_face.put(*data);
+	}
+
+	// Answers <baseName>/status/stats, .../histograms,
+	// .../histograms/<slot> and .../trace
+	void
+	sendStatus(const ndn::Name& name)
+	{
+		size_t request = m_baseName.size() + 1;
+		if (name.size() == request + 1)
+		{
+			if (name.get(request) == COMPONENT_STATS)
+				sendStats(name);
+			else if (name.get(request) == COMPONENT_HISTOGRAMS)
+				sendHistograms(name);
+			else if (name.get(request) == COMPONENT_TRACE)
+				sendTrace(name);
+		}
+		else if (name.size() == request + 2 && name.get(request) == COMPONENT_HISTOGRAMS)
+			sendHistogramBuckets(name);
+	}
+
+	// Answer a stats interest with the counters and queue depths as JSON
+	void
+	sendStats(const ndn::Name& name)
+	{
+		StatTotals totals;
+		collectStats(totals);
+
+		std::ostringstream json;
+		json << "{\"name\": \"" << m_baseName.toUri() << "\""
+			 << ", \"remote\": \"" << m_remoteName << "\""
+			 << ", \"connected\": " << (m_connGood ? "true" : "false")
+			 << ", \"heartbeat_rtt_us\": " << m_hbRtt
+			 << ", \"input_queue\": " << m_inputQueue.size()
+			 << ", \"interest_queue\": " << interestQueueSize();
+		if (midiin != NULL)
+		{
+			RtMidiIn::QueueStatistics queue = midiin->getQueueStatistics();
+			json << ", \"midi_queue\": {\"size\": " << queue.size
+				 << ", \"high_water_mark\": " << queue.highWaterMark
+				 << ", \"dropped\": " << queue.dropped << "}";
+		}
+		json << ", ";
+		printStats(json, totals, CONTROLLER_STATS_SLOT);
+		json << "}";
+		sendJson(name, json.str());
+	}
+
+	// Answer a histograms interest with the percentiles of each stage
+	void
+	sendHistograms(const ndn::Name& name)
+	{
+		std::ostringstream json;
+		json << "{\"name\": \"" << m_baseName.toUri() << "\"";
+		for (unsigned int i = 0; i < CONTROLLER_STAGES; ++i)
+		{
+			json << ", \"" << controllerStageNames[i] << "\": ";
+			m_histograms[i].printPercentiles(json);
+		}
+		json << "}";
+		sendJson(name, json.str());
+	}
+
+	// Answer histograms/<slot> with the buckets of each stage, to be
+	// merged with those of other processes
+	void
+	sendHistogramBuckets(const ndn::Name& name)
+	{
+		std::ostringstream json;
+		json << "{\"name\": \"" << m_baseName.toUri() << "\"";
+		for (unsigned int i = 0; i < CONTROLLER_STAGES; ++i)
+		{
+			json << ", \"" << controllerStageNames[i] << "\": ";
+			m_histograms[i].printBuckets(json);
+		}
+		json << "}";
+		sendJson(name, json.str());
+	}
+
+	// Answer a trace interest once the trace writer has written the
+	// file, back on the thread that runs the face
+	void
+	sendTrace(const ndn::Name& name)
+	{
+		boost::asio::io_service& io = m_face.getIoService();
+		requestTraceWrite([this, &io, name] (long long events) {
+			io.post([this, name, events] {
+				std::ostringstream json;
+				json << "{\"name\": \"" << m_baseName.toUri() << "\""
+					 << ", \"file\": \"" << traceFile() << "\""
+					 << ", \"events\": " << events << "}";
+				sendJson(name, json.str());
+			});
+		});
+	}
+
+	void
+	sendJson(const ndn::Name& name, const std::string& content)
+	{
+		std::shared_ptr<ndn::Data> data = std::make_shared<ndn::Data>(name);
+		data->setContent(reinterpret_cast<const uint8_t*>(content.c_str()), content.size());
+		// Stale numbers are of no use to whoever is watching
+		data->setFreshnessPeriod(ndn::time::milliseconds(100));
+		std::lock_guard<std::mutex> lock(m_putMutex);
+		m_keyChain.sign(*data);
+		m_face.put(*data);
+	}
+
+	// Send interest for heartbeat message or reset connection
+	void
+	sendHeartbeat()
+	{
+		enterThread(ROLE_TIMER, "heartbeat");
+		while (true)
+		{
+			heartbeat();
+			std::this_thread::sleep_for(std::chrono::seconds(HEARTBEAT_PERIOD_S));
+		}
+	}
+
+	// One heartbeat period: probe the playback module, and reset the
+	// connection if too many probes went unanswered
+	void
+	heartbeat()
+	{
+		m_hbCount += 1;
+		// Send interest for heartbeat message
+		requestNext();
+		//std::cerr << "HEARTBEAT: " << m_hbCount << std::endl;
+
+		if (m_hbCount > MAX_HEARTBEAT_PROBE && m_connGood)
+		{
+			//std::cerr << "Heartbeat failed! Resetting connection..." << std::endl;
+			std::cerr << "Resetting connection..." << std::endl;
+			m_connGood = false;
+		}
+	}
+
+private:
+	ndn::Face& m_face;
+	ndn::KeyChain m_keyChain;
+	// One sign and put at a time: the output sender answers note
+	// interests while the NDN thread answers status interests
+	std::mutex m_putMutex;
+	ndn::Name m_baseName;
+
+	std::string m_projName;
+
+	bool m_connGood;
+	std::string m_remoteName;
+	std::string m_devName;
+	InputQueue m_inputQueue;
+
+	// Guards the interest queue, shared by the NDN thread and the
+	// output sender, which sleeps on m_senderReady when idle
+	std::mutex m_senderMutex;
+	std::condition_variable m_senderReady;
+	std::atomic<bool> m_senderWaiting;
+	// Set on a new connection for the sender to empty the input queue
+	std::atomic<bool> m_resetInput;
+	std::deque<ndn::Name> m_interestQueue;
+	MIDIMessage midiBuf[10]; // For multi-message sending
+
+	int m_maxSeqNo;
+	int m_hbCount;
+
+	// When the latest heartbeat was requested and how long its reply
+	// took, in microseconds (-1 before the first reply)
+	std::atomic<long long> m_hbSent;
+	std::atomic<long long> m_hbRtt;
+
+	Histogram m_histograms[CONTROLLER_STAGES];
+
+	bool m_heartbeatThread;
+	std::thread heartbeatProbe;
+	int heartbeatNonce;
+
+public:
+	//add RtMidiIn instance to the class
+	RtMidiIn *midiin = NULL;
+};
+
+// Most messages taken from the input queue per wakeup
+const unsigned int MIDI_BURST_SIZE = 64;
+
+// Sleeps until the input handler queues MIDI messages,
+// then takes the whole burst at once
+inline void midiLoopBurst(RtMidiIn *midiin, Controller& controller)
+{
+	enterThread(ROLE_MIDI, "MIDI input");
+	RtMidiMessage burst[MIDI_BURST_SIZE];
+	while ( true ) {
+		unsigned int count = midiin->waitForMessages( burst, MIDI_BURST_SIZE, 1.0 );
+		for (unsigned int i = 0; i < count; ++i)
+		{
+			if ( burst[i].size() >= 3 )
+				controller.addInput(burst[i]);
+		}
+	}
+}
+
+// Sends queued MIDI messages as interests arrive, sleeping in between
+// so that it never holds its core away from the NDN thread
+inline void output_sender(Controller& controller)
+{
+	enterThread(ROLE_NETWORK, "output sender");
+	while (true)
+	{
+		controller.waitToSend();
+		controller.replyInterest();
+	}
+}
+
+#endif
@@ -18,310 +18,22 @@ Currently untested but should work on Linux distros with minimal changes
 #include <ndn-cxx/data.hpp>
 #include <ndn-cxx/security/key-chain.hpp>
 
+#include <boost/asio/posix/stream_descriptor.hpp>
+
 #include <iostream>
 #include <string>
+#include <sstream>
 #include <map>
 #include <chrono>
 #include <thread>
 #include <deque>
+#include <memory>
+#include <vector>
 
 #include <stdlib.h>
 #include "RtMidi.h"
-
-// Length in seconds between heartbeat probes
-#define HEARTBEAT_PERIOD_S 5
-
-// Maximum number of probes for reconnection
-#define MAX_HEARTBEAT_PROBE 3
-
-using sysclock = std::chrono::system_clock;
-
-
-// Container for a single MIDI message of 3 bytes
-struct MIDIMessage
-{
-	char data[3];
-};
-
-class Controller
-{
-public:
-	Controller(ndn::Face& face, const std::string& remoteName,
-	const std::string& devName, const std::string& projName)
-		: m_face(face)
-		, m_baseName(ndn::Name("/topo-prefix/" + devName + "/midi-ndn/" + projName))
-		, m_remoteName(remoteName)
-		, m_devName(devName)
-		, m_projName(projName)
-	{
-		srand(sysclock::to_time_t(sysclock::now()));
-		m_connGood = false;
-		m_hbCount = 0;
-		heartbeatNonce = rand();
-		m_face.setInterestFilter(m_baseName,
-								 std::bind(&Controller::onInterest, this, _2),
-								 std::bind(&Controller::onSuccess, this, _1),
-								 [] (const ndn::Name& prefix, const std::string& reason) {
-									std::cerr << "Failed to register prefix: " << reason << std::endl;
-								 });
-	}
-
-
-	// Add a MIDIMessage to the input queue
-	void
-	addInput(MIDIMessage msg)
-	{
-		m_inputQueue.push_back(msg);
-	}
-
-	// Convert msg to a MIDIMessage
-	// Add the MIDIMessage to the input queue
-	void
-	addInput(std::string msg)
-	{
-		MIDIMessage midiMsg;
-		for (unsigned int i = 0; i < 3; ++i)
-		{
-			if (i >= msg.size())
-				midiMsg.data[i] = 0;
-			else
-				midiMsg.data[i] = msg[i];
-		}
-		addInput(midiMsg);
-	}
-	
-	// If input and interest queues are not empty
-	// sends up to maxBufSize midi messages in a packet
-	void
-	replyInterest()
-	{
-		// If not connected, queue will be cleared
-		if (!m_connGood)
-		{
-			m_inputQueue.clear();
-			m_interestQueue.clear();
-		}
-
-		// TODO: Verify this is right logic - what if no interests? Notes lost?
-		if (!m_inputQueue.empty() && !m_interestQueue.empty())
-		{
-			int midiBufSize = 0;
-			std::cout << "Sending Data: ";
-			// Send up to to max number of notes in a packet
-			while (!m_inputQueue.empty() && midiBufSize < 10){
-				midiBuf[midiBufSize] = m_inputQueue.front();
-				m_inputQueue.pop_front();
-				// Print three bytes of MIDI message
-				std::cout << "[";
-				std::cout << " " << (((unsigned int)midiBuf[midiBufSize].data[0] >> 4) & 15);
-				for (int i = 1; i < 3; ++i) {
-					std::cout << " " << (int)midiBuf[midiBufSize].data[i];
-				}
-				std::cout << "] ";
-				midiBufSize++;
-			}
-			std::cout << std::endl;
-			
-			// Name data packet using interest sequence number
-			ndn::Name interestName = m_interestQueue.front();
-			m_interestQueue.pop_front();
-
-			//int seqNo = interestName.get(-1).toSequenceNumber();
-			sendData(interestName, (char *)midiBuf, midiBufSize*3);
-		}
-	}
-
-private:
-	// Creates thread to send heartbeat message
-	void
-	onSuccess(const ndn::Name& prefix)
-	{
-		std::cerr << "Prefix registered" << std::endl;
-		heartbeatProbe = std::thread(&Controller::sendHeartbeat, this);
-	}
-
-	// Add interest to interest queue or drop interest
-	void
-	onInterest(const ndn::Interest& interest)
-	{
-		try 
-		{
-			if (interest.getName().get(-1).toUri() == "shutdown") 
-			{
-				std::cout << "Shutting Down" << std::endl;
-				throw "e";
-				return;
-			}
-		}
-		catch (const char* e) 
-		{
-		std::cerr << "Disconnected from Playback Module" << std::endl;
-		exit(1);
-		}
-
-
-		if (!m_connGood)
-		{
-			std::cerr << "Connection not set up yet!?" << std::endl;
-			return;
-		}
-
-		/*** send out data of keyboard input ***/
-
-		if (m_inputQueue.empty())
-		{
-			// std::cerr << "\nReceived interest but no more data to send."
-			// 		  << std::endl;
-		}
-
-		// Consider out-of-order or retransmitted interest
-		int seqNo = interest.getName().get(-1).toSequenceNumber();
-		
-		if (seqNo >= m_maxSeqNo)
-		{
-			m_interestQueue.push_back(interest.getName());
-			m_maxSeqNo = seqNo + 1;
-		}
-		else
-		{
-			std::cerr << "Dropped out-of-order packet" << std::endl;
-		}
-	}
-
-	// Data should be heartbeat message or connection setup
-	void
-	onData(const ndn::Data& data)
-	{
-		// Exit if not a heartbeat message
-		if (data.getName().get(-1).toUri() != "heartbeat")
-		{
-			return;
-		}
-
-		if (m_connGood)
-		{
-			//std::cerr << "Heartbeat!" << std::endl;
-			m_hbCount = 0;
-			return;
-		}
-
-		// Set up connection
-		m_connGood = true;
-		m_hbCount = 0;
-		m_inputQueue.clear();
-		m_interestQueue.clear();
-		m_maxSeqNo = 0;	// reset seqNo tracking
-
-		std::cout << "Received data: "
-				  << std::string(reinterpret_cast<const char*>(data.getContent().value()),
-															   data.getContent().value_size())
-				  << std::endl;
-
-		//std::cout << "Data name: " << data.getName().toUri() << std::endl;
-	}
-
-	// For future: Maybe implement at least a message
-	void
-	onTimeout(const ndn::Interest& interest)
-	{
-		// re-express interest: no need to retransmit for this case (?)
-		//std::cerr << "Timeout for: " << interest << std::endl;
-		//m_face.expressInterest(interest.getName(),
-		//						std::bind(&Controller::onData, this, _2),
-		//						std::bind(&Controller::onTimeout, this, _1));
-	}
-	
-	// For future: Maybe implement at least a message
-	void
-	onNetworkNack(const ndn::Interest& interest)
-	{
-
-	}
-
-	// Request heartbeat from playback module
-	void
-	requestNext()
-	{
-		heartbeatNonce = rand();
-		// Express interest for heartbeat message
-		m_face.expressInterest(ndn::Interest(ndn::Name(
-											"/topo-prefix/" + m_remoteName + "/midi-ndn/" + m_projName
-											).append(m_devName + "/heartbeat"))
-								.setMustBeFresh(true)
-								.setInterestLifetime(ndn::time::seconds(HEARTBEAT_PERIOD_S))
-								.setNonce(heartbeatNonce),
-								std::bind(&Controller::onData, this, _2),
-								std::bind(&Controller::onTimeout, this, _1),
-								std::bind(&Controller::onNetworkNack, this, _1));
-		
-		//std::cerr << "Sending out interest: " << m_baseName << std::endl;
-	}
-
-	// Respond to interest with data
-	void
-	sendData(const ndn::Name& dataName, const char *buf, size_t size)
-	{
-		// Create data packet with the same name as interest
-		std::shared_ptr<ndn::Data> data = std::make_shared<ndn::Data>(dataName);
-
-		// Prepare and assign content of the data packet
-		data->setContent(reinterpret_cast<const uint8_t*>(buf), size);
-
-		// Set metainfo parameters
-		data->setFreshnessPeriod(ndn::time::seconds(1));
-
-		// Sign data packet
-		m_keyChain.sign(*data);
-
-		// Make data packet available for fetching
-		m_face.put(*data);
-	}
-
-	// Send interest for heartbeat message or reset connection
-	void
-	sendHeartbeat()
-	{
-		while (true)
-		{
-			m_hbCount += 1;
-			// Send interest for heartbeat message
-			requestNext();
-			//std::cerr << "HEARTBEAT: " << m_hbCount << std::endl;
-
-			if (m_hbCount > MAX_HEARTBEAT_PROBE && m_connGood)
-			{
-				//std::cerr << "Heartbeat failed! Resetting connection..." << std::endl;
-				std::cerr << "Resetting connection..." << std::endl;
-				m_connGood = false;
-			}
-
-			std::this_thread::sleep_for(std::chrono::seconds(HEARTBEAT_PERIOD_S));
-		}
-	}
-
-	ndn::Face& m_face;
-	ndn::KeyChain m_keyChain;
-	ndn::Name m_baseName;
-
-	std::string m_projName;
-
-	bool m_connGood;
-	std::string m_remoteName;
-	std::string m_devName;
-	std::deque<MIDIMessage> m_inputQueue;
-	std::deque<ndn::Name> m_interestQueue;
-	MIDIMessage midiBuf[10]; // For multi-message sending
-
-	int m_maxSeqNo;
-	int m_hbCount;
-
-	std::thread heartbeatProbe;
-	int heartbeatNonce;
-
-public:
-	//add RtMidiIn instance to the class
-	RtMidiIn *midiin;
-};
+#include "Realtime.h"
+#include "Controller.h"
 
 void
 printTitle()
@@ -349,15 +61,6 @@ void input_listener(Controller& controller)
 	}
 }
 
-void output_sender(Controller& controller)
-{
-	while (true)
-	{
-		controller.replyInterest();
-		//std::this_thread::sleep_for(std::chrono::milliseconds(1));
-	}
-}
-
 // Beginning of RtMidi functions
 void usage( void ) 
 {
@@ -396,31 +99,106 @@ void midiLoop(char input)
 	std::cin.get(input);
 }
 
-// Non-blocking function to get MIDI messages
-void midiLoopNoBlock(RtMidiIn *midiin, std::vector<unsigned char> message, Controller& controller)
+// Threadless input: adds the RtMidiIn descriptors to the face's
+// io_service so MIDI is read on the same thread as NDN
+class MidiInputWatcher
 {
-	bool done = false;
-	double stamp;
-	int nBytes;
-	char messageThree[3];
-	while ( !done ) {
-    	stamp = midiin->getMessage( &message );
-    	nBytes = message.size();
-    	// for (int i=0; i<nBytes; i++ ){
-     //  		std::cout << "Byte " << i << " = " << (unsigned char)message[i] << ", ";
-     //  	}
-    	if ( nBytes >= 3 ){
-    		//std::cout << std::endl;
-      		for (int i=0; i<nBytes; i++){
-      			if (i < 3){
-      				messageThree[i] = (unsigned char)message[i];
-      				//std::cout << (unsigned char)messageThree[i] << ", ";
-      			}
-      		}
-      		//std::cout << std::endl;
-      		controller.addInput(messageThree);
+public:
+	MidiInputWatcher(boost::asio::io_service& io, RtMidiIn *midiin)
+		: m_midiin(midiin)
+	{
+		std::vector<int> fds;
+		m_midiin->getPollDescriptors(fds);
+		for (unsigned int i = 0; i < fds.size(); ++i)
+		{
+			m_descriptors.push_back(std::make_shared<boost::asio::posix::stream_descriptor>(io, fds[i]));
+			wait(m_descriptors.back());
 		}
 	}
+
+	~MidiInputWatcher()
+	{
+		// The descriptors belong to RtMidi, so don't let Asio close them
+		for (unsigned int i = 0; i < m_descriptors.size(); ++i)
+			m_descriptors[i]->release();
+	}
+
+private:
+	void
+	wait(std::shared_ptr<boost::asio::posix::stream_descriptor> descriptor)
+	{
+		descriptor->async_read_some(boost::asio::null_buffers(),
+			[this, descriptor] (const boost::system::error_code& error, size_t) {
+				if (error)
+					return;
+				m_midiin->processPending();
+				wait(descriptor);
+			});
+	}
+
+	RtMidiIn *m_midiin;
+	std::vector<std::shared_ptr<boost::asio::posix::stream_descriptor>> m_descriptors;
+};
+
+// Used in threadless mode to queue each message as RtMidi reads it
+void addInputCallback(const RtMidiMessage& message, void *userData)
+{
+	if (message.size() >= 3)
+		static_cast<Controller*>(userData)->addInput(message);
+}
+
+void printUsage(const char *program)
+{
+	std::cerr << "Usage: " << program << " [options] <remote name> <device name> [project name]" << std::endl
+			  << "  --threadless  read MIDI input on the NDN event loop instead of its own thread" << std::endl
+			  << "  --channels=LIST  only forward these MIDI channels, e.g. --channels=1,2,10" << std::endl
+			  << "  --drop=LIST   drop these message types: noteoff, noteon, polypressure," << std::endl
+			  << "                cc, program, pressure, pitchbend" << std::endl
+			  << realtimeUsage()
+			  << traceUsage()
+			  << logUsage();
+}
+
+// Parses a comma separated list of channels 1-16 into a channel mask
+bool parseChannels(const std::string& list, unsigned int& channels)
+{
+	std::istringstream items(list);
+	std::string item;
+	channels = 0;
+	while (std::getline(items, item, ','))
+	{
+		int channel = atoi(item.c_str());
+		if (channel < 1 || channel > 16)
+			return false;
+		channels |= 1 << (channel - 1);
+	}
+	return channels != 0;
+}
+
+// Parses a comma separated list of message type names into a type mask
+bool parseDropTypes(const std::string& list, unsigned int& types)
+{
+	static const std::map<std::string, unsigned int> names = {
+		{"noteoff", RtMidiIn::NOTE_OFF},
+		{"noteon", RtMidiIn::NOTE_ON},
+		{"polypressure", RtMidiIn::POLY_PRESSURE},
+		{"cc", RtMidiIn::CONTROL_CHANGE},
+		{"program", RtMidiIn::PROGRAM_CHANGE},
+		{"pressure", RtMidiIn::CHANNEL_PRESSURE},
+		{"pitchbend", RtMidiIn::PITCH_BEND}
+	};
+
+	std::istringstream items(list);
+	std::string item;
+	types = 0;
+	while (std::getline(items, item, ','))
+	{
+		auto name = names.find(item);
+		if (name == names.end())
+			return false;
+		types |= name->second;
+	}
+	return true;
 }
 
 int main(int argc, char *argv[])
@@ -428,26 +206,70 @@ int main(int argc, char *argv[])
 	std::string remoteName;
 	std::string devName;
 	std::string projName = "tmp-proj";
-	std::vector<unsigned char> message; 
-	
-	if (argc > 2)
+	bool threadless = false;
+	unsigned int channels = 0xFFFF;
+	unsigned int dropTypes = 0;
+
+	// Options come before the positional arguments
+	int argi = 1;
+	for (; argi < argc && std::string(argv[argi]).compare(0, 2, "--") == 0; ++argi)
 	{
-		remoteName = argv[1];
-		devName = argv[2];
+		std::string option = argv[argi];
+		if (option == "--threadless")
+			threadless = true;
+		else if (option.compare(0, 11, "--channels=") == 0)
+		{
+			if (!parseChannels(option.substr(11), channels))
+			{
+				std::cerr << "Bad channel list " << option << std::endl;
+				printUsage(argv[0]);
+				return 1;
+			}
+		}
+		else if (option.compare(0, 7, "--drop=") == 0)
+		{
+			if (!parseDropTypes(option.substr(7), dropTypes))
+			{
+				std::cerr << "Bad message type list " << option << std::endl;
+				printUsage(argv[0]);
+				return 1;
+			}
+		}
+		else if (!parseRealtimeOption(option) && !parseTraceOption(option)
+				 && !parseLogOption(option))
+		{
+			std::cerr << "Unknown option " << option << std::endl;
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (argc - argi > 1)
+	{
+		remoteName = argv[argi];
+		devName = argv[argi + 1];
 	}
 	else
 	{
 		std::cerr << "Must specify a remote name and device name!" << std::endl;
+		printUsage(argv[0]);
 		return 1;
 	}
 
-	if (argc > 3)
+	if (argc - argi > 2)
 	{
-		projName = argv[3];
+		projName = argv[argi + 2];
 	}
 
 	printTitle();
 
+	startRealtime();
+	startTrace("ControllerMIDI " + devName);
+	startLogger();
+
+	// In threadless mode MIDI is read on the NDN event loop
+	enterThread(threadless ? ROLE_MIDI : ROLE_NETWORK, "main");
+
 	try 
 	{
 		// Create Face instance
@@ -458,9 +280,22 @@ int main(int argc, char *argv[])
 
 		// Create RTMidiIn instance
 		controller.midiin = new RtMidiIn();
+		controller.midiin->setThreadOptions(realtimeMidiOptions());
+
+		// In threadless mode messages go straight to the controller
+		if (threadless)
+		{
+			controller.midiin->setThreadless();
+			controller.midiin->setMessageCallback(&addInputCallback, &controller);
+		}
+
+		// Unwanted traffic is dropped by RtMidi before it is queued
+		controller.midiin->filterMessages(dropTypes, channels);
 
 		// Choose MIDI port or create virtual port
 		if ( chooseMidiPort( controller.midiin ) == false ) goto cleanup;
+		if (!threadless)
+			reportMidiThread(*controller.midiin, "RtMidi input");
 	 	//controller.midiin->setCallback( &mycallback );
 
      	// Don't ignore sysex, timing, or active sensing messages.
@@ -469,7 +304,12 @@ int main(int argc, char *argv[])
      	std::cout << "\nReading MIDI input ... press <enter> to quit.\n";
 
      	// Get MIDI input
-		std::thread midiThread(midiLoopNoBlock, controller.midiin, message, std::ref(controller));
+		std::unique_ptr<MidiInputWatcher> midiWatcher;
+		std::thread midiThread;
+		if (threadless)
+			midiWatcher.reset(new MidiInputWatcher(face.getIoService(), controller.midiin));
+		else
+			midiThread = std::thread(midiLoopBurst, controller.midiin, std::ref(controller));
 		
 		// Create thread with call to replyInterest()
 		std::thread outputThread(output_sender, std::ref(controller));
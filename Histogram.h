@@ -0,0 +1,172 @@
+/********************************
+
+Histogram.h
+Fixed-size latency histograms for the stages of ControllerMIDI and
+PlaybackModuleMIDI
+
+Values are nanoseconds. Below 32 ns each value has its own bucket;
+above that every power of two is split into 32 buckets, so a bucket
+is never wider than about 3% of its values, from one microsecond up to
+HISTOGRAM_MAX_BITS (about two minutes, larger values go in the last
+bucket). Recording a value is one relaxed atomic increment, and the
+bucket layout is the same in every build, so histograms from several
+processes are merged by adding their counts bucket by bucket.
+
+********************************/
+
+#ifndef NDNMIDI_HISTOGRAM_H
+#define NDNMIDI_HISTOGRAM_H
+
+#include <atomic>
+#include <ostream>
+
+// Buckets per power of two, as a power of two
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+
+// Values up to 2^37 ns (137 seconds) are kept apart
+#define HISTOGRAM_MAX_BITS 37
+#define HISTOGRAM_BUCKETS ((HISTOGRAM_MAX_BITS - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+class Histogram
+{
+public:
+	Histogram()
+	{
+		reset();
+	}
+
+	// Adds a value in nanoseconds; negative values count as 0
+	void
+	record(long long value)
+	{
+		m_buckets[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void
+	reset()
+	{
+		for (unsigned int i = 0; i < HISTOGRAM_BUCKETS; ++i)
+			m_buckets[i].store(0, std::memory_order_relaxed);
+	}
+
+	// Adds count values to a bucket, as read from another histogram
+	void
+	addBucket(unsigned int bucket, unsigned long long count)
+	{
+		if (bucket < HISTOGRAM_BUCKETS)
+			m_buckets[bucket].fetch_add(count, std::memory_order_relaxed);
+	}
+
+	void
+	merge(const Histogram& other)
+	{
+		for (unsigned int i = 0; i < HISTOGRAM_BUCKETS; ++i)
+			addBucket(i, other.count(i));
+	}
+
+	unsigned long long
+	count(unsigned int bucket) const
+	{
+		return m_buckets[bucket].load(std::memory_order_relaxed);
+	}
+
+	unsigned long long
+	total() const
+	{
+		unsigned long long sum = 0;
+		for (unsigned int i = 0; i < HISTOGRAM_BUCKETS; ++i)
+			sum += count(i);
+		return sum;
+	}
+
+	// Upper end of the bucket holding the given fraction of the values,
+	// 0 if there are none
+	long long
+	percentile(double fraction) const
+	{
+		unsigned long long sum = total();
+		if (sum == 0)
+			return 0;
+
+		unsigned long long rank = (unsigned long long)(fraction * sum);
+		if (rank >= sum)
+			rank = sum - 1;
+		unsigned long long seen = 0;
+		for (unsigned int i = 0; i < HISTOGRAM_BUCKETS; ++i)
+		{
+			seen += count(i);
+			if (seen > rank)
+				return highestOf(i);
+		}
+		return highestOf(HISTOGRAM_BUCKETS - 1);
+	}
+
+	// Writes the percentile table as a JSON object, in microseconds
+	void
+	printPercentiles(std::ostream& out) const
+	{
+		out << "{\"count\": " << total()
+			<< ", \"p50\": " << percentile(0.5) / 1000.0
+			<< ", \"p90\": " << percentile(0.9) / 1000.0
+			<< ", \"p99\": " << percentile(0.99) / 1000.0
+			<< ", \"p99_9\": " << percentile(0.999) / 1000.0
+			<< ", \"max\": " << percentile(1.0) / 1000.0 << "}";
+	}
+
+	// Writes the non-empty buckets as a JSON object of
+	// "bucket": count members, which addBucket() takes back
+	void
+	printBuckets(std::ostream& out) const
+	{
+		out << "{";
+		bool first = true;
+		for (unsigned int i = 0; i < HISTOGRAM_BUCKETS; ++i)
+		{
+			unsigned long long n = count(i);
+			if (n == 0)
+				continue;
+			out << (first ? "" : ", ") << "\"" << i << "\": " << n;
+			first = false;
+		}
+		out << "}";
+	}
+
+	static unsigned int
+	bucketOf(long long value)
+	{
+		if (value < HISTOGRAM_SUB_BUCKETS)
+			return value < 0 ? 0 : (unsigned int) value;
+
+		int msb = 63 - __builtin_clzll((unsigned long long) value);
+		if (msb >= HISTOGRAM_MAX_BITS)
+			return HISTOGRAM_BUCKETS - 1;
+		int shift = msb - HISTOGRAM_SUB_BITS;
+		return (shift + 1) * HISTOGRAM_SUB_BUCKETS
+			+ (unsigned int)(value >> shift) - HISTOGRAM_SUB_BUCKETS;
+	}
+
+	// Smallest and largest values of a bucket
+	static long long
+	lowestOf(unsigned int bucket)
+	{
+		if (bucket < HISTOGRAM_SUB_BUCKETS)
+			return bucket;
+		unsigned int shift = bucket / HISTOGRAM_SUB_BUCKETS - 1;
+		return (long long)(HISTOGRAM_SUB_BUCKETS + bucket % HISTOGRAM_SUB_BUCKETS) << shift;
+	}
+
+	static long long
+	highestOf(unsigned int bucket)
+	{
+		if (bucket < HISTOGRAM_SUB_BUCKETS)
+			return bucket;
+		unsigned int shift = bucket / HISTOGRAM_SUB_BUCKETS - 1;
+		return lowestOf(bucket) + (1LL << shift) - 1;
+	}
+
+private:
+	std::atomic<unsigned long long> m_buckets[HISTOGRAM_BUCKETS];
+};
+
+#endif
@@ -0,0 +1,206 @@
+/********************************
+
+Logger.cpp
+Asynchronous leveled logging for ControllerMIDI and PlaybackModuleMIDI
+
+********************************/
+
+#include "Logger.h"
+#include "Realtime.h"
+#include "RtMidi.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <stdlib.h>
+#include <string.h>
+
+// How often the logger thread drains the rings
+#define LOG_DRAIN_MS 10
+
+std::atomic<int> logLevel(LOG_OFF);
+
+// Level to use once the logger is started
+static int requestedLevel = LOG_INFO;
+
+static const char *levelNames[LOG_OFF + 1] = {
+	"debug", "info", "warn", "error", "off"
+};
+
+// The records of one thread. Only that thread advances head and only
+// the drain advances tail.
+struct LogRing
+{
+	std::atomic<unsigned long long> head;
+	std::atomic<unsigned long long> tail;
+	std::atomic<unsigned long long> dropped;
+	unsigned long long reported;
+	LogRecord records[LOG_RING_RECORDS];
+};
+
+// Guards the list of rings; drainMutex makes the drain single-consumer
+static std::mutex registryMutex;
+static std::mutex drainMutex;
+static std::vector<LogRing *> rings;
+
+static thread_local LogRing *threadRing = NULL;
+
+static LogRing *
+getThreadRing()
+{
+	if (threadRing != NULL)
+		return threadRing;
+
+	LogRing *ring = new LogRing;
+	ring->head.store(0, std::memory_order_relaxed);
+	ring->tail.store(0, std::memory_order_relaxed);
+	ring->dropped.store(0, std::memory_order_relaxed);
+	ring->reported = 0;
+
+	std::lock_guard<std::mutex> lock(registryMutex);
+	rings.push_back(ring);
+	threadRing = ring;
+	return ring;
+}
+
+static void
+formatText(std::ostream& out, const LogRecord& record)
+{
+	out << record.text << std::endl;
+}
+
+bool
+parseLogOption(const std::string& option)
+{
+	if (option.compare(0, 6, "--log=") != 0)
+		return false;
+
+	std::string name = option.substr(6);
+	for (int level = LOG_DEBUG; level <= LOG_OFF; ++level)
+	{
+		if (name == levelNames[level])
+		{
+			requestedLevel = level;
+			return true;
+		}
+	}
+	std::cerr << "Unknown log level " << name << ", using info" << std::endl;
+	return true;
+}
+
+const char *
+logUsage()
+{
+	return "  --log=LEVEL   print debug, info, warn or error messages and above, or off (default info)\n";
+}
+
+void
+logRecord(LogLevel level, LogFormat format, const char *text,
+		  const void *bytes, unsigned int size, int arg0, int arg1, int arg2)
+{
+	if (!logEnabled(level))
+		return;
+
+	LogRing *ring = getThreadRing();
+	unsigned long long head = ring->head.load(std::memory_order_relaxed);
+	if (head - ring->tail.load(std::memory_order_acquire) >= LOG_RING_RECORDS)
+	{
+		ring->dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	LogRecord& record = ring->records[head % LOG_RING_RECORDS];
+	record.format = format;
+	record.text = text;
+	record.level = level;
+	record.time = RtMidi::getTime();
+	record.args[0] = arg0;
+	record.args[1] = arg1;
+	record.args[2] = arg2;
+	record.size = std::min(size, (unsigned int) LOG_RECORD_BYTES);
+	if (record.size > 0)
+		memcpy(record.bytes, bytes, record.size);
+	ring->head.store(head + 1, std::memory_order_release);
+}
+
+void
+logText(LogLevel level, const char *text)
+{
+	logRecord(level, &formatText, text);
+}
+
+void
+flushLog()
+{
+	std::lock_guard<std::mutex> drain(drainMutex);
+	std::vector<LogRing *> current;
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+		current = rings;
+	}
+
+	// Records of all threads are printed in the order they were logged
+	std::vector<const LogRecord *> batch;
+	std::vector<std::pair<LogRing *, unsigned long long> > ends;
+	for (LogRing *ring : current)
+	{
+		unsigned long long tail = ring->tail.load(std::memory_order_relaxed);
+		unsigned long long head = ring->head.load(std::memory_order_acquire);
+		for (unsigned long long i = tail; i < head; ++i)
+			batch.push_back(&ring->records[i % LOG_RING_RECORDS]);
+		ends.push_back(std::make_pair(ring, head));
+	}
+	std::stable_sort(batch.begin(), batch.end(),
+					 [] (const LogRecord *a, const LogRecord *b) { return a->time < b->time; });
+
+	for (const LogRecord *record : batch)
+		record->format(record->level >= LOG_WARN ? std::cerr : std::cout, *record);
+
+	// Hand the slots back only after they were formatted
+	for (unsigned int i = 0; i < ends.size(); ++i)
+	{
+		LogRing *ring = ends[i].first;
+		ring->tail.store(ends[i].second, std::memory_order_release);
+
+		unsigned long long dropped = ring->dropped.load(std::memory_order_relaxed);
+		if (dropped != ring->reported)
+		{
+			std::cerr << "Logger: " << dropped - ring->reported
+					  << " messages dropped, output is too slow" << std::endl;
+			ring->reported = dropped;
+		}
+	}
+	std::cout.flush();
+}
+
+static void
+flushLogAtExit()
+{
+	flushLog();
+}
+
+static void
+drainLoop()
+{
+	enterThread(ROLE_UI, "logger");
+	while (true)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(LOG_DRAIN_MS));
+		flushLog();
+	}
+}
+
+void
+startLogger()
+{
+	logLevel = requestedLevel;
+	if (requestedLevel == LOG_OFF)
+		return;
+
+	atexit(flushLogAtExit);
+	std::thread(drainLoop).detach();
+}
@@ -0,0 +1,89 @@
+/********************************
+
+Logger.h
+Asynchronous leveled logging for ControllerMIDI and PlaybackModuleMIDI
+
+A log call copies a fixed-size binary record into the calling thread's
+ring and returns. It does no formatting and no I/O. A background thread
+started by startLogger() drains the rings and formats each record with
+the function stored in it. Records below the level given with --log=
+are skipped before anything is copied. Until startLogger() is called
+nothing is logged at all, which is what the benchmarks rely on.
+
+If a ring is full the record is dropped and counted, so a slow terminal
+never holds up the MIDI path.
+
+********************************/
+
+#ifndef NDNMIDI_LOGGER_H
+#define NDNMIDI_LOGGER_H
+
+#include <atomic>
+#include <ostream>
+#include <string>
+
+// Records per thread ring, a power of two
+#ifndef LOG_RING_RECORDS
+#define LOG_RING_RECORDS 4096
+#endif
+
+// Payload bytes per record, enough for a packet of ten MIDI messages
+#define LOG_RECORD_BYTES 30
+
+enum LogLevel
+{
+	LOG_DEBUG,
+	LOG_INFO,
+	LOG_WARN,
+	LOG_ERROR,
+	LOG_OFF
+};
+
+struct LogRecord;
+
+// Writes a record as text, on the logger thread
+typedef void (*LogFormat)(std::ostream& out, const LogRecord& record);
+
+struct LogRecord
+{
+	LogFormat format;
+	const char *text;
+	int level;                 // warnings and errors go to std::cerr
+	long long time;            // RtMidi::getTime() nanoseconds
+	int args[3];
+	unsigned int size;         // bytes used
+	char bytes[LOG_RECORD_BYTES];
+};
+
+extern std::atomic<int> logLevel;
+
+// Whether records of a level are kept; check before gathering arguments
+inline bool logEnabled(LogLevel level)
+{
+	return level >= logLevel.load(std::memory_order_relaxed);
+}
+
+// Handles "--log=<level>" and returns true,
+// or returns false if the option is not a log option
+bool parseLogOption(const std::string& option);
+
+// Usage lines for the log options
+const char *logUsage();
+
+// Starts the logger thread at the level given with --log (info by
+// default). Call once from main.
+void startLogger();
+
+// Queues a record to be formatted later by format. Up to
+// LOG_RECORD_BYTES of bytes are copied, text must outlive the record.
+void logRecord(LogLevel level, LogFormat format, const char *text,
+			   const void *bytes = NULL, unsigned int size = 0,
+			   int arg0 = 0, int arg1 = 0, int arg2 = 0);
+
+// Queues a line of static text
+void logText(LogLevel level, const char *text);
+
+// Formats every queued record now, e.g. before exiting
+void flushLog();
+
+#endif
@@ -0,0 +1,25 @@
+/********************************
+
+Names.h
+Name components that ControllerMIDI and PlaybackModuleMIDI look for in
+the names of incoming packets
+
+They are built once, so that telling what a packet is for compares a
+few bytes instead of building a string of every component.
+
+********************************/
+
+#ifndef NDNMIDI_NAMES_H
+#define NDNMIDI_NAMES_H
+
+#include <ndn-cxx/name.hpp>
+
+const ndn::name::Component COMPONENT_HEARTBEAT("heartbeat");
+const ndn::name::Component COMPONENT_SHUTDOWN("shutdown");
+// Status requests are <baseName>/status/<request>
+const ndn::name::Component COMPONENT_STATUS("status");
+const ndn::name::Component COMPONENT_STATS("stats");
+const ndn::name::Component COMPONENT_HISTOGRAMS("histograms");
+const ndn::name::Component COMPONENT_TRACE("trace");
+
+#endif
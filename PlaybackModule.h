@@ -0,0 +1,958 @@
+/********************************
+
+PlaybackModule.h
+Requires NFD, ndn-cxx, RtMidi.cpp, and RtMidi.h to compile
+
+The playback side of NDN-MIDI: accepts connections from ControllerMIDI,
+requests its MIDI messages and plays them on an RtMidiOut port
+
+Used by PlaybackModuleMIDI and the benchmarks
+
+********************************/
+
+#ifndef NDNMIDI_PLAYBACK_MODULE_H
+#define NDNMIDI_PLAYBACK_MODULE_H
+
+#include <ndn-cxx/face.hpp>
+#include <ndn-cxx/interest.hpp>
+#include <ndn-cxx/data.hpp>
+#include <ndn-cxx/security/key-chain.hpp>
+
+#include <iostream>
+#include <string>
+#include <map>
+#include <set>
+#include <thread>
+#include <sstream>
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "RtMidi.h"
+#include "Realtime.h"
+#include "Stats.h"
+#include "Histogram.h"
+#include "Trace.h"
+#include "Probes.h"
+#include "Logger.h"
+#include "AllocCheck.h"
+#include "Names.h"
+
+// Define platform-dependent sleep routines.
+#if defined(__WINDOWS_MM__)
+  #include <windows.h>
+  #define SLEEP( milliseconds ) Sleep( (DWORD) milliseconds ) 
+#else // Unix variants
+  #include <unistd.h>
+  #define SLEEP( milliseconds ) usleep( (unsigned long) (milliseconds * 1000.0) )
+#endif
+
+// Define number of interests sent once connection is made with ControllerMIDI
+#define PREWARM_AMOUNT 5
+
+// Define maximum time for connection with ControllerMIDI to be inactive 
+#define MAX_INACTIVE_TIME 5
+
+// Define maximum number of MIDI channels
+#define MAX_CHANNELS 16
+
+// MIDI message information for a single connection
+struct MIDIControlBlock
+{
+	int minSeqNo;
+	int maxSeqNo;
+	int inactiveTime;
+	int channel;
+	// Made once at connection setup, so packets need not build them
+	std::string remoteName;   // as in the controller's names
+	ndn::Name prefix;         // /topo-prefix/<remote>/midi-ndn/<project>
+};
+
+// Prints a packet of MIDI messages as "[ type data1 data2 Channel: n] ..."
+// followed by the sequence window
+inline void formatReceivedData(std::ostream& out, const LogRecord& record)
+{
+	out << "Received data:";
+	for (unsigned int i = 0; i + 2 < record.size; i += 3)
+	{
+		out << " [" << (((int)record.bytes[i] >> 4) & 15)
+			<< " " << (int)record.bytes[i + 1]
+			<< " " << (int)record.bytes[i + 2]
+			<< " Channel: " << record.args[0] << "]";
+	}
+	out << "\t[seq range = (" << record.args[1] << "," << record.args[2] << ")]" << std::endl;
+}
+
+// Stages a MIDI message goes through in the playback module, each with
+// its own latency histogram per connection
+enum PlaybackStage
+{
+	STAGE_RECEIVE_TO_DECODE,
+	STAGE_DECODE_TO_SEND,
+	STAGE_RECEIVE_TO_SEND,
+	PLAYBACK_STAGES
+};
+
+static const char *playbackStageNames[PLAYBACK_STAGES] = {
+	"receive_to_decode",
+	"decode_to_send",
+	"receive_to_send"
+};
+
+
+class PlaybackModule
+{
+public:
+	// Without monitorThread, checkConnections() must be called every
+	// second instead, e.g. on a simulation's virtual clock
+	PlaybackModule(ndn::Face& face, const std::string& hostname, const std::string& projname,
+				   bool monitorThread = true)
+		: m_face(face)
+		, m_baseName(ndn::Name("/topo-prefix/" + hostname + "/midi-ndn/" + projname))
+		, m_projName(projname)
+	{
+		// Set interest filter for connection setup
+		m_face.setInterestFilter(m_baseName,
+								 std::bind(&PlaybackModule::onInterest, this, _2),
+								 std::bind([] {
+									std::cerr << "Prefix registered" << std::endl;
+
+								 }),
+								 [] (const ndn::Name& prefix, const std::string& reason) {
+									std::cerr << "Failed to register prefix: " << reason << std::endl;
+								 });
+
+		// Thread to check for and remove stale connections
+		if (monitorThread)
+			cbMonitor = std::thread(&PlaybackModule::controlBlockMonitoring, this);
+
+		setupComplete = true;
+
+	}
+
+	bool
+	getSetupComplete()
+	{
+		return setupComplete;
+	}
+
+	bool
+	getViewingMenu()
+	{
+		return viewingMenu;
+	}
+
+	void
+	setViewingMenu()
+	{
+		viewingMenu = true;
+	}
+
+	void
+	unsetViewingMenu()
+	{
+		viewingMenu = false;
+	}
+
+	std::set <std::string>
+	getAllowedDevices()
+	{
+		return allowedDevices;
+	}
+
+	bool
+	getVerboseMode()
+	{
+		return verboseMode;
+	}
+
+	void
+	setVerboseMode()
+	{
+		verboseMode = true;
+	}
+
+	void
+	unsetVerboseMode()
+	{
+		verboseMode = false;
+	}
+
+	void
+	toggleVerboseMode()
+	{
+		if (verboseMode)
+		{
+			verboseMode = false;
+		}
+		else 
+		{
+			verboseMode = true;
+		}
+	}
+
+	// Print connected devices menu 
+	void
+	printConnections()
+	{
+		bool noConnections = true;
+		std::cout
+		<< " ____________________________________\n"
+		<< "|      ----- Connections -----       |\n"
+		<< "|                                    |\n";
+		for (int i = 0; i < MAX_CHANNELS; i++)
+		{
+			if (channelList[i] != "")
+			{
+				std::cout << "| Channel "
+					<< i
+					<< ": "
+					<< channelList[i];
+				int extraSpace = 24 - channelList[i].size();
+				for (int i = 0; i < extraSpace; i++) {
+					std::cout << " ";
+				}
+				std::cout << "|" << std::endl;
+				noConnections = false;
+			}
+		}
+		if (noConnections) {
+			std::cout << "| No connections                     |\n";
+		}
+		printNavFooter();
+	}
+
+	// Print footer for menus
+	void
+	printNavFooter()
+	{
+		std::cout 
+		<< "|                                    |\n"
+		<< "| Main Menu: m                       |\n"
+		<< "| Quit: q                            |\n"
+		<< "|____________________________________|\n"
+		<< std::endl
+		<< "Enter selection: ";
+	}
+
+	void
+	printAllowedDevices()
+	{
+		std::cout
+			<< " ____________________________________\n"
+			<< "|     ----- Allowed Devices ----     |\n"
+			<< "|                                    |\n";
+		if (allowedDevices.empty())
+		{
+			std::cout << "| All Devices Allowed                |\n";;
+		}
+		else 
+		{
+			std::cout << "| Allowed Devices:                   |\n";
+			std::set <std::string> :: iterator itr;
+			for (itr = allowedDevices.begin(); itr != allowedDevices.end(); ++ itr)
+			{
+				std::cout << "|     " << *itr;
+				int spaces = 31 - (*itr).size();
+				for (int i = 0; i < spaces; i++) {
+					std::cout << " ";
+				}
+				std::cout << "|" << std::endl;
+			}
+		}
+	}
+
+	void
+	printProhibitedDevices()
+	{
+		std::cout
+			<< " ____________________________________\n"
+			<< "|    ----- Prohibited Devices ----   |\n"
+			<< "|                                    |\n";
+		if (prohibitedDevices.empty())
+		{
+			std::cout << "| No devices Prohibited              |\n";
+		}
+		else 
+		{
+			std::cout << "| Prohibited Devices:                |\n";
+			std::set <std::string> :: iterator itr;
+			for (itr = prohibitedDevices.begin(); itr != prohibitedDevices.end(); ++ itr)
+			{
+				std::cout << "|     " << *itr;
+				int spaces = 31 - (*itr).size();
+				for (int i = 0; i < spaces; i++) {
+					std::cout << " ";
+				}
+				std::cout << "|" << std::endl;
+			}
+		}
+	}
+
+	void
+	printVerboseMode()
+	{
+		std::cout << std::endl;
+		if (verboseMode)
+		{
+			std::cout << "Verbose mode on. ";
+		}
+		else
+		{
+			std::cout << "Verbose mode off. ";
+		}
+		std::cout << std::endl;
+	}
+
+	// Clear all connections to external controllers
+	void
+	clearAllConnections()
+	{
+		m_lookup.clear();
+		for (int i = 0; i < MAX_CHANNELS; i++)
+		{
+			if (channelList[i] != "")
+			{
+				closeConnection(channelList[i]);
+			}
+			this->channelList[i] = "";
+		}
+		printConnections();
+	}
+
+	// Interface to set allowed and prohibited devices
+	void
+	specifyConnections()
+	{
+			std::cout << "\nWould you like to specify which devices can connect? [y/N] ";
+
+			std::string keyHit;
+			std::string keyHit2;
+	  		std::getline( std::cin, keyHit);
+			while ( keyHit == "y" ) {
+				std::cout << "\nEnter device name: ";
+				std::getline( std::cin, keyHit2);
+				allowedDevices.insert(keyHit2);
+				std::cout << "\nWould you like to specify another device? [y/N] ";
+				std::getline( std::cin, keyHit); 
+	  		}
+
+	  		std::cout << "\nWould you like to specify which devices are prohibited? [y/N] ";
+
+	  		std::getline( std::cin, keyHit);
+			while ( keyHit == "y" ) {
+				std::cout << "\nEnter device name: ";
+				std::getline( std::cin, keyHit2);
+				prohibitedDevices.insert(keyHit2);
+				std::cout << "\nWould you like to specify another device? [y/N] ";
+				std::getline( std::cin, keyHit); 
+	  		}
+
+	}
+
+
+// Packet handlers are protected so the benchmarks can call them directly
+protected:
+		
+	// Respond to interest as heartbeat message or connection setup	
+	void
+	onInterest(const ndn::Interest& interest)
+	{
+		// Heartbeats are <baseName>/<remote>/heartbeat. Status requests
+		// never end in heartbeat, so a remote may have any name.
+		const ndn::Name& name = interest.getName();
+		if (name.get(-1) != COMPONENT_HEARTBEAT)
+		{
+			if (name.size() > m_baseName.size() + 1 && name.get(m_baseName.size()) == COMPONENT_STATUS)
+				sendStatus(name);
+			return;
+		}
+
+		// Check if connection already exist
+		bool isHeartbeat = false;
+		bool connectionSuccess = true;
+		std::string content = "ACCEPTED";
+
+		// Get name of remote sending device
+		const ndn::Name::Component& remote = interest.getName().get(-2);
+		std::string remoteName = remote.toUri();
+
+		// Check if device is allowed
+		// Close connection if not allowed
+		if (!allowedDevices.empty()) 
+		{
+			if (allowedDevices.find(remoteName) == allowedDevices.end())
+			{
+				if (!viewingMenu)
+				{
+					std::cerr << "Connection denied: Device not allowed: " << remoteName << std::endl;
+				}
+				countStat(STATS_PROCESS_SLOT, STAT_REJECTED);
+				closeConnection(remoteName);
+				return;
+			}
+		}
+
+		// Check if device is prohibited
+		// Close connection if prohibited
+		if (!prohibitedDevices.empty()) 
+		{
+			if (prohibitedDevices.find(remoteName) != prohibitedDevices.end())
+			{
+				if (!viewingMenu)
+				{
+					std::cerr << "Connection denied: Device prohibited." << remoteName << std::endl;
+				}
+				countStat(STATS_PROCESS_SLOT, STAT_REJECTED);
+				closeConnection(remoteName);
+				return;
+			}
+		}
+
+		// Check if connection already exists
+		MIDIControlBlock *cb = findConnection(remote);
+		if (cb != NULL)
+		{
+			if (verboseMode && !viewingMenu) {
+				std::cerr << "Received heartbeat message: " << interest << std::endl;
+			}
+			isHeartbeat = true;
+			cb->inactiveTime = 0;
+			countStat(cb->channel, STAT_HEARTBEATS);
+		}
+
+		// Accept and create new connection
+		if (!isHeartbeat)
+		{
+			int controllerChannel = MAX_CHANNELS;
+			// Set channel to first available channel
+			for (int i = 0; i < MAX_CHANNELS; i++) 
+			{
+				if (channelList[i] == "") {
+					controllerChannel = i;
+					channelList[i] = remoteName;
+					break;
+				}
+			}
+
+			// Return error if no availble channels
+			if (controllerChannel == MAX_CHANNELS) {
+				std::cerr << "Connection denied: No available MIDI channels." << std::endl;
+				countStat(STATS_PROCESS_SLOT, STAT_REJECTED);
+				connectionSuccess = false;
+				content = "DENIED";
+			}
+		
+			// Create MIDI control block for new connection
+			if (connectionSuccess) 
+			{
+				cb = &m_lookup[remote];
+				*cb = {0, 0, 0, controllerChannel, remoteName,
+					   ndn::Name("/topo-prefix/" + remoteName + "/midi-ndn/" + m_projName)};
+				// The channel's counters start again for the new remote
+				resetStats(controllerChannel);
+				for (int i = 0; i < PLAYBACK_STAGES; ++i)
+					m_histograms[controllerChannel][i].reset();
+				countStat(controllerChannel, STAT_HEARTBEATS);
+				if (verboseMode && !viewingMenu)
+				{
+					std::cerr << "Connection accepted: " << interest << std::endl;
+				}
+			}
+		}
+
+		/*** Respond to connection request ***/
+
+		// Create data packet with the same name as the interest packet
+		std::shared_ptr<ndn::Data> data = std::make_shared<ndn::Data>(interest.getName());
+
+		// Prepare and assign content of the data packet
+		data->setContent(reinterpret_cast<const uint8_t*>(content.c_str()), content.size());
+
+		// Set metainfo parameters
+		data->setFreshnessPeriod(ndn::time::seconds(1)); 
+
+		// Sign data packet
+		m_keyChain.sign(*data);
+
+		// Make data packet available for fetching
+		m_face.put(*data);
+
+		if (!isHeartbeat)
+		{
+			SLEEP(20);
+			// "Prewarm the channel" with some interest packets to avoid initial playback latency
+			for (int i = 0; cb != NULL && i < PREWARM_AMOUNT; ++i)
+			{
+				requestNext(*cb);
+			}
+		}
+	}
+
+	void
+	onData(const ndn::Data& data)
+	{
+		ALLOC_REGION("PlaybackModule::onData");
+		long long received = RtMidi::getTime();
+
+		// Exit is data packet is a heartbeat message
+		if (data.getName().get(-1) == COMPONENT_HEARTBEAT)
+			return;
+
+		// Get sequence number of data packet
+		int seqNo;
+		{
+			// ndn-cxx decodes the number through a Block
+			ALLOC_ALLOWED();
+			seqNo = data.getName().get(-1).toSequenceNumber();
+		}
+
+		// Verify connection exists, by the remote MIDI controller's name
+		MIDIControlBlock *connection = findConnection(data.getName().get(-4));
+		if (connection == NULL)
+		{
+			// the connection doesn't exist!! The name is only built to
+			// report it
+			ALLOC_ALLOWED();
+			std::cerr << "Connection for remote user \""
+					  << data.getName().get(-4).toUri() << "\" doesn't exist!"
+					  << std::endl;
+			countStat(STATS_PROCESS_SLOT, STAT_PACKETS_IN);
+			countStat(STATS_PROCESS_SLOT, STAT_EVENTS_DROPPED, data.getContent().value_size()/3);
+			return;
+		}
+
+		// Possibly for future: CHECKPOINT 2: sequence number agrees
+		//if (m_lookup[remoteName].minSeqNo >= m_lookup[remoteName].maxSeqNo)
+		//{
+		//	// behavior yet to be defined......
+		//	std::cerr << "Corrupted block: minSeqNo >= maxSeqNo"
+		//			  << std::endl;
+		//}
+		//if (m_lookup[remoteName].minSeqNo != seqNo)
+		//{
+		//	// behavior yet to be defined
+		//	std::cerr << "Sequence number out of order --> "
+		//			  << "sent: " << m_lookup[remoteName].minSeqNo
+		//			  << "  rcvd: " << seqNo
+		//			  << std::endl;
+		//}
+
+		char buffer[30];
+		int dataSize = data.getContent().value_size();
+		// Possibly got future:
+		// if (data.getContent().value_size() != 3)
+		// {
+		// 	// incorrect data format
+		// 	// behavior yet to be defined
+		// 	std::cerr << "Incorrect data format: len = "
+		// 			  << data.getContent().value_size()
+		// 			  << " (expected 3)"
+		// 			  << std::endl;
+		// }
+
+		// Copy data to buffer and increment sequence number
+		memcpy(buffer, data.getContent().value(), dataSize);
+		
+		// Get connection information
+		MIDIControlBlock& cb = *connection;
+		countStat(cb.channel, STAT_PACKETS_IN);
+		countStat(cb.channel, STAT_EVENTS_IN, dataSize/3);
+		NDNMIDI_PROBE5(playback_data, cb.remoteName.c_str(), cb.channel, seqNo, dataSize/3, received);
+
+		// Check for valid sequence number
+		if (cb.minSeqNo > seqNo)
+		{
+			// out-of-date data, drop
+			countStat(cb.channel, STAT_OUT_OF_DATE);
+			countStat(cb.channel, STAT_EVENTS_DROPPED, dataSize/3);
+			if (verboseMode && !viewingMenu)
+			{
+				std::cerr << "Received out-of-date packet... Dropped" << std::endl;
+			}
+			return;
+		}
+		else if (cb.maxSeqNo < seqNo)
+		{
+			countStat(cb.channel, STAT_OUT_OF_ORDER);
+			countStat(cb.channel, STAT_EVENTS_DROPPED, dataSize/3);
+			if (verboseMode && !viewingMenu)
+			{
+				std::cerr << "Received packet w/ seq# somehow larger than "
+						  << "expected max value: " << seqNo
+						  << " (" << cb.maxSeqNo << ")" << std::endl;
+			}
+			return;
+		}
+
+		// Adjust sequence number window
+		int diff = seqNo - cb.minSeqNo + 1;
+		cb.minSeqNo += diff;
+		NDNMIDI_PROBE5(window_update, cb.remoteName.c_str(), cb.channel, cb.minSeqNo,
+					   cb.maxSeqNo, received);
+
+		// Create MIDI message for playback from data packet
+		for (int j = 0; j < dataSize/3; ++j){
+				// for midi message
+				this->message[0] = ((unsigned char)buffer[(j*3)] & 0b11110000) | cb.channel;
+			for (int i = 1; i < 3; ++i)
+			{
+				// for midi message
+				this->message[i] = (unsigned char)buffer[i+(j*3)];
+
+			}
+
+			// Playback of MIDI message
+			if (this->message.size()==3){
+				long long decoded = RtMidi::getTime();
+				{
+					ALLOC_REGION("RtMidiOut::sendMessage");
+					this->midiout->sendMessage(&this->message);
+				}
+				long long sent = RtMidi::getTime();
+				NDNMIDI_PROBE5(midi_output, cb.channel, this->message[0], seqNo, decoded, sent);
+				countStat(cb.channel, STAT_EVENTS_OUT);
+				Histogram *histograms = m_histograms[cb.channel];
+				histograms[STAGE_RECEIVE_TO_DECODE].record(decoded - received);
+				histograms[STAGE_DECODE_TO_SEND].record(sent - decoded);
+				histograms[STAGE_RECEIVE_TO_SEND].record(sent - received);
+
+				// The note's flow from the controller ends here
+				if (tracing())
+				{
+					traceSlice("sendMessage", decoded, sent, "channel", cb.channel);
+					traceFlow('f', "network", decoded, traceFlowId(cb.remoteName, seqNo, j));
+				}
+			}
+
+			// Special MIDI message for shutdown
+			// TODO: Implement a way to send this message 
+			if (buffer[0] == 0 && buffer[1] == 0 && buffer[2] == 0)
+			{
+				std::cerr << "Deleting table entry of: " << cb.remoteName << std::endl;
+				channelList[cb.channel] = "";
+				m_lookup.erase(data.getName().get(-4));
+				return;
+			}
+		}
+		
+		// Print the messages and sequence range, later on the logger thread
+		if (!getViewingMenu())
+		{
+			logRecord(LOG_INFO, &formatReceivedData, NULL, buffer, dataSize, cb.channel,
+					  cb.minSeqNo, cb.maxSeqNo);
+		}
+		// Request next data packets based on window size
+		for (int i = 0; i < diff; ++i)
+		{
+			requestNext(cb);
+		}
+
+		if (tracing())
+			traceSlice("onData", received, RtMidi::getTime(), "seq", seqNo);
+	}
+
+	
+	void
+	onTimeout(const ndn::Interest& interest)
+	{
+		countStat(statsSlot(interest.getName()), STAT_TIMEOUTS);
+		// For future: Possibly more than a message
+		if (verboseMode && !viewingMenu)
+		{
+			std::cerr << "Timeout for: " << interest << std::endl;
+		}
+		//m_face.expressInterest(interest,
+		//						std::bind(&PlaybackModule::onData, this, _2),
+		//						std::bind(&PlaybackModule::onTimeout, this, _1));
+	}
+
+	void 
+	onNack(const ndn::Interest& interest)
+	{
+		countStat(statsSlot(interest.getName()), STAT_NACKS);
+		// For future: Possibly more than a message
+		if (verboseMode && !viewingMenu)
+		{
+			std::cerr << "Nack received for: " << interest << std::endl;
+		}
+	}
+	
+
+protected:
+	// The connection with a remote, or NULL if there is none
+	MIDIControlBlock *
+	findConnection(const ndn::Name::Component& remote)
+	{
+		std::map<ndn::Name::Component, MIDIControlBlock>::iterator it = m_lookup.find(remote);
+		return it == m_lookup.end() ? NULL : &it->second;
+	}
+
+	void
+	requestNext(MIDIControlBlock& cb)
+	{
+		ALLOC_REGION("PlaybackModule::requestNext");
+
+		int nextSeqNo = cb.maxSeqNo;
+		
+		// Possible implementation without specifying interest lifetime
+		/** Send interest without specifying interest lifetime 
+
+		ndn::Name nextName = ndn::Name(m_baseName).appendSequenceNumber(nextSeqNo);
+		m_face.expressInterest(ndn::Interest(nextName).setMustBeFresh(true),
+								std::bind(&PlaybackModule::onData, this, _2),
+								std::bind(&PlaybackModule::onTimeout, this, _1));
+		**/
+
+		// Create and send next interest with long interest lifetime
+		{
+			// ndn-cxx allocates to build and express the interest
+			ALLOC_ALLOWED();
+			ndn::Name nextName = ndn::Name(cb.prefix).appendSequenceNumber(nextSeqNo);
+			ndn::Interest nextNameInterest = ndn::Interest(nextName);
+			nextNameInterest.setInterestLifetime(ndn::time::seconds(3600));
+			nextNameInterest.setMustBeFresh(true);
+			m_face.expressInterest(nextNameInterest,
+									std::bind(&PlaybackModule::onData, this, _2),
+									std::bind(&PlaybackModule::onNack, this, _1),
+									std::bind(&PlaybackModule::onTimeout, this, _1));
+		}
+
+		// Increment max sequence number 
+		cb.maxSeqNo++;
+		NDNMIDI_PROBE5(window_update, cb.remoteName.c_str(), cb.channel,
+					   cb.minSeqNo, cb.maxSeqNo, RtMidi::getTime());
+		countStat(cb.channel, STAT_PACKETS_OUT);
+
+		//std::cerr << "Sending out interest: " << nextName << std::endl;
+	}
+
+	// Answers <baseName>/status/stats, .../histograms,
+	// .../histograms/<channel> and .../trace
+	void
+	sendStatus(const ndn::Name& name)
+	{
+		size_t request = m_baseName.size() + 1;
+		if (name.size() == request + 1)
+		{
+			if (name.get(request) == COMPONENT_STATS)
+				sendStats(name);
+			else if (name.get(request) == COMPONENT_HISTOGRAMS)
+				sendHistograms(name);
+			else if (name.get(request) == COMPONENT_TRACE)
+				sendTrace(name);
+		}
+		else if (name.size() == request + 2 && name.get(request) == COMPONENT_HISTOGRAMS)
+			sendHistogramBuckets(name);
+	}
+
+	// Answer a stats interest with the process counters and those of
+	// every connection as JSON
+	void
+	sendStats(const ndn::Name& name)
+	{
+		StatTotals totals;
+		collectStats(totals);
+
+		std::ostringstream json;
+		json << "{\"name\": \"" << m_baseName.toUri() << "\", \"process\": {";
+		printStats(json, totals, STATS_PROCESS_SLOT);
+		json << "}, \"connections\": [";
+		bool first = true;
+		for (std::map<ndn::Name::Component, MIDIControlBlock>::iterator it = m_lookup.begin();
+			it != m_lookup.end(); ++it)
+		{
+			const MIDIControlBlock& cb = it->second;
+			json << (first ? "" : ", ")
+				 << "{\"remote\": \"" << it->second.remoteName << "\""
+				 << ", \"channel\": " << cb.channel
+				 << ", \"window\": " << cb.maxSeqNo - cb.minSeqNo
+				 << ", \"inactive_time\": " << cb.inactiveTime << ", ";
+			printStats(json, totals, cb.channel);
+			json << "}";
+			first = false;
+		}
+		json << "]}";
+		sendJson(name, json.str());
+	}
+
+	// Answer a histograms interest with the percentiles of each stage,
+	// over all connections and for each one
+	void
+	sendHistograms(const ndn::Name& name)
+	{
+		std::ostringstream json;
+		json << "{\"name\": \"" << m_baseName.toUri() << "\", \"all\": {";
+		for (int i = 0; i < PLAYBACK_STAGES; ++i)
+		{
+			Histogram all;
+			for (int channel = 0; channel < MAX_CHANNELS; ++channel)
+				all.merge(m_histograms[channel][i]);
+			json << (i ? ", " : "") << "\"" << playbackStageNames[i] << "\": ";
+			all.printPercentiles(json);
+		}
+		json << "}, \"connections\": [";
+		bool first = true;
+		for (std::map<ndn::Name::Component, MIDIControlBlock>::iterator it = m_lookup.begin();
+			it != m_lookup.end(); ++it)
+		{
+			json << (first ? "" : ", ")
+				 << "{\"remote\": \"" << it->second.remoteName << "\""
+				 << ", \"channel\": " << it->second.channel;
+			for (int i = 0; i < PLAYBACK_STAGES; ++i)
+			{
+				json << ", \"" << playbackStageNames[i] << "\": ";
+				m_histograms[it->second.channel][i].printPercentiles(json);
+			}
+			json << "}";
+			first = false;
+		}
+		json << "]}";
+		sendJson(name, json.str());
+	}
+
+	// Answer histograms/<channel> with the buckets of each stage of that
+	// channel, to be merged with those of other processes
+	void
+	sendHistogramBuckets(const ndn::Name& name)
+	{
+		int channel = atoi(name.get(-1).toUri().c_str());
+		if (channel < 0 || channel >= MAX_CHANNELS)
+			return;
+
+		std::ostringstream json;
+		json << "{\"name\": \"" << m_baseName.toUri() << "\""
+			 << ", \"remote\": \"" << channelList[channel] << "\""
+			 << ", \"channel\": " << channel;
+		for (int i = 0; i < PLAYBACK_STAGES; ++i)
+		{
+			json << ", \"" << playbackStageNames[i] << "\": ";
+			m_histograms[channel][i].printBuckets(json);
+		}
+		json << "}";
+		sendJson(name, json.str());
+	}
+
+	// Answer a trace interest once the trace writer has written the
+	// file, back on the thread that runs the face
+	void
+	sendTrace(const ndn::Name& name)
+	{
+		boost::asio::io_service& io = m_face.getIoService();
+		requestTraceWrite([this, &io, name] (long long events) {
+			io.post([this, name, events] {
+				std::ostringstream json;
+				json << "{\"name\": \"" << m_baseName.toUri() << "\""
+					 << ", \"file\": \"" << traceFile() << "\""
+					 << ", \"events\": " << events << "}";
+				sendJson(name, json.str());
+			});
+		});
+	}
+
+	void
+	sendJson(const ndn::Name& name, const std::string& content)
+	{
+		std::shared_ptr<ndn::Data> data = std::make_shared<ndn::Data>(name);
+		data->setContent(reinterpret_cast<const uint8_t*>(content.c_str()), content.size());
+		// Stale numbers are of no use to whoever is watching
+		data->setFreshnessPeriod(ndn::time::milliseconds(100));
+		m_keyChain.sign(*data);
+		m_face.put(*data);
+	}
+
+	// Stats slot of the connection an interest was sent on, named
+	// /topo-prefix/<remote>/midi-ndn/<project>/<seqNo or shutdown>
+	unsigned int
+	statsSlot(const ndn::Name& name)
+	{
+		MIDIControlBlock *cb = findConnection(name.get(-4));
+		return cb == NULL ? STATS_PROCESS_SLOT : cb->channel;
+	}
+
+	// Close the connection with remoteName
+	private:
+	void
+	closeConnection(std::string remoteName)
+	{
+		// Create and send next interest with long interest lifetime
+		ndn::Name nextName = ndn::Name("/topo-prefix/" + remoteName + "/midi-ndn/" + m_projName + "/shutdown");
+		ndn::Interest nextNameInterest = ndn::Interest(nextName);
+		nextNameInterest.setInterestLifetime(ndn::time::seconds(10));
+		nextNameInterest.setMustBeFresh(true);
+		m_face.expressInterest(nextNameInterest,
+								std::bind(&PlaybackModule::onData, this, _2),
+								std::bind(&PlaybackModule::onNack, this, _1),
+								std::bind(&PlaybackModule::onTimeout, this, _1));
+
+	}
+
+	// Check and update/remove all control blocks every second
+	void
+	controlBlockMonitoring()
+	{
+		enterThread(ROLE_TIMER, "connection monitor");
+		while (true)
+		{
+			SLEEP(1000);
+			checkConnections();
+		}
+	}
+
+protected:
+	// Count another second without heartbeat for every connection and
+	// remove those inactive for too long
+	void
+	checkConnections()
+	{
+		std::map<ndn::Name::Component, MIDIControlBlock>::iterator it = m_lookup.begin();
+		while (it != m_lookup.end())
+		{
+			if (++it->second.inactiveTime > MAX_INACTIVE_TIME)
+			{
+				std::cerr << "Deleting connection because it is not active: "
+						  << it->second.remoteName << std::endl;
+				channelList[it->second.channel] = "";
+				m_lookup.erase(it++);
+			}
+			else
+				++it;
+		}
+	}
+
+private:
+	ndn::Face& m_face;
+	ndn::KeyChain m_keyChain;
+	ndn::Name m_baseName;
+	std::string m_projName;
+
+	// Devices that are explicity stated as allowed
+	std::set <std::string> allowedDevices;
+
+	// Devices that are explicity stated as prohibited 
+	std::set <std::string> prohibitedDevices;
+
+	// Maps the remote hostname's name component to a control block
+	std::map<ndn::Name::Component, MIDIControlBlock> m_lookup;
+
+	// Thread to monitor control blocks and add/remove as necessary
+	std::thread cbMonitor;
+
+	// List of MIDI channels
+	std::string channelList[16] = {};
+
+	// Latency of each stage, per channel
+	Histogram m_histograms[MAX_CHANNELS][PLAYBACK_STAGES];
+
+	bool setupComplete = false;
+
+	bool viewingMenu = false;
+
+	bool verboseMode = false;
+
+public:
+	RtMidiOut *midiout;
+	std::vector<unsigned char> message;
+};
+
+#endif
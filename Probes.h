@@ -0,0 +1,40 @@
+/********************************
+
+Probes.h
+USDT static probes (provider "ndnmidi") at the hot-path boundaries of
+RtMidi, ControllerMIDI and PlaybackModuleMIDI
+
+Probes are compiled in when <sys/sdt.h> (systemtap-sdt-dev) is
+available, unless NDNMIDI_NO_PROBES is defined (make PROBES=0). An
+unattached probe is a single nop, and its arguments are values the
+code has at hand anyway. bpftrace or perf can attach to a running
+binary, e.g.
+
+  bpftrace -e 'usdt:./PlaybackModuleMIDI:ndnmidi:midi_output { @us = hist((arg4 - arg3) / 1000); }'
+
+Times are RtMidi::getTime() nanoseconds. On Linux that is
+CLOCK_MONOTONIC, the clock of bpftrace's nsecs.
+
+********************************/
+
+#ifndef NDNMIDI_PROBES_H
+#define NDNMIDI_PROBES_H
+
+#if !defined(NDNMIDI_NO_PROBES) && defined(__has_include)
+  #if __has_include(<sys/sdt.h>)
+    #include <sys/sdt.h>
+    #define NDNMIDI_PROBES 1
+  #endif
+#endif
+
+#if defined(NDNMIDI_PROBES)
+  #define NDNMIDI_PROBE3(name, a, b, c) DTRACE_PROBE3(ndnmidi, name, a, b, c)
+  #define NDNMIDI_PROBE4(name, a, b, c, d) DTRACE_PROBE4(ndnmidi, name, a, b, c, d)
+  #define NDNMIDI_PROBE5(name, a, b, c, d, e) DTRACE_PROBE5(ndnmidi, name, a, b, c, d, e)
+#else
+  #define NDNMIDI_PROBE3(name, a, b, c) do {} while (0)
+  #define NDNMIDI_PROBE4(name, a, b, c, d) do {} while (0)
+  #define NDNMIDI_PROBE5(name, a, b, c, d, e) do {} while (0)
+#endif
+
+#endif
@@ -0,0 +1,250 @@
+/********************************
+
+Realtime.cpp
+Process-wide real-time mode shared by ControllerMIDI and PlaybackModuleMIDI
+
+********************************/
+
+#include "Realtime.h"
+#include "Trace.h"
+
+#include <iostream>
+#include <sstream>
+#include <mutex>
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#if defined(__GLIBC__)
+  #include <malloc.h>
+#endif
+
+// Priorities of the latency-critical roles; MIDI preempts network
+#define MIDI_PRIORITY 80
+#define NETWORK_PRIORITY 70
+
+// Stack touched by each thread when it starts
+#define STACK_PREFAULT (256 * 1024)
+
+// Heap touched at startup so later allocations reuse locked pages
+#define HEAP_PREFAULT (16 * 1024 * 1024)
+
+static bool realtimeEnabled = false;
+
+// Cores for the latency-critical roles (0 for any)
+static unsigned long long realtimeCores = 0;
+
+// Keeps report lines from different threads apart
+static std::mutex reportMutex;
+
+static void
+report(const std::string& line)
+{
+	std::lock_guard<std::mutex> lock(reportMutex);
+	std::cout << "realtime: " << line << std::endl;
+}
+
+static std::string
+describeCores(unsigned long long mask)
+{
+	if (mask == 0)
+		return "any CPU";
+
+	std::ostringstream ost;
+	ost << "CPUs ";
+	bool first = true;
+	for (unsigned int i = 0; i < 64; ++i)
+	{
+		if (mask & (1ULL << i))
+		{
+			ost << (first ? "" : ",") << i;
+			first = false;
+		}
+	}
+	return ost.str();
+}
+
+static std::string
+describeOptions(const RtMidi::ThreadOptions& options)
+{
+	std::ostringstream ost;
+	if (options.policy == RtMidi::THREAD_FIFO)
+		ost << "SCHED_FIFO priority " << options.priority;
+	else if (options.policy == RtMidi::THREAD_RR)
+		ost << "SCHED_RR priority " << options.priority;
+	else
+		ost << "SCHED_OTHER";
+	ost << ", " << describeCores(options.cpuMask);
+	return ost.str();
+}
+
+static RtMidi::ThreadOptions
+roleOptions(ThreadRole role)
+{
+	RtMidi::ThreadOptions options;
+	if (role == ROLE_MIDI || role == ROLE_NETWORK)
+	{
+		options.policy = RtMidi::THREAD_FIFO;
+		options.priority = (role == ROLE_MIDI) ? MIDI_PRIORITY : NETWORK_PRIORITY;
+		options.cpuMask = realtimeCores;
+	}
+	return options;
+}
+
+bool
+parseRealtimeOption(const std::string& option)
+{
+	if (option == "--realtime")
+	{
+		realtimeEnabled = true;
+		return true;
+	}
+
+	if (option.compare(0, 8, "--cores=") == 0)
+	{
+		// Comma separated list of core numbers
+		std::istringstream list(option.substr(8));
+		std::string core;
+		while (std::getline(list, core, ','))
+		{
+			int n = atoi(core.c_str());
+			if (n >= 0 && n < 64)
+				realtimeCores |= 1ULL << n;
+		}
+		return true;
+	}
+
+	return false;
+}
+
+const char *
+realtimeUsage()
+{
+	return "  --realtime    lock memory and run MIDI and network threads with real-time priority\n"
+		   "  --cores=LIST  pin the real-time threads to these cores, e.g. --cores=2,3\n";
+}
+
+void
+startRealtime()
+{
+	if (!realtimeEnabled)
+		return;
+
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) == 0)
+		report("memory locked");
+	else
+		report(std::string("could not lock memory (") + strerror(errno) + "), check RLIMIT_MEMLOCK");
+
+#if defined(__GLIBC__)
+	// Keep freed memory in the heap instead of returning it to the
+	// system, so the prefaulted pages stay mapped
+	mallopt(M_TRIM_THRESHOLD, -1);
+	mallopt(M_MMAP_MAX, 0);
+#endif
+
+	char *pool = (char *)malloc(HEAP_PREFAULT);
+	if (pool != NULL)
+	{
+		long page = sysconf(_SC_PAGESIZE);
+		for (long i = 0; i < HEAP_PREFAULT; i += page)
+			pool[i] = 0;
+		free(pool);
+
+		std::ostringstream ost;
+		ost << "prefaulted " << HEAP_PREFAULT / 1024 << " KiB of heap";
+		report(ost.str());
+	}
+}
+
+void
+enterThread(ThreadRole role, const char *name)
+{
+	// Named in the trace whether or not real-time mode is on
+	traceThread(name);
+
+	if (!realtimeEnabled)
+		return;
+
+	// Touch the stack so it is faulted in before it is needed
+	volatile char stack[STACK_PREFAULT];
+	long page = sysconf(_SC_PAGESIZE);
+	for (long i = 0; i < STACK_PREFAULT; i += page)
+		stack[i] = 0;
+	(void)stack;
+
+	// Threads inherit the scheduling of their creator, so the normal
+	// roles are set explicitly too
+	RtMidi::ThreadOptions options = roleOptions(role);
+	std::string problems;
+
+	struct sched_param param;
+	param.sched_priority = options.priority;
+	int err = pthread_setschedparam(pthread_self(),
+		options.policy == RtMidi::THREAD_FIFO ? SCHED_FIFO : SCHED_OTHER, &param);
+	if (err)
+		problems += std::string(" (no real-time priority: ") + strerror(err) + ")";
+
+	if (realtimeCores)
+	{
+#if defined(__linux__)
+		// Real-time roles get the configured cores, the others the rest
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		long online = sysconf(_SC_NPROCESSORS_ONLN);
+		for (long i = 0; i < online && i < 64; ++i)
+		{
+			bool reserved = realtimeCores & (1ULL << i);
+			if (reserved == (options.cpuMask != 0))
+				CPU_SET(i, &cpus);
+		}
+		if (CPU_COUNT(&cpus) > 0)
+		{
+			err = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+			if (err)
+				problems += std::string(" (not pinned: ") + strerror(err) + ")";
+		}
+#else
+		problems += " (not pinned: no CPU affinity on this platform)";
+#endif
+	}
+
+	// Report what the thread really got
+	RtMidi::ThreadOptions effective;
+	int policy;
+	if (pthread_getschedparam(pthread_self(), &policy, &param) == 0 && policy == SCHED_FIFO)
+	{
+		effective.policy = RtMidi::THREAD_FIFO;
+		effective.priority = param.sched_priority;
+	}
+#if defined(__linux__)
+	cpu_set_t cpus;
+	if (realtimeCores && pthread_getaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0)
+	{
+		for (unsigned int i = 0; i < 64; ++i)
+			if (CPU_ISSET(i, &cpus))
+				effective.cpuMask |= 1ULL << i;
+	}
+#endif
+
+	report(std::string(name) + ": " + describeOptions(effective) + problems);
+}
+
+RtMidi::ThreadOptions
+realtimeMidiOptions()
+{
+	if (!realtimeEnabled)
+		return RtMidi::ThreadOptions();
+	return roleOptions(ROLE_MIDI);
+}
+
+void
+reportMidiThread(RtMidi& midi, const char *name)
+{
+	if (!realtimeEnabled)
+		return;
+	report(std::string(name) + ": " + describeOptions(midi.getThreadOptions()));
+}
@@ -0,0 +1,52 @@
+/********************************
+
+Realtime.h
+Process-wide real-time mode shared by ControllerMIDI and PlaybackModuleMIDI
+
+With --realtime, memory is locked and prefaulted at startup and every
+thread takes the scheduling of its role when it starts. Latency-critical
+roles (MIDI, network) run SCHED_FIFO on the cores given by --cores=,
+the others keep the normal policy.
+
+********************************/
+
+#ifndef NDNMIDI_REALTIME_H
+#define NDNMIDI_REALTIME_H
+
+#include <string>
+
+#include "RtMidi.h"
+
+// What a thread does, which decides how it is scheduled
+enum ThreadRole
+{
+	ROLE_MIDI,      // RtMidi threads and the MIDI input loop
+	ROLE_NETWORK,   // NDN event loop and the data sender
+	ROLE_TIMER,     // heartbeat and connection monitoring
+	ROLE_UI         // console menu
+};
+
+// Handles "--realtime" and "--cores=<list>" and returns true,
+// or returns false if the option is not a real-time option
+bool parseRealtimeOption(const std::string& option);
+
+// Usage lines for the real-time options
+const char *realtimeUsage();
+
+// Locks and prefaults memory when real-time mode is on and prints
+// what was applied. Call once from main before starting threads,
+// then enterThread() for the main thread itself.
+void startRealtime();
+
+// Applies the role's scheduling to the calling thread, prefaults its
+// stack and reports the result. Does nothing unless real-time mode is
+// on, apart from naming the thread in the trace.
+void enterThread(ThreadRole role, const char *name);
+
+// Thread options for threads that RtMidi starts itself
+RtMidi::ThreadOptions realtimeMidiOptions();
+
+// Reports the scheduling of the thread RtMidi started for a port
+void reportMidiThread(RtMidi& midi, const char *name);
+
+#endif
@@ -37,15 +37,62 @@
 /**********************************************************************/
 
 #include "RtMidi.h"
+#include <algorithm>
+#include <chrono>
 #include <sstream>
 
 #if defined(__MACOSX_CORE__)
   #if TARGET_OS_IPHONE
     #define AudioGetCurrentHostTime CAHostTimeBase::GetCurrentTime
     #define AudioConvertHostTimeToNanos CAHostTimeBase::ConvertToNanos
+    #define AudioConvertNanosToHostTime CAHostTimeBase::ConvertFromNanos
   #endif
 #endif
 
+// Instrumentation hooks of the input path.  They are empty unless
+// RTMIDI_HOOKS names a header that defines some of them, as in
+// -D RTMIDI_HOOKS='"RtMidiHooks.h"'.
+//
+//   RTMIDI_INPUT_REGION( name )
+//     Opens a scope of an input handler that must not allocate once
+//     it is warmed up.
+//   RTMIDI_INPUT_CALLBACK()
+//     Opens a scope inside one, around the application's callback,
+//     whose allocations the handler does not answer for.
+//   RTMIDI_INPUT_PROBE( port, sequence, bytes, size, time )
+//     A message passed the filters: the name of the port it came in
+//     on, its number since the port was opened, its bytes, their
+//     count and its arrival time (RtMidi::getTime() nanoseconds).
+#if defined(RTMIDI_HOOKS)
+  #include RTMIDI_HOOKS
+#endif
+#if !defined(RTMIDI_INPUT_REGION)
+  #define RTMIDI_INPUT_REGION( name ) do {} while ( 0 )
+#endif
+#if !defined(RTMIDI_INPUT_CALLBACK)
+  #define RTMIDI_INPUT_CALLBACK() do {} while ( 0 )
+#endif
+#if !defined(RTMIDI_INPUT_PROBE)
+  #define RTMIDI_INPUT_PROBE( port, sequence, bytes, size, time ) do {} while ( 0 )
+#endif
+
+// Platform clock used by RtMidi::getTime().
+#if defined(_WIN32)
+  #include <windows.h>
+#elif defined(__APPLE__)
+  #include <mach/mach_time.h>
+#else
+  #include <time.h>
+#endif
+
+// Thread scheduling used by RtMidi::setThreadOptions().
+#if !defined(_WIN32)
+  #include <pthread.h>
+  #include <sched.h>
+  #include <unistd.h>
+  #include <errno.h>
+#endif
+
 //*********************************************************************//
 //  RtMidi Definitions
 //*********************************************************************//
@@ -78,6 +125,7 @@ void RtMidi :: getCompiledApi( std::vector<RtMidi::Api> &apis ) throw()
 #endif
 #if defined(__LINUX_ALSA__)
   apis.push_back( LINUX_ALSA );
+  apis.push_back( LINUX_ALSA_RAW );
 #endif
 #if defined(__UNIX_JACK__)
   apis.push_back( UNIX_JACK );
@@ -87,6 +135,27 @@ void RtMidi :: getCompiledApi( std::vector<RtMidi::Api> &apis ) throw()
 #endif
 #if defined(__RTMIDI_DUMMY__)
   apis.push_back( RTMIDI_DUMMY );
+#endif
+  apis.push_back( RTMIDI_LOOPBACK );
+}
+
+long long RtMidi :: getTime( void ) throw()
+{
+#if defined(_WIN32)
+  LARGE_INTEGER counter, frequency;
+  QueryPerformanceCounter( &counter );
+  QueryPerformanceFrequency( &frequency );
+  return (long long) ( counter.QuadPart / frequency.QuadPart ) * 1000000000LL +
+    (long long) ( counter.QuadPart % frequency.QuadPart ) * 1000000000LL / frequency.QuadPart;
+#elif defined(__APPLE__)
+  // Host time is the clock CoreMIDI uses for packet time stamps.
+  static mach_timebase_info_data_t timebase;
+  if ( timebase.denom == 0 ) mach_timebase_info( &timebase );
+  return (long long) ( mach_absolute_time() * timebase.numer / timebase.denom );
+#else
+  struct timespec ts;
+  clock_gettime( CLOCK_MONOTONIC, &ts );
+  return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
 #endif
 }
 
@@ -107,6 +176,8 @@ void RtMidiIn :: openMidiApi( RtMidi::Api api, const std::string clientName, uns
 #if defined(__LINUX_ALSA__)
   if ( api == LINUX_ALSA )
     rtapi_ = new MidiInAlsa( clientName, queueSizeLimit );
+  if ( api == LINUX_ALSA_RAW )
+    rtapi_ = new MidiInAlsaRaw( clientName, queueSizeLimit );
 #endif
 #if defined(__WINDOWS_MM__)
   if ( api == WINDOWS_MM )
@@ -120,6 +191,8 @@ void RtMidiIn :: openMidiApi( RtMidi::Api api, const std::string clientName, uns
   if ( api == RTMIDI_DUMMY )
     rtapi_ = new MidiInDummy( clientName, queueSizeLimit );
 #endif
+  if ( api == RTMIDI_LOOPBACK )
+    rtapi_ = new MidiInLoopback( clientName, queueSizeLimit );
 }
 
 RtMidiIn :: RtMidiIn( RtMidi::Api api, const std::string clientName, unsigned int queueSizeLimit )
@@ -136,10 +209,12 @@ RtMidiIn :: RtMidiIn( RtMidi::Api api, const std::string clientName, unsigned in
   }
 
   // Iterate through the compiled APIs and return as soon as we find
-  // one with at least one port or we reach the end of the list.
+  // one with at least one port or we reach the end of the list.  The
+  // loopback API is only used when asked for.
   std::vector< RtMidi::Api > apis;
   getCompiledApi( apis );
   for ( unsigned int i=0; i<apis.size(); i++ ) {
+    if ( apis[i] == RTMIDI_LOOPBACK ) continue;
     openMidiApi( apis[i], clientName, queueSizeLimit );
     if ( rtapi_->getPortCount() ) break;
   }
@@ -176,6 +251,8 @@ void RtMidiOut :: openMidiApi( RtMidi::Api api, const std::string clientName )
 #if defined(__LINUX_ALSA__)
   if ( api == LINUX_ALSA )
     rtapi_ = new MidiOutAlsa( clientName );
+  if ( api == LINUX_ALSA_RAW )
+    rtapi_ = new MidiOutAlsaRaw( clientName );
 #endif
 #if defined(__WINDOWS_MM__)
   if ( api == WINDOWS_MM )
@@ -189,6 +266,8 @@ void RtMidiOut :: openMidiApi( RtMidi::Api api, const std::string clientName )
   if ( api == RTMIDI_DUMMY )
     rtapi_ = new MidiOutDummy( clientName );
 #endif
+  if ( api == RTMIDI_LOOPBACK )
+    rtapi_ = new MidiOutLoopback( clientName );
 }
 
 RtMidiOut :: RtMidiOut( RtMidi::Api api, const std::string clientName )
@@ -204,10 +283,12 @@ RtMidiOut :: RtMidiOut( RtMidi::Api api, const std::string clientName )
   }
 
   // Iterate through the compiled APIs and return as soon as we find
-  // one with at least one port or we reach the end of the list.
+  // one with at least one port or we reach the end of the list.  The
+  // loopback API is only used when asked for.
   std::vector< RtMidi::Api > apis;
   getCompiledApi( apis );
   for ( unsigned int i=0; i<apis.size(); i++ ) {
+    if ( apis[i] == RTMIDI_LOOPBACK ) continue;
     openMidiApi( apis[i], clientName );
     if ( rtapi_->getPortCount() ) break;
   }
@@ -231,7 +312,8 @@ RtMidiOut :: ~RtMidiOut() throw()
 //*********************************************************************//
 
 MidiApi :: MidiApi( void )
-  : apiData_( 0 ), connected_( false ), errorCallback_(0), errorCallbackUserData_(0)
+  : apiData_( 0 ), connected_( false ), errorCallback_(0), errorCallbackUserData_(0),
+    portCallback_(0), portCallbackUserData_(0)
 {
 }
 
@@ -245,6 +327,14 @@ void MidiApi :: setErrorCallback( RtMidiErrorCallback errorCallback, void *userD
     errorCallbackUserData_ = userData;
 }
 
+void MidiApi :: setPortCallback( RtMidiPortCallback callback, void * /*userData*/ )
+{
+  if ( callback ) {
+    errorString_ = "RtMidi::setPortCallback: port changes are not reported by this API.";
+    error( RtMidiError::WARNING, errorString_ );
+  }
+}
+
 void MidiApi :: error( RtMidiError::Type type, std::string errorString )
 {
   if ( errorCallback_ ) {
@@ -274,6 +364,69 @@ void MidiApi :: error( RtMidiError::Type type, std::string errorString )
   }
 }
 
+#if !defined(_WIN32)
+
+// Apply the requested scheduling options to a thread we have started
+// and read back what it actually got into 'effective'.  Returns false,
+// with a description in 'problem', if a setting could not be applied;
+// the thread then keeps running with the settings it has.
+static bool applyThreadOptions( pthread_t thread, const RtMidi::ThreadOptions &requested,
+                                RtMidi::ThreadOptions &effective, std::string &problem )
+{
+  std::ostringstream ost;
+
+  if ( requested.policy != RtMidi::THREAD_DEFAULT ) {
+    int policy = ( requested.policy == RtMidi::THREAD_FIFO ) ? SCHED_FIFO : SCHED_RR;
+    struct sched_param param;
+    param.sched_priority = std::min( std::max( requested.priority, sched_get_priority_min( policy ) ),
+                                     sched_get_priority_max( policy ) );
+    int err = pthread_setschedparam( thread, policy, &param );
+    if ( err == EPERM )
+      ost << "no permission for real-time scheduling (check RLIMIT_RTPRIO), the thread keeps the default policy. ";
+    else if ( err )
+      ost << "error setting the thread scheduling policy (" << err << "). ";
+  }
+
+  if ( requested.cpuMask ) {
+#if defined(__linux__)
+    cpu_set_t cpus;
+    CPU_ZERO( &cpus );
+    for ( unsigned int i=0; i<64 && i<CPU_SETSIZE; i++ )
+      if ( requested.cpuMask & ( 1ULL << i ) ) CPU_SET( i, &cpus );
+    int err = pthread_setaffinity_np( thread, sizeof(cpus), &cpus );
+    if ( err )
+      ost << "error setting the thread CPU affinity (" << err << "), the thread may run on any CPU. ";
+#else
+    ost << "CPU affinity is not supported on this platform. ";
+#endif
+  }
+
+  // Report what the thread really runs with.
+  effective = RtMidi::ThreadOptions();
+  int policy;
+  struct sched_param param;
+  if ( pthread_getschedparam( thread, &policy, &param ) == 0 ) {
+    if ( policy == SCHED_FIFO ) effective.policy = RtMidi::THREAD_FIFO;
+    else if ( policy == SCHED_RR ) effective.policy = RtMidi::THREAD_RR;
+    if ( effective.policy != RtMidi::THREAD_DEFAULT ) effective.priority = param.sched_priority;
+  }
+#if defined(__linux__)
+  cpu_set_t cpus;
+  if ( pthread_getaffinity_np( thread, sizeof(cpus), &cpus ) == 0 ) {
+    for ( unsigned int i=0; i<64 && i<CPU_SETSIZE; i++ )
+      if ( CPU_ISSET( i, &cpus ) ) effective.cpuMask |= 1ULL << i;
+    // A thread allowed on every CPU is reported as unrestricted.
+    if ( !requested.cpuMask && CPU_COUNT( &cpus ) == (int) sysconf( _SC_NPROCESSORS_ONLN ) )
+      effective.cpuMask = 0;
+  }
+#endif
+
+  problem = ost.str();
+  return problem.empty();
+}
+
+#endif
+
 //*********************************************************************//
 //  Common MidiInApi Definitions
 //*********************************************************************//
@@ -282,15 +435,35 @@ MidiInApi :: MidiInApi( unsigned int queueSizeLimit )
   : MidiApi()
 {
   // Allocate the MIDI queue.
-  inputData_.queue.ringSize = queueSizeLimit;
-  if ( inputData_.queue.ringSize > 0 )
-    inputData_.queue.ring = new MidiMessage[ inputData_.queue.ringSize ];
+  inputData_.queue.allocate( queueSizeLimit );
+
+  // Size the buffer handed to user callbacks so that channel messages
+  // and typical sysex dumps never reallocate it.
+  inputData_.callbackBytes.reserve( 1024 );
 }
 
 MidiInApi :: ~MidiInApi( void )
 {
-  // Delete the MIDI queue.
-  if ( inputData_.queue.ringSize > 0 ) delete [] inputData_.queue.ring;
+}
+
+void MidiInApi :: openInput( unsigned int portNumber, const std::string &portName )
+{
+  // An open port keeps its name; the backend warns about the second open.
+  if ( !connected_ ) {
+    if ( portNumber < getPortCount() ) inputData_.portName = getPortName( portNumber );
+    else inputData_.portName = portName;
+    inputData_.sequence = 0;
+  }
+  openPort( portNumber, portName );
+}
+
+void MidiInApi :: openVirtualInput( const std::string &portName )
+{
+  if ( !connected_ ) {
+    inputData_.portName = portName;
+    inputData_.sequence = 0;
+  }
+  openVirtualPort( portName );
 }
 
 void MidiInApi :: setCallback( RtMidiIn::RtMidiCallback callback, void *userData )
@@ -312,6 +485,44 @@ void MidiInApi :: setCallback( RtMidiIn::RtMidiCallback callback, void *userData
   inputData_.usingCallback = true;
 }
 
+void MidiInApi :: setMessageCallback( RtMidiIn::RtMidiMessageCallback callback, void *userData )
+{
+  if ( inputData_.usingCallback ) {
+    errorString_ = "MidiInApi::setMessageCallback: a callback function is already set!";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+
+  if ( !callback ) {
+    errorString_ = "RtMidiIn::setMessageCallback: callback function value is invalid!";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+
+  inputData_.messageCallback = callback;
+  inputData_.userData = userData;
+  inputData_.usingCallback = true;
+}
+
+void MidiInApi :: setBatchCallback( RtMidiIn::RtMidiBatchCallback callback, void *userData )
+{
+  if ( inputData_.usingCallback ) {
+    errorString_ = "MidiInApi::setBatchCallback: a callback function is already set!";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+
+  if ( !callback ) {
+    errorString_ = "RtMidiIn::setBatchCallback: callback function value is invalid!";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+
+  inputData_.batchCallback = callback;
+  inputData_.userData = userData;
+  inputData_.usingCallback = true;
+}
+
 void MidiInApi :: cancelCallback()
 {
   if ( !inputData_.usingCallback ) {
@@ -321,6 +532,8 @@ void MidiInApi :: cancelCallback()
   }
 
   inputData_.userCallback = 0;
+  inputData_.messageCallback = 0;
+  inputData_.batchCallback = 0;
   inputData_.userData = 0;
   inputData_.usingCallback = false;
 }
@@ -331,11 +544,26 @@ void MidiInApi :: ignoreTypes( bool midiSysex, bool midiTime, bool midiSense )
   if ( midiSysex ) inputData_.ignoreFlags = 0x01;
   if ( midiTime ) inputData_.ignoreFlags |= 0x02;
   if ( midiSense ) inputData_.ignoreFlags |= 0x04;
+  inputData_.compileFilter();
+}
+
+void MidiInApi :: filterMessages( unsigned int dropTypes, unsigned int channels )
+{
+  inputData_.filterTypes = dropTypes;
+  inputData_.filterChannels = channels;
+  inputData_.compileFilter();
 }
 
 double MidiInApi :: getMessage( std::vector<unsigned char> *message )
+{
+  long long absoluteTime;
+  return getMessage( message, &absoluteTime );
+}
+
+double MidiInApi :: getMessage( std::vector<unsigned char> *message, long long *absoluteTime )
 {
   message->clear();
+  *absoluteTime = 0;
 
   if ( inputData_.usingCallback ) {
     errorString_ = "RtMidiIn::getNextMessage: a user callback is currently set for this port.";
@@ -343,20 +571,272 @@ double MidiInApi :: getMessage( std::vector<unsigned char> *message )
     return 0.0;
   }
 
-  if ( inputData_.queue.size == 0 ) return 0.0;
+  const MidiMessage *queued = inputData_.queue.peek();
+  if ( queued == 0 ) return 0.0;
 
   // Copy queued message to the vector pointer argument and then "pop" it.
-  std::vector<unsigned char> *bytes = &(inputData_.queue.ring[inputData_.queue.front].bytes);
-  message->assign( bytes->begin(), bytes->end() );
-  double deltaTime = inputData_.queue.ring[inputData_.queue.front].timeStamp;
-  inputData_.queue.size--;
-  inputData_.queue.front++;
-  if ( inputData_.queue.front == inputData_.queue.ringSize )
-    inputData_.queue.front = 0;
+  message->assign( queued->data(), queued->data() + queued->size() );
+  double deltaTime = queued->timeStamp;
+  *absoluteTime = queued->absoluteTime;
+  inputData_.queue.pop();
 
   return deltaTime;
 }
 
+unsigned int MidiInApi :: getMessages( RtMidiMessage *messages, unsigned int maxCount )
+{
+  if ( inputData_.usingCallback ) {
+    errorString_ = "RtMidiIn::getMessages: a user callback is currently set for this port.";
+    error( RtMidiError::WARNING, errorString_ );
+    return 0;
+  }
+
+  // Copy each queued message into the caller's array and "pop" it.
+  unsigned int count = 0;
+  const MidiMessage *queued;
+  while ( count < maxCount && ( queued = inputData_.queue.peek() ) != 0 ) {
+    messages[count++] = *queued;
+    inputData_.queue.pop();
+  }
+
+  return count;
+}
+
+unsigned int MidiInApi :: waitForMessages( RtMidiMessage *messages, unsigned int maxCount, double timeout )
+{
+  if ( inputData_.usingCallback ) {
+    errorString_ = "RtMidiIn::waitForMessages: a user callback is currently set for this port.";
+    error( RtMidiError::WARNING, errorString_ );
+    return 0;
+  }
+
+  if ( maxCount == 0 || !inputData_.queue.wait( timeout ) ) return 0;
+  return getMessages( messages, maxCount );
+}
+
+void MidiInApi :: setThreadless( bool threadless )
+{
+  if ( threadless ) {
+    errorString_ = "RtMidiIn::setThreadless: threadless input is not supported by this API; input stays on its own thread.";
+    error( RtMidiError::WARNING, errorString_ );
+  }
+}
+
+void MidiInApi :: getPollDescriptors( std::vector<int> &descriptors )
+{
+  descriptors.clear();
+}
+
+unsigned int MidiInApi :: processPending( void )
+{
+  return 0;
+}
+
+void MidiInApi :: setQueueGrowth( bool grow )
+{
+  inputData_.queue.grow.store( grow );
+}
+
+RtMidiIn::QueueStatistics MidiInApi :: getQueueStatistics( void )
+{
+  RtMidiIn::QueueStatistics stats;
+  stats.capacity = inputData_.queue.capacity.load( std::memory_order_relaxed );
+  stats.size = inputData_.queue.size();
+  stats.highWaterMark = inputData_.queue.highWaterMark.load( std::memory_order_relaxed );
+  stats.dropped = inputData_.queue.dropped.load( std::memory_order_relaxed );
+  return stats;
+}
+
+MidiInApi::MidiQueue::Ring :: Ring( unsigned int size )
+  : slots( new MidiMessage[size] ), mask( size - 1 ), front( 0 ), back( 0 ), next( 0 )
+{
+}
+
+MidiInApi::MidiQueue::Ring :: ~Ring()
+{
+  delete [] slots;
+}
+
+MidiInApi::MidiQueue :: ~MidiQueue()
+{
+  while ( head ) {
+    Ring *next = head->next.load();
+    delete head;
+    head = next;
+  }
+}
+
+void MidiInApi::MidiQueue :: allocate( unsigned int size )
+{
+  // A size of zero means no queue: messages are only delivered to a
+  // callback, and are dropped without one.
+  if ( size == 0 ) return;
+
+  // Round the requested size up to a power of two.
+  unsigned int n = 1;
+  while ( n < size && n < 0x80000000u ) n <<= 1;
+  head = tail = new Ring( n );
+  capacity.store( n );
+}
+
+bool MidiInApi::MidiQueue :: push( const MidiMessage &message )
+{
+  Ring *ring = tail;
+  if ( ring == 0 ) {
+    // No queue, and it never grows.
+    dropped.store( dropped.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+    return false;
+  }
+  unsigned int back = ring->back.load( std::memory_order_relaxed );
+  if ( back - ring->front.load( std::memory_order_acquire ) > ring->mask ) {
+    if ( !grow.load( std::memory_order_relaxed ) || ring->mask >= 0x7FFFFFFFu ) {
+      dropped.store( dropped.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+      return false;
+    }
+
+    // Carry on in a ring of twice the size.  The consumer finds it
+    // through 'next' once it has emptied this one.
+    Ring *bigger = new Ring( ( ring->mask + 1 ) * 2 );
+    ring->next.store( bigger, std::memory_order_release );
+    tail = ring = bigger;
+    back = 0;
+    capacity.store( ring->mask + 1, std::memory_order_relaxed );
+  }
+
+  ring->slots[back & ring->mask] = message;
+  ring->back.store( back + 1, std::memory_order_release );
+
+  unsigned long long count = pushed.load( std::memory_order_relaxed ) + 1;
+  pushed.store( count, std::memory_order_release );
+  unsigned int depth = (unsigned int) ( count - popped.load( std::memory_order_acquire ) );
+  if ( depth > highWaterMark.load( std::memory_order_relaxed ) )
+    highWaterMark.store( depth, std::memory_order_relaxed );
+  return true;
+}
+
+const MidiInApi::MidiMessage *MidiInApi::MidiQueue :: peek( void )
+{
+  while ( head ) {
+    unsigned int front = head->front.load( std::memory_order_relaxed );
+    if ( front != head->back.load( std::memory_order_acquire ) )
+      return &head->slots[front & head->mask];
+
+    // This ring is empty.  If the producer has moved on, everything it
+    // wrote here is visible once 'next' is, so check once more before
+    // freeing the ring and following it.
+    Ring *next = head->next.load( std::memory_order_acquire );
+    if ( next == 0 ) return 0;
+    if ( front != head->back.load( std::memory_order_acquire ) ) continue;
+    delete head;
+    head = next;
+  }
+  return 0;
+}
+
+void MidiInApi::MidiQueue :: notify( void )
+{
+  // Pairs with the fence in wait(): either the reader sees the message
+  // we just pushed, or we see that it is waiting and wake it.
+  std::atomic_thread_fence( std::memory_order_seq_cst );
+  if ( waiting.load( std::memory_order_relaxed ) ) {
+    std::lock_guard<std::mutex> lock( mutex );
+    ready.notify_one();
+  }
+}
+
+bool MidiInApi::MidiQueue :: wait( double timeout )
+{
+  std::unique_lock<std::mutex> lock( mutex );
+  waiting.store( true, std::memory_order_relaxed );
+  std::atomic_thread_fence( std::memory_order_seq_cst );
+
+  std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() +
+    std::chrono::duration_cast<std::chrono::steady_clock::duration>( std::chrono::duration<double>( timeout ) );
+  bool available;
+  while ( !( available = ( peek() != 0 ) ) ) {
+    if ( timeout < 0.0 )
+      ready.wait( lock );
+    else if ( ready.wait_until( lock, deadline ) == std::cv_status::timeout ) {
+      available = ( peek() != 0 );
+      break;
+    }
+  }
+
+  waiting.store( false, std::memory_order_relaxed );
+  return available;
+}
+
+void MidiInApi::MidiQueue :: pop( void )
+{
+  head->front.store( head->front.load( std::memory_order_relaxed ) + 1, std::memory_order_release );
+  popped.store( popped.load( std::memory_order_relaxed ) + 1, std::memory_order_release );
+}
+
+unsigned int MidiInApi::MidiQueue :: size( void ) const
+{
+  unsigned long long out = popped.load( std::memory_order_acquire );
+  unsigned long long in = pushed.load( std::memory_order_acquire );
+  return in > out ? (unsigned int) ( in - out ) : 0;
+}
+
+void MidiInApi::RtMidiInData :: compileFilter( void )
+{
+  for ( unsigned int status=0; status<256; status++ ) {
+    bool drop = false;
+    if ( status >= 0x80 && status < 0xF0 )
+      drop = ( filterTypes & ( 1 << ( ( status >> 4 ) - 8 ) ) ) || !( filterChannels & ( 1 << ( status & 0x0F ) ) );
+    else if ( status == 0xF0 )
+      drop = ignoreFlags & 0x01;
+    else if ( status == 0xF1 || status == 0xF8 || status == 0xF9 )
+      drop = ignoreFlags & 0x02;
+    else if ( status == 0xFE )
+      drop = ignoreFlags & 0x04;
+    filter[status] = drop;
+  }
+}
+
+void MidiInApi::RtMidiInData :: deliver( const MidiMessage *messages, unsigned int count )
+{
+  for ( unsigned int i=0; i<count; i++ )
+    RTMIDI_INPUT_PROBE( portName.c_str(), sequence + i, messages[i].data(), messages[i].size(), messages[i].absoluteTime );
+  sequence += count;
+
+  if ( batchCallback ) {
+    RTMIDI_INPUT_CALLBACK();
+    batchCallback( messages, count, userData );
+    return;
+  }
+
+  if ( messageCallback ) {
+    RTMIDI_INPUT_CALLBACK();
+    for ( unsigned int i=0; i<count; i++ )
+      messageCallback( messages[i], userData );
+    return;
+  }
+
+  if ( usingCallback ) {
+    // The callback interface takes a vector, which keeps its capacity
+    // between messages.
+    RtMidiIn::RtMidiCallback callback = (RtMidiIn::RtMidiCallback) userCallback;
+    for ( unsigned int i=0; i<count; i++ ) {
+      callbackBytes.assign( messages[i].data(), messages[i].data() + messages[i].size() );
+      RTMIDI_INPUT_CALLBACK();
+      callback( messages[i].timeStamp, &callbackBytes, userData );
+    }
+    return;
+  }
+
+  // As long as we haven't reached our queue size limit, push the messages.
+  // The slots keep their own storage, so this is a plain copy.  Dropped
+  // messages are only counted, for getQueueStatistics(), since this runs
+  // on the input handler's thread.  A waiting reader is woken once for
+  // the whole batch.
+  bool pushed = false;
+  for ( unsigned int i=0; i<count; i++ )
+    if ( queue.push( messages[i] ) ) pushed = true;
+  if ( pushed ) queue.notify();
+}
+
 //*********************************************************************//
 //  Common MidiOutApi Definitions
 //*********************************************************************//
@@ -370,6 +850,12 @@ MidiOutApi :: ~MidiOutApi( void )
 {
 }
 
+void MidiOutApi :: sendMessageAt( long long /*timeStamp*/, std::vector<unsigned char> *message )
+{
+  // APIs without scheduled output send the message right away.
+  sendMessage( message );
+}
+
 // *************************************************** //
 //
 // OS/API-specific methods.
@@ -405,6 +891,8 @@ struct CoreMidiData {
 
 static void midiInputCallback( const MIDIPacketList *list, void *procRef, void */*srcRef*/ )
 {
+  // Steady-state input must not allocate.
+  RTMIDI_INPUT_REGION( "CoreMIDI input" );
   MidiInApi::RtMidiInData *data = static_cast<MidiInApi::RtMidiInData *> (procRef);
   CoreMidiData *apiData = static_cast<CoreMidiData *> (data->apiData);
 
@@ -430,7 +918,13 @@ static void midiInputCallback( const MIDIPacketList *list, void *procRef, void *
     nBytes = packet->length;
     if ( nBytes == 0 ) continue;
 
-    // Calculate time stamp.
+    // Calculate time stamp.  Host time counts mach_absolute_time()
+    // units, so in nanoseconds it is on the RtMidi::getTime() clock.
+    if ( !continueSysex ) {
+      time = packet->timeStamp;
+      if ( time == 0 ) time = AudioGetCurrentHostTime();
+      message.absoluteTime = (long long) AudioConvertHostTimeToNanos( time );
+    }
 
     if ( data->firstMessage ) {
       message.timeStamp = 0.0;
@@ -457,29 +951,14 @@ static void midiInputCallback( const MIDIPacketList *list, void *procRef, void *
       // We have a continuing, segmented sysex message.
       if ( !( data->ignoreFlags & 0x01 ) ) {
         // If we're not ignoring sysex messages, copy the entire packet.
-        for ( unsigned int j=0; j<nBytes; ++j )
-          message.bytes.push_back( packet->data[j] );
+        message.append( packet->data, nBytes );
       }
       continueSysex = packet->data[nBytes-1] != 0xF7;
 
       if ( !( data->ignoreFlags & 0x01 ) && !continueSysex ) {
         // If not a continuing sysex message, invoke the user callback function or queue the message.
-        if ( data->usingCallback ) {
-          RtMidiIn::RtMidiCallback callback = (RtMidiIn::RtMidiCallback) data->userCallback;
-          callback( message.timeStamp, &message.bytes, data->userData );
-        }
-        else {
-          // As long as we haven't reached our queue size limit, push the message.
-          if ( data->queue.size < data->queue.ringSize ) {
-            data->queue.ring[data->queue.back++] = message;
-            if ( data->queue.back == data->queue.ringSize )
-              data->queue.back = 0;
-            data->queue.size++;
-          }
-          else
-            std::cerr << "\nMidiInCore: message queue limit reached!!\n\n";
-        }
-        message.bytes.clear();
+        data->deliver( message );
+        message.clear();
       }
     }
     else {
@@ -523,27 +1002,19 @@ static void midiInputCallback( const MIDIPacketList *list, void *procRef, void *
         }
         else size = 1;
 
+        // Skip channel messages dropped by the input filter.
+        if ( status < 0xF0 && data->filter[status] ) {
+          iByte += size;
+          continue;
+        }
+
         // Copy the MIDI data to our vector.
         if ( size ) {
-          message.bytes.assign( &packet->data[iByte], &packet->data[iByte+size] );
+          message.assign( &packet->data[iByte], size );
           if ( !continueSysex ) {
             // If not a continuing sysex message, invoke the user callback function or queue the message.
-            if ( data->usingCallback ) {
-              RtMidiIn::RtMidiCallback callback = (RtMidiIn::RtMidiCallback) data->userCallback;
-              callback( message.timeStamp, &message.bytes, data->userData );
-            }
-            else {
-              // As long as we haven't reached our queue size limit, push the message.
-              if ( data->queue.size < data->queue.ringSize ) {
-                data->queue.ring[data->queue.back++] = message;
-                if ( data->queue.back == data->queue.ringSize )
-                  data->queue.back = 0;
-                data->queue.size++;
-              }
-              else
-                std::cerr << "\nMidiInCore: message queue limit reached!!\n\n";
-            }
-            message.bytes.clear();
+            data->deliver( message );
+            message.clear();
           }
           iByte += size;
         }
@@ -1008,6 +1479,11 @@ void MidiOutCore :: openVirtualPort( std::string portName )
 }
 
 void MidiOutCore :: sendMessage( std::vector<unsigned char> *message )
+{
+  sendMessageAt( 0, message );
+}
+
+void MidiOutCore :: sendMessageAt( long long time, std::vector<unsigned char> *message )
 {
   // We use the MIDISendSysex() function to asynchronously send sysex
   // messages.  Otherwise, we use a single CoreMidi MIDIPacket.
@@ -1018,7 +1494,11 @@ void MidiOutCore :: sendMessage( std::vector<unsigned char> *message )
     return;
   }
 
+  // CoreMIDI holds packets with a future time stamp until they are due.
   MIDITimeStamp timeStamp = AudioGetCurrentHostTime();
+  long long delay = time - RtMidi::getTime();
+  if ( delay > 0 )
+    timeStamp += AudioConvertNanosToHostTime( (UInt64) delay );
   CoreMidiData *data = static_cast<CoreMidiData *> (apiData_);
   OSStatus result;
 
@@ -1094,799 +1574,2002 @@ void MidiOutCore :: sendMessage( std::vector<unsigned char> *message )
 // ALSA header file.
 #include <alsa/asoundlib.h>
 
+#include <map>
+#include <memory>
+#include <thread>
+
+// Number of decoded messages the ALSA input handler collects before
+// handing them over in one call.
+#define ALSA_INPUT_BATCH 64
+
+// A MIDI port as listed by the port directory.
+struct AlsaPort {
+  snd_seq_addr_t addr;
+  unsigned int caps;
+  std::string clientName;
+  std::string portName;
+  std::string name; // as returned by getPortName()
+};
+
+// A sequencer client shared by the RtMidi ports of a process that use
+// the same client name.  Each port is a port of the client; one thread
+// reads the client and hands every event to the input registered for
+// the port it was sent to, and one queue times input and schedules
+// output, so clients, queues and threads do not multiply with ports.
+// A threadless input gets a private client, read by the application.
+struct AlsaSequencer {
+  std::string name;
+  bool shared;             // false for the private client of a threadless input
+  unsigned int refCount;   // guarded by the list of shared clients
+  snd_seq_t *seq;
+  int queue_id;            // times input events and schedules output
+  long long queueStart;    // RtMidi::getTime() when the queue was started
+  std::mutex threadMutex;  // serializes starting the thread and setting its options
+  std::mutex inputMutex;   // guards inputs and delivering, held while events are decoded
+  std::map<int, MidiInApi::RtMidiInData *> inputs; // by the number of our port
+  MidiInApi::RtMidiInData *delivering; // the input in a callback, if any
+  pthread_t deliverer;                 // and the thread running it
+  std::condition_variable delivered;   // signalled when a delivery ends
+  RtMidi::ThreadOptions threadOptions; // the most demanding asked of the thread
+  std::mutex outputMutex;  // serializes event output and subscription changes
+  pthread_t thread;
+  std::atomic<bool> running;
+  int trigger_fds[2];
+};
+
 // A structure to hold variables related to the ALSA API
 // implementation.
 struct AlsaMidiData {
-  snd_seq_t *seq;
+  AlsaSequencer *sequencer;
   unsigned int portNum;
   int vport;
   snd_seq_port_subscribe_t *subscription;
   snd_midi_event_t *coder;
   unsigned int bufferSize;
   unsigned char *buffer;
-  pthread_t thread;
-  pthread_t dummy_thread_id;
   unsigned long long lastTime;
-  int queue_id; // an input queue is needed to get timestamped events
-  int trigger_fds[2];
+  unsigned int batched;
+  MidiInApi::MidiMessage batch[ALSA_INPUT_BATCH]; // input messages waiting to be delivered
+  std::mutex portMutex; // guards the connection against the port directory thread
+  AlsaPort peer;        // the port connected to
+  bool portLost;        // the peer went away and may come back
 };
 
 #define PORT_TYPE( pinfo, bits ) ((snd_seq_port_info_get_capability(pinfo) & (bits)) == (bits))
 
-//*********************************************************************//
-//  API: LINUX ALSA
-//  Class Definitions: MidiInAlsa
-//*********************************************************************//
+typedef std::vector<AlsaPort> AlsaPortList;
 
-static void *alsaMidiHandler( void *ptr )
-{
-  MidiInApi::RtMidiInData *data = static_cast<MidiInApi::RtMidiInData *> (ptr);
-  AlsaMidiData *apiData = static_cast<AlsaMidiData *> (data->apiData);
+// Called on the directory thread for every port that appears or goes away.
+typedef void (*AlsaPortHandler)( const AlsaPort &port, bool added, void *object );
 
-  long nBytes;
-  unsigned long long time, lastTime;
-  bool continueSysex = false;
-  bool doDecode = false;
-  MidiInApi::MidiMessage message;
-  int poll_fd_count;
-  struct pollfd *poll_fds;
+#define PORT_CAPS_INPUT ( SND_SEQ_PORT_CAP_READ | SND_SEQ_PORT_CAP_SUBS_READ )
+#define PORT_CAPS_OUTPUT ( SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_SUBS_WRITE )
 
-  snd_seq_event_t *ev;
-  int result;
-  apiData->bufferSize = 32;
-  result = snd_midi_event_new( 0, &apiData->coder );
-  if ( result < 0 ) {
-    data->doInput = false;
-    std::cerr << "\nMidiInAlsa::alsaMidiHandler: error initializing MIDI event parser!\n\n";
-    return 0;
-  }
-  unsigned char *buffer = (unsigned char *) malloc( apiData->bufferSize );
-  if ( buffer == NULL ) {
-    data->doInput = false;
-    snd_midi_event_free( apiData->coder );
-    apiData->coder = 0;
-    std::cerr << "\nMidiInAlsa::alsaMidiHandler: error initializing buffer memory!\n\n";
-    return 0;
+// Fill 'ports' with every MIDI port of the sequencer, in the order
+// used for port numbers.
+static void alsaScanPorts( snd_seq_t *seq, AlsaPortList &ports )
+{
+  snd_seq_client_info_t *cinfo;
+  snd_seq_port_info_t *pinfo;
+  snd_seq_client_info_alloca( &cinfo );
+  snd_seq_port_info_alloca( &pinfo );
+
+  ports.clear();
+  snd_seq_client_info_set_client( cinfo, -1 );
+  while ( snd_seq_query_next_client( seq, cinfo ) >= 0 ) {
+    int client = snd_seq_client_info_get_client( cinfo );
+    if ( client == 0 ) continue;
+    snd_seq_port_info_set_client( pinfo, client );
+    snd_seq_port_info_set_port( pinfo, -1 );
+    while ( snd_seq_query_next_port( seq, pinfo ) >= 0 ) {
+      unsigned int atyp = snd_seq_port_info_get_type( pinfo );
+      if ( ( ( atyp & SND_SEQ_PORT_TYPE_MIDI_GENERIC ) == 0 ) &&
+        ( ( atyp & SND_SEQ_PORT_TYPE_SYNTH ) == 0 ) ) continue;
+      AlsaPort port;
+      port.addr.client = client;
+      port.addr.port = snd_seq_port_info_get_port( pinfo );
+      port.caps = snd_seq_port_info_get_capability( pinfo );
+      port.clientName = snd_seq_client_info_get_name( cinfo );
+      port.portName = snd_seq_port_info_get_name( pinfo );
+      std::ostringstream os;
+      os << port.clientName << " " << client << ":" << (int) port.addr.port;
+      port.name = os.str();
+      ports.push_back( port );
+    }
   }
-  snd_midi_event_init( apiData->coder );
-  snd_midi_event_no_status( apiData->coder, 1 ); // suppress running status messages
+}
 
-  poll_fd_count = snd_seq_poll_descriptors_count( apiData->seq, POLLIN ) + 1;
-  poll_fds = (struct pollfd*)alloca( poll_fd_count * sizeof( struct pollfd ));
-  snd_seq_poll_descriptors( apiData->seq, poll_fds + 1, poll_fd_count - 1, POLLIN );
-  poll_fds[0].fd = apiData->trigger_fds[0];
-  poll_fds[0].events = POLLIN;
+// The port directory keeps the list of sequencer ports current by
+// listening to the system announce port, so port queries do not walk
+// the sequencer, and it tells the open ports about devices that come
+// and go.  There is one directory per process, with its own sequencer
+// client and thread, created on first use and kept until exit.
+class AlsaPortDirectory
+{
+ public:
+  //! Return the directory, or 0 if the sequencer cannot be watched.
+  static AlsaPortDirectory *instance( void );
+
+  //! Return the current input (readable) or output (writable) ports.
+  std::shared_ptr<const AlsaPortList> ports( bool input );
+
+  //! Read the port list again now and return it.
+  /*!
+    For ports this process has just created or deleted, whose
+    announcements the directory thread may not have read yet.  The
+    handlers still hear of the change from that thread.
+  */
+  std::shared_ptr<const AlsaPortList> refresh( void );
+
+  //! Start or stop calling a handler for port changes.
+  void addHandler( AlsaPortHandler handler, void *object );
+  void removeHandler( void *object );
+
+ private:
+  AlsaPortDirectory( snd_seq_t *seq );
+  void rescan( void );
+  void run( void );
+
+  snd_seq_t *seq_;
+  std::mutex scanMutex_; // one scan of the sequencer at a time
+  std::mutex mutex_; // guards the lists
+  std::shared_ptr<const AlsaPortList> inputs_, outputs_;
+  std::shared_ptr<const AlsaPortList> reported_; // the list the handlers know, directory thread only
+  std::mutex handlerMutex_; // guards the handlers and the call in progress
+  std::vector< std::pair<AlsaPortHandler, void *> > handlers_;
+  void *calling_;               // the object whose handler runs, if any
+  std::thread::id caller_;      // and the thread running it
+  std::condition_variable called_; // signalled when a handler returns
+};
 
-  while ( data->doInput ) {
+AlsaPortDirectory *AlsaPortDirectory :: instance( void )
+{
+  static std::mutex mutex;
+  static AlsaPortDirectory *directory = 0;
+  static bool tried = false;
 
-    if ( snd_seq_event_input_pending( apiData->seq, 1 ) == 0 ) {
-      // No data pending
-      if ( poll( poll_fds, poll_fd_count, -1) >= 0 ) {
-        if ( poll_fds[0].revents & POLLIN ) {
-          bool dummy;
-          int res = read( poll_fds[0].fd, &dummy, sizeof(dummy) );
-          (void) res;
-        }
-      }
-      continue;
+  std::lock_guard<std::mutex> lock( mutex );
+  if ( tried ) return directory;
+  tried = true;
+
+  snd_seq_t *seq;
+  if ( snd_seq_open( &seq, "default", SND_SEQ_OPEN_INPUT, 0 ) < 0 ) return 0;
+  snd_seq_set_client_name( seq, "RtMidi Port Directory" );
+  int port = snd_seq_create_simple_port( seq, "Announcements",
+                                         SND_SEQ_PORT_CAP_WRITE | SND_SEQ_PORT_CAP_NO_EXPORT,
+                                         SND_SEQ_PORT_TYPE_APPLICATION );
+  if ( port < 0 || snd_seq_connect_from( seq, port, SND_SEQ_CLIENT_SYSTEM, SND_SEQ_PORT_SYSTEM_ANNOUNCE ) < 0 ) {
+    snd_seq_close( seq );
+    return 0;
+  }
+
+  directory = new AlsaPortDirectory( seq );
+  std::thread( &AlsaPortDirectory::run, directory ).detach();
+  return directory;
+}
+
+AlsaPortDirectory :: AlsaPortDirectory( snd_seq_t *seq )
+  : seq_( seq ), calling_( 0 )
+{
+  reported_ = refresh();
+}
+
+std::shared_ptr<const AlsaPortList> AlsaPortDirectory :: ports( bool input )
+{
+  std::lock_guard<std::mutex> lock( mutex_ );
+  return input ? inputs_ : outputs_;
+}
+
+void AlsaPortDirectory :: addHandler( AlsaPortHandler handler, void *object )
+{
+  std::lock_guard<std::mutex> lock( handlerMutex_ );
+  handlers_.push_back( std::make_pair( handler, object ) );
+}
+
+void AlsaPortDirectory :: removeHandler( void *object )
+{
+  std::unique_lock<std::mutex> lock( handlerMutex_ );
+  for ( unsigned int i=0; i<handlers_.size(); i++ ) {
+    if ( handlers_[i].second == object ) {
+      handlers_.erase( handlers_.begin() + i );
+      break;
     }
+  }
 
-    // If here, there should be data.
-    result = snd_seq_event_input( apiData->seq, &ev );
-    if ( result == -ENOSPC ) {
-      std::cerr << "\nMidiInAlsa::alsaMidiHandler: MIDI input buffer overrun!\n\n";
-      continue;
+  // Wait for a call to the object in progress, unless this is it (a
+  // port callback deleting its RtMidiIn or RtMidiOut).
+  while ( calling_ == object && caller_ != std::this_thread::get_id() )
+    called_.wait( lock );
+}
+
+static bool alsaSamePort( const AlsaPort &a, const AlsaPort &b )
+{
+  return a.addr.client == b.addr.client && a.addr.port == b.addr.port && a.name == b.name;
+}
+
+// Queries do not touch the event input buffer, so this may run while
+// the directory thread waits for announcements.
+std::shared_ptr<const AlsaPortList> AlsaPortDirectory :: refresh( void )
+{
+  std::lock_guard<std::mutex> scanLock( scanMutex_ );
+  std::shared_ptr<AlsaPortList> all = std::make_shared<AlsaPortList>();
+  std::shared_ptr<AlsaPortList> inputs = std::make_shared<AlsaPortList>();
+  std::shared_ptr<AlsaPortList> outputs = std::make_shared<AlsaPortList>();
+  alsaScanPorts( seq_, *all );
+  for ( unsigned int i=0; i<all->size(); i++ ) {
+    if ( ( (*all)[i].caps & PORT_CAPS_INPUT ) == PORT_CAPS_INPUT ) inputs->push_back( (*all)[i] );
+    if ( ( (*all)[i].caps & PORT_CAPS_OUTPUT ) == PORT_CAPS_OUTPUT ) outputs->push_back( (*all)[i] );
+  }
+
+  std::lock_guard<std::mutex> lock( mutex_ );
+  inputs_ = inputs;
+  outputs_ = outputs;
+  return all;
+}
+
+// Read the port list again and report the differences since the last
+// report to the handlers.
+void AlsaPortDirectory :: rescan( void )
+{
+  std::shared_ptr<const AlsaPortList> all = refresh();
+  std::shared_ptr<const AlsaPortList> previous = reported_;
+  reported_ = all;
+
+  std::vector< std::pair<const AlsaPort *, bool> > changes;
+  for ( unsigned int i=0; i<previous->size(); i++ ) {
+    const AlsaPort &port = (*previous)[i];
+    if ( std::find_if( all->begin(), all->end(), [&port]( const AlsaPort &p ) { return alsaSamePort( p, port ); } ) == all->end() )
+      changes.push_back( std::make_pair( &port, false ) );
+  }
+  for ( unsigned int i=0; i<all->size(); i++ ) {
+    const AlsaPort &port = (*all)[i];
+    if ( std::find_if( previous->begin(), previous->end(), [&port]( const AlsaPort &p ) { return alsaSamePort( p, port ); } ) == previous->end() )
+      changes.push_back( std::make_pair( &port, true ) );
+  }
+
+  // The handlers run without the lock, so that they may open, close
+  // and delete ports; each is skipped once it has been removed.
+  std::unique_lock<std::mutex> lock( handlerMutex_ );
+  std::vector< std::pair<AlsaPortHandler, void *> > handlers = handlers_;
+  for ( unsigned int i=0; i<changes.size(); i++ ) {
+    for ( unsigned int j=0; j<handlers.size(); j++ ) {
+      if ( std::find( handlers_.begin(), handlers_.end(), handlers[j] ) == handlers_.end() ) continue;
+      calling_ = handlers[j].second;
+      caller_ = std::this_thread::get_id();
+      lock.unlock();
+      handlers[j].first( *changes[i].first, changes[i].second, handlers[j].second );
+      lock.lock();
+      calling_ = 0;
+      called_.notify_all();
     }
-    else if ( result <= 0 ) {
-      std::cerr << "\nMidiInAlsa::alsaMidiHandler: unknown MIDI input error!\n";
-      perror("System reports");
-      continue;
+  }
+}
+
+void AlsaPortDirectory :: run( void )
+{
+  snd_seq_event_t *ev;
+  unsigned int failures = 0;
+  while ( true ) {
+    // Collect every pending announcement, then rescan once.
+    bool changed = false;
+    int result;
+    do {
+      result = snd_seq_event_input( seq_, &ev );
+      if ( result == -ENOSPC ) {
+        // Announcements were lost, so the list may be stale.
+        changed = true;
+        continue;
+      }
+      if ( result < 0 ) break;
+
+      switch ( ev->type ) {
+      case SND_SEQ_EVENT_CLIENT_START:
+      case SND_SEQ_EVENT_CLIENT_EXIT:
+      case SND_SEQ_EVENT_CLIENT_CHANGE:
+      case SND_SEQ_EVENT_PORT_START:
+      case SND_SEQ_EVENT_PORT_EXIT:
+      case SND_SEQ_EVENT_PORT_CHANGE:
+        changed = true;
+        break;
+      default:
+        break;
+      }
+      snd_seq_free_event( ev );
+    } while ( snd_seq_event_input_pending( seq_, 0 ) > 0 );
+
+    if ( changed ) rescan();
+
+    // The read blocks, so an error that persists would spin; retry it
+    // after a pause that grows to a second.
+    if ( result < 0 && result != -ENOSPC && result != -EINTR && result != -EAGAIN ) {
+      if ( failures == 0 )
+        std::cerr << "\nAlsaPortDirectory: error reading port announcements: " << snd_strerror( result ) << "\n\n";
+      std::this_thread::sleep_for( std::chrono::milliseconds( std::min( 10 << failures, 1000 ) ) );
+      if ( failures < 7 ) ++failures;
+    }
+    else failures = 0;
+  }
+}
+
+// Bring the directory up to date with a port this process has just
+// created or deleted, so that queries right after it agree.
+static void alsaPortsChanged( void )
+{
+  AlsaPortDirectory *directory = AlsaPortDirectory::instance();
+  if ( directory ) directory->refresh();
+}
+
+// Look up an input or output port by number.  Without a directory,
+// the sequencer is queried directly.
+static bool alsaFindPort( snd_seq_t *seq, bool input, unsigned int portNumber, AlsaPort &port )
+{
+  AlsaPortDirectory *directory = AlsaPortDirectory::instance();
+  if ( directory ) {
+    std::shared_ptr<const AlsaPortList> ports = directory->ports( input );
+    if ( portNumber >= ports->size() ) return false;
+    port = (*ports)[portNumber];
+    return true;
+  }
+
+  AlsaPortList ports;
+  alsaScanPorts( seq, ports );
+  unsigned int caps = input ? PORT_CAPS_INPUT : PORT_CAPS_OUTPUT;
+  for ( unsigned int i=0; i<ports.size(); i++ ) {
+    if ( ( ports[i].caps & caps ) != caps ) continue;
+    if ( portNumber-- == 0 ) {
+      port = ports[i];
+      return true;
     }
+  }
+  return false;
+}
+
+static unsigned int alsaPortCount( snd_seq_t *seq, bool input )
+{
+  AlsaPortDirectory *directory = AlsaPortDirectory::instance();
+  if ( directory ) return directory->ports( input )->size();
+
+  AlsaPortList ports;
+  alsaScanPorts( seq, ports );
+  unsigned int caps = input ? PORT_CAPS_INPUT : PORT_CAPS_OUTPUT, count = 0;
+  for ( unsigned int i=0; i<ports.size(); i++ )
+    if ( ( ports[i].caps & caps ) == caps ) ++count;
+  return count;
+}
+
+// Make or break a connection of one of our ports.  The client may be
+// shared with ports that send on other threads, so this goes through
+// its output lock like the events do.
+static int alsaSubscribe( AlsaSequencer *sequencer, snd_seq_port_subscribe_t *subscription )
+{
+  std::lock_guard<std::mutex> outputLock( sequencer->outputMutex );
+  return snd_seq_subscribe_port( sequencer->seq, subscription );
+}
+
+static int alsaUnsubscribe( AlsaSequencer *sequencer, snd_seq_port_subscribe_t *subscription )
+{
+  std::lock_guard<std::mutex> outputLock( sequencer->outputMutex );
+  return snd_seq_unsubscribe_port( sequencer->seq, subscription );
+}
+
+// Follow the device of an open connection.  When its port goes away
+// the connection is marked lost, and when a port with the same client
+// and port name appears the subscription is made again to the new
+// address.  Returns 1 if the connection was lost, 2 if it was restored
+// and 0 otherwise.
+static int alsaFollowPort( AlsaMidiData *data, const AlsaPort &port, bool added, bool input )
+{
+  std::lock_guard<std::mutex> lock( data->portMutex );
+  if ( data->subscription == 0 ) return 0;
+
+  if ( !added ) {
+    if ( data->portLost || port.addr.client != data->peer.addr.client || port.addr.port != data->peer.addr.port )
+      return 0;
+    data->portLost = true;
+    return 1;
+  }
+
+  if ( !data->portLost || port.clientName != data->peer.clientName || port.portName != data->peer.portName )
+    return 0;
+  unsigned int caps = input ? PORT_CAPS_INPUT : PORT_CAPS_OUTPUT;
+  if ( ( port.caps & caps ) != caps ) return 0;
+
+  if ( input ) snd_seq_port_subscribe_set_sender( data->subscription, &port.addr );
+  else snd_seq_port_subscribe_set_dest( data->subscription, &port.addr );
+  if ( alsaSubscribe( data->sequencer, data->subscription ) < 0 ) return 0;
+  data->peer = port;
+  data->portLost = false;
+  return 2;
+}
+
+//*********************************************************************//
+//  API: LINUX ALSA
+//  Class Definitions: MidiInAlsa
+//*********************************************************************//
+
+// Set up the event decoder and the buffers used by alsaMidiProcess().
+// The decode buffer holds one sequencer sysex chunk (256 bytes) and
+// the message reassembles chunks into a full sysex.  Both are sized
+// up front and only grow for unusually long events, so steady-state
+// input does not allocate.
+static bool alsaMidiStartDecoder( MidiInApi::RtMidiInData *data )
+{
+  AlsaMidiData *apiData = static_cast<AlsaMidiData *> (data->apiData);
+
+  apiData->bufferSize = 256;
+  apiData->batched = 0;
+  data->message.clear();
+  data->message.reserve( 1024 );
+  data->continueSysex = false;
+  int result = snd_midi_event_new( 0, &apiData->coder );
+  if ( result < 0 ) {
+    std::cerr << "\nMidiInAlsa::alsaMidiHandler: error initializing MIDI event parser!\n\n";
+    return false;
+  }
+  apiData->buffer = (unsigned char *) malloc( apiData->bufferSize );
+  if ( apiData->buffer == NULL ) {
+    snd_midi_event_free( apiData->coder );
+    apiData->coder = 0;
+    std::cerr << "\nMidiInAlsa::alsaMidiHandler: error initializing buffer memory!\n\n";
+    return false;
+  }
+  snd_midi_event_init( apiData->coder );
+  snd_midi_event_no_status( apiData->coder, 1 ); // suppress running status messages
+  return true;
+}
+
+static void alsaMidiStopDecoder( AlsaMidiData *apiData )
+{
+  if ( apiData->buffer ) free( apiData->buffer );
+  apiData->buffer = 0;
+  if ( apiData->coder ) snd_midi_event_free( apiData->coder );
+  apiData->coder = 0;
+}
+
+// The status byte of a channel event, or 0 for other events.
+static unsigned char alsaEventStatus( const snd_seq_event_t *ev )
+{
+  switch ( ev->type ) {
+  case SND_SEQ_EVENT_NOTEOFF: return 0x80 | ( ev->data.note.channel & 0x0F );
+  case SND_SEQ_EVENT_NOTEON: return 0x90 | ( ev->data.note.channel & 0x0F );
+  case SND_SEQ_EVENT_KEYPRESS: return 0xA0 | ( ev->data.note.channel & 0x0F );
+  case SND_SEQ_EVENT_CONTROLLER:
+  case SND_SEQ_EVENT_CONTROL14:
+  case SND_SEQ_EVENT_NONREGPARAM:
+  case SND_SEQ_EVENT_REGPARAM: return 0xB0 | ( ev->data.control.channel & 0x0F );
+  case SND_SEQ_EVENT_PGMCHANGE: return 0xC0 | ( ev->data.control.channel & 0x0F );
+  case SND_SEQ_EVENT_CHANPRESS: return 0xD0 | ( ev->data.control.channel & 0x0F );
+  case SND_SEQ_EVENT_PITCHBEND: return 0xE0 | ( ev->data.control.channel & 0x0F );
+  default: return 0;
+  }
+}
+
+// Decode one sequencer event sent to an input port and add the
+// message it completes, if any, to the port's batch.  Returns true
+// when the batch is full.
+static bool alsaMidiDecode( MidiInApi::RtMidiInData *data, snd_seq_event_t *ev )
+{
+  // Steady-state input must not allocate; sysex grows the buffers
+  // while warming up.
+  RTMIDI_INPUT_REGION( "ALSA sequencer input" );
+  AlsaMidiData *apiData = static_cast<AlsaMidiData *> (data->apiData);
+
+  long nBytes;
+  unsigned long long time, lastTime;
+  bool& continueSysex = data->continueSysex;
+  bool doDecode = false;
+  MidiInApi::MidiMessage& message = data->message;
 
-    // This is a bit weird, but we now have to decode an ALSA MIDI
-    // event (back) into MIDI bytes.  We'll ignore non-MIDI types.
-    if ( !continueSysex ) message.bytes.clear();
+  // This is a bit weird, but we now have to decode an ALSA MIDI
+  // event (back) into MIDI bytes.  We'll ignore non-MIDI types.
+  if ( !continueSysex ) message.clear();
 
-    doDecode = false;
-    switch ( ev->type ) {
+  // Drop filtered channel messages before decoding them.
+  unsigned char status = alsaEventStatus( ev );
+  if ( status && data->filter[status] ) return false;
 
-    case SND_SEQ_EVENT_PORT_SUBSCRIBED:
+  doDecode = false;
+  switch ( ev->type ) {
+
+  case SND_SEQ_EVENT_PORT_SUBSCRIBED:
 #if defined(__RTMIDI_DEBUG__)
-      std::cout << "MidiInAlsa::alsaMidiHandler: port connection made!\n";
+    std::cout << "MidiInAlsa::alsaMidiHandler: port connection made!\n";
 #endif
-      break;
+    break;
 
-    case SND_SEQ_EVENT_PORT_UNSUBSCRIBED:
+  case SND_SEQ_EVENT_PORT_UNSUBSCRIBED:
 #if defined(__RTMIDI_DEBUG__)
-      std::cerr << "MidiInAlsa::alsaMidiHandler: port connection has closed!\n";
-      std::cout << "sender = " << (int) ev->data.connect.sender.client << ":"
-                << (int) ev->data.connect.sender.port
-                << ", dest = " << (int) ev->data.connect.dest.client << ":"
-                << (int) ev->data.connect.dest.port
-                << std::endl;
+    std::cerr << "MidiInAlsa::alsaMidiHandler: port connection has closed!\n";
+    std::cout << "sender = " << (int) ev->data.connect.sender.client << ":"
+              << (int) ev->data.connect.sender.port
+              << ", dest = " << (int) ev->data.connect.dest.client << ":"
+              << (int) ev->data.connect.dest.port
+              << std::endl;
 #endif
-      break;
+    break;
 
-    case SND_SEQ_EVENT_QFRAME: // MIDI time code
-      if ( !( data->ignoreFlags & 0x02 ) ) doDecode = true;
-      break;
+  case SND_SEQ_EVENT_QFRAME: // MIDI time code
+    if ( !data->filter[0xF1] ) doDecode = true;
+    break;
 
-    case SND_SEQ_EVENT_TICK: // 0xF9 ... MIDI timing tick
-      if ( !( data->ignoreFlags & 0x02 ) ) doDecode = true;
-      break;
+  case SND_SEQ_EVENT_TICK: // 0xF9 ... MIDI timing tick
+    if ( !data->filter[0xF9] ) doDecode = true;
+    break;
 
-    case SND_SEQ_EVENT_CLOCK: // 0xF8 ... MIDI timing (clock) tick
-      if ( !( data->ignoreFlags & 0x02 ) ) doDecode = true;
-      break;
+  case SND_SEQ_EVENT_CLOCK: // 0xF8 ... MIDI timing (clock) tick
+    if ( !data->filter[0xF8] ) doDecode = true;
+    break;
 
-    case SND_SEQ_EVENT_SENSING: // Active sensing
-      if ( !( data->ignoreFlags & 0x04 ) ) doDecode = true;
-      break;
+  case SND_SEQ_EVENT_SENSING: // Active sensing
+    if ( !data->filter[0xFE] ) doDecode = true;
+    break;
 
 		case SND_SEQ_EVENT_SYSEX:
-      if ( (data->ignoreFlags & 0x01) ) break;
-      if ( ev->data.ext.len > apiData->bufferSize ) {
-        apiData->bufferSize = ev->data.ext.len;
-        free( buffer );
-        buffer = (unsigned char *) malloc( apiData->bufferSize );
-        if ( buffer == NULL ) {
-          data->doInput = false;
-          std::cerr << "\nMidiInAlsa::alsaMidiHandler: error resizing buffer memory!\n\n";
-          break;
-        }
+    if ( (data->ignoreFlags & 0x01) ) break;
+    if ( ev->data.ext.len > apiData->bufferSize ) {
+      apiData->bufferSize = ev->data.ext.len;
+      free( apiData->buffer );
+      apiData->buffer = (unsigned char *) malloc( apiData->bufferSize );
+      if ( apiData->buffer == NULL ) {
+        data->doInput = false;
+        std::cerr << "\nMidiInAlsa::alsaMidiHandler: error resizing buffer memory!\n\n";
+        break;
       }
-
-    default:
-      doDecode = true;
     }
 
-    if ( doDecode ) {
+  default:
+    doDecode = true;
+  }
+
+  if ( doDecode && apiData->buffer ) {
 
-      nBytes = snd_midi_event_decode( apiData->coder, buffer, apiData->bufferSize, ev );
-      if ( nBytes > 0 ) {
-        // The ALSA sequencer has a maximum buffer size for MIDI sysex
-        // events of 256 bytes.  If a device sends sysex messages larger
-        // than this, they are segmented into 256 byte chunks.  So,
-        // we'll watch for this and concatenate sysex chunks into a
-        // single sysex message if necessary.
-        if ( !continueSysex )
-          message.bytes.assign( buffer, &buffer[nBytes] );
+    nBytes = snd_midi_event_decode( apiData->coder, apiData->buffer, apiData->bufferSize, ev );
+    if ( nBytes > 0 ) {
+      // The ALSA sequencer has a maximum buffer size for MIDI sysex
+      // events of 256 bytes.  If a device sends sysex messages larger
+      // than this, they are segmented into 256 byte chunks.  So,
+      // we'll watch for this and concatenate sysex chunks into a
+      // single sysex message if necessary.
+      if ( !continueSysex )
+        message.assign( apiData->buffer, nBytes );
+      else
+        message.append( apiData->buffer, nBytes );
+
+      continueSysex = ( ( ev->type == SND_SEQ_EVENT_SYSEX ) && ( message.back() != 0xF7 ) );
+      if ( !continueSysex ) {
+
+        // Calculate the time stamp:
+        message.timeStamp = 0.0;
+
+        // Method 1: Use the system time.
+        //(void)gettimeofday(&tv, (struct timezone *)NULL);
+        //time = (tv.tv_sec * 1000000) + tv.tv_usec;
+
+        // Method 2: Use the ALSA sequencer event time data.
+        // (thanks to Pedro Lopez-Cabanillas!).
+        time = ( ev->time.time.tv_sec * 1000000 ) + ( ev->time.time.tv_nsec/1000 );
+        lastTime = time;
+        time -= apiData->lastTime;
+        apiData->lastTime = lastTime;
+        if ( data->firstMessage == true )
+          data->firstMessage = false;
         else
-          message.bytes.insert( message.bytes.end(), buffer, &buffer[nBytes] );
-
-        continueSysex = ( ( ev->type == SND_SEQ_EVENT_SYSEX ) && ( message.bytes.back() != 0xF7 ) );
-        if ( !continueSysex ) {
-
-          // Calculate the time stamp:
-          message.timeStamp = 0.0;
-
-          // Method 1: Use the system time.
-          //(void)gettimeofday(&tv, (struct timezone *)NULL);
-          //time = (tv.tv_sec * 1000000) + tv.tv_usec;
-
-          // Method 2: Use the ALSA sequencer event time data.
-          // (thanks to Pedro Lopez-Cabanillas!).
-          time = ( ev->time.time.tv_sec * 1000000 ) + ( ev->time.time.tv_nsec/1000 );
-          lastTime = time;
-          time -= apiData->lastTime;
-          apiData->lastTime = lastTime;
-          if ( data->firstMessage == true )
-            data->firstMessage = false;
-          else
-            message.timeStamp = time * 0.000001;
-        }
-        else {
+          message.timeStamp = time * 0.000001;
+
+        // The event time is relative to the start of the input queue.
+        // The queue timer and the monotonic clock drift slightly, so
+        // never report a time in the future.
+        long long now = RtMidi::getTime();
+#ifndef AVOID_TIMESTAMPING
+        message.absoluteTime = apiData->sequencer->queueStart + (long long) ev->time.time.tv_sec * 1000000000LL + ev->time.time.tv_nsec;
+        if ( message.absoluteTime > now ) message.absoluteTime = now;
+#else
+        message.absoluteTime = now;
+#endif
+      }
+      else {
 #if defined(__RTMIDI_DEBUG__)
-          std::cerr << "\nMidiInAlsa::alsaMidiHandler: event parsing error or not a MIDI event!\n\n";
+        std::cerr << "\nMidiInAlsa::alsaMidiHandler: event parsing error or not a MIDI event!\n\n";
 #endif
-        }
       }
     }
+  }
+
+  if ( message.size() == 0 || continueSysex ) return false;
+
+  apiData->batch[apiData->batched++] = message;
+  return apiData->batched == ALSA_INPUT_BATCH;
+}
+
+// Hand an input its batch.  The input lock is released meanwhile, so
+// that the callback may open and close ports; alsaSequencerRemoveInput()
+// waits for the delivery instead.  The input may be gone when this
+// returns.  Returns the number of messages delivered.
+static unsigned int alsaMidiDeliver( AlsaSequencer *sequencer, MidiInApi::RtMidiInData *data,
+                                     std::unique_lock<std::mutex> &lock )
+{
+  RTMIDI_INPUT_REGION( "ALSA sequencer delivery" );
+  AlsaMidiData *apiData = static_cast<AlsaMidiData *> (data->apiData);
+  unsigned int count = apiData->batched;
+  apiData->batched = 0;
+
+  sequencer->delivering = data;
+  sequencer->deliverer = pthread_self();
+  lock.unlock();
+  data->deliver( apiData->batch, count );
+  lock.lock();
+  sequencer->delivering = 0;
+  sequencer->delivered.notify_all();
+  return count;
+}
+
+// Decode and deliver every event already pending on a sequencer
+// client, without blocking.  Returns the number of messages delivered.
+// This is the body of the input thread and, in threadless mode, of
+// MidiInAlsa::processPending().  Events are read from the sequencer's
+// userspace buffer and only refilled from the kernel once that is
+// empty; each goes to the input of the port it was sent to, and the
+// decoded messages are delivered in batches per input.
+static unsigned int alsaMidiProcess( AlsaSequencer *sequencer )
+{
+  unsigned int delivered = 0;
+  snd_seq_event_t *ev;
+  int result;
+
+  std::unique_lock<std::mutex> lock( sequencer->inputMutex );
+  while ( !sequencer->shared || sequencer->running ) {
+
+    if ( snd_seq_event_input_pending( sequencer->seq, 0 ) == 0 &&
+         snd_seq_event_input_pending( sequencer->seq, 1 ) == 0 ) break;
+
+    result = snd_seq_event_input( sequencer->seq, &ev );
+    if ( result == -ENOSPC ) {
+      std::cerr << "\nMidiInAlsa::alsaMidiHandler: MIDI input buffer overrun!\n\n";
+      continue;
+    }
+    else if ( result <= 0 ) {
+      std::cerr << "\nMidiInAlsa::alsaMidiHandler: unknown MIDI input error!\n";
+      perror("System reports");
+      continue;
+    }
 
+    std::map<int, MidiInApi::RtMidiInData *>::iterator input = sequencer->inputs.find( ev->dest.port );
+    if ( input != sequencer->inputs.end() && input->second->doInput &&
+         alsaMidiDecode( input->second, ev ) )
+      delivered += alsaMidiDeliver( sequencer, input->second, lock );
     snd_seq_free_event( ev );
-    if ( message.bytes.size() == 0 || continueSysex ) continue;
+  }
 
-    if ( data->usingCallback ) {
-      RtMidiIn::RtMidiCallback callback = (RtMidiIn::RtMidiCallback) data->userCallback;
-      callback( message.timeStamp, &message.bytes, data->userData );
+  // Deliver the rest of every batch.  Inputs may come and go during a
+  // delivery, so the walk resumes after the port just served.
+  std::map<int, MidiInApi::RtMidiInData *>::iterator input = sequencer->inputs.begin();
+  while ( input != sequencer->inputs.end() ) {
+    AlsaMidiData *apiData = static_cast<AlsaMidiData *> (input->second->apiData);
+    if ( apiData->batched == 0 ) {
+      ++input;
+      continue;
     }
-    else {
-      // As long as we haven't reached our queue size limit, push the message.
-      if ( data->queue.size < data->queue.ringSize ) {
-        data->queue.ring[data->queue.back++] = message;
-        if ( data->queue.back == data->queue.ringSize )
-          data->queue.back = 0;
-        data->queue.size++;
+    int port = input->first;
+    delivered += alsaMidiDeliver( sequencer, input->second, lock );
+    input = sequencer->inputs.upper_bound( port );
+  }
+
+  return delivered;
+}
+
+static void *alsaMidiHandler( void *ptr )
+{
+  AlsaSequencer *sequencer = static_cast<AlsaSequencer *> (ptr);
+
+  int poll_fd_count;
+  struct pollfd *poll_fds;
+
+  poll_fd_count = snd_seq_poll_descriptors_count( sequencer->seq, POLLIN ) + 1;
+  poll_fds = (struct pollfd*)alloca( poll_fd_count * sizeof( struct pollfd ));
+  snd_seq_poll_descriptors( sequencer->seq, poll_fds + 1, poll_fd_count - 1, POLLIN );
+  poll_fds[0].fd = sequencer->trigger_fds[0];
+  poll_fds[0].events = POLLIN;
+
+  while ( sequencer->running ) {
+
+    if ( snd_seq_event_input_pending( sequencer->seq, 1 ) == 0 ) {
+      // No data pending
+      if ( poll( poll_fds, poll_fd_count, -1) >= 0 ) {
+        if ( poll_fds[0].revents & POLLIN ) {
+          bool dummy;
+          int res = read( poll_fds[0].fd, &dummy, sizeof(dummy) );
+          (void) res;
+        }
       }
-      else
-        std::cerr << "\nMidiInAlsa: message queue limit reached!!\n\n";
+      continue;
     }
+
+    alsaMidiProcess( sequencer );
   }
 
-  if ( buffer ) free( buffer );
-  snd_midi_event_free( apiData->coder );
-  apiData->coder = 0;
-  apiData->thread = apiData->dummy_thread_id;
   return 0;
 }
 
-MidiInAlsa :: MidiInAlsa( const std::string clientName, unsigned int queueSizeLimit ) : MidiInApi( queueSizeLimit )
+// The shared sequencer clients of the process.
+static std::mutex alsaSequencersMutex;
+static std::vector<AlsaSequencer *> alsaSequencers;
+
+// Return the shared client with the given name, opened on first use,
+// or a new private client.  Returns 0 if the sequencer cannot be opened.
+static AlsaSequencer *alsaSequencerOpen( const std::string &clientName, bool shared )
+{
+  std::lock_guard<std::mutex> lock( alsaSequencersMutex );
+  if ( shared ) {
+    for ( unsigned int i=0; i<alsaSequencers.size(); i++ ) {
+      if ( alsaSequencers[i]->name == clientName ) {
+        alsaSequencers[i]->refCount++;
+        return alsaSequencers[i];
+      }
+    }
+  }
+
+  // Set up the ALSA sequencer client.
+  snd_seq_t *seq;
+  if ( snd_seq_open( &seq, "default", SND_SEQ_OPEN_DUPLEX, SND_SEQ_NONBLOCK ) < 0 ) return 0;
+  snd_seq_set_client_name( seq, clientName.c_str() );
+
+  AlsaSequencer *sequencer = new AlsaSequencer;
+  sequencer->name = clientName;
+  sequencer->shared = shared;
+  sequencer->refCount = 1;
+  sequencer->seq = seq;
+  sequencer->delivering = 0;
+  sequencer->running = false;
+  if ( pipe( sequencer->trigger_fds ) == -1 ) {
+    snd_seq_close( seq );
+    delete sequencer;
+    return 0;
+  }
+
+  // Create and start the queue, with an arbitrary tempo (mm=100) and
+  // resolution (240).
+  sequencer->queue_id = snd_seq_alloc_named_queue( seq, "RtMidi Queue" );
+  snd_seq_queue_tempo_t *qtempo;
+  snd_seq_queue_tempo_alloca( &qtempo );
+  snd_seq_queue_tempo_set_tempo( qtempo, 600000 );
+  snd_seq_queue_tempo_set_ppq( qtempo, 240 );
+  snd_seq_set_queue_tempo( seq, sequencer->queue_id, qtempo );
+  snd_seq_start_queue( seq, sequencer->queue_id, NULL );
+  snd_seq_drain_output( seq );
+  sequencer->queueStart = RtMidi::getTime();
+
+  if ( shared ) alsaSequencers.push_back( sequencer );
+  return sequencer;
+}
+
+// Release a client; the last user closes it, stopping its input
+// thread.  Its inputs must have been removed.
+static void alsaSequencerClose( AlsaSequencer *sequencer )
+{
+  {
+    std::lock_guard<std::mutex> lock( alsaSequencersMutex );
+    if ( --sequencer->refCount > 0 ) return;
+    if ( sequencer->shared )
+      alsaSequencers.erase( std::find( alsaSequencers.begin(), alsaSequencers.end(), sequencer ) );
+  }
+
+  if ( sequencer->running ) {
+    sequencer->running = false;
+    bool stop = false;
+    int res = write( sequencer->trigger_fds[1], &stop, sizeof(stop) );
+    (void) res;
+    pthread_join( sequencer->thread, NULL );
+  }
+
+  snd_seq_free_queue( sequencer->seq, sequencer->queue_id );
+  snd_seq_close( sequencer->seq );
+  close( sequencer->trigger_fds[0] );
+  close( sequencer->trigger_fds[1] );
+  delete sequencer;
+}
+
+// Start handing the events sent to one of our ports to an input.  The
+// first input of a shared client starts its thread, which then runs
+// until the client is closed; returns false if that fails.
+static bool alsaSequencerAddInput( AlsaSequencer *sequencer, int port, MidiInApi::RtMidiInData *data )
+{
+  std::lock_guard<std::mutex> threadLock( sequencer->threadMutex );
+  {
+    std::lock_guard<std::mutex> lock( sequencer->inputMutex );
+    sequencer->inputs[port] = data;
+  }
+  if ( !sequencer->shared || sequencer->running ) return true;
+
+  // Start our MIDI input thread.
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+  pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+
+  sequencer->running = true;
+  int err = pthread_create(&sequencer->thread, &attr, alsaMidiHandler, sequencer);
+  pthread_attr_destroy(&attr);
+  if ( err ) {
+    sequencer->running = false;
+    std::lock_guard<std::mutex> lock( sequencer->inputMutex );
+    sequencer->inputs.erase( port );
+    return false;
+  }
+
+  return true;
+}
+
+// Stop handing events to an input.  Once this returns, the input is
+// not called again: a delivery to it in progress on another thread is
+// waited for, while its own callback may close it without waiting.
+static void alsaSequencerRemoveInput( AlsaSequencer *sequencer, int port )
+{
+  std::unique_lock<std::mutex> lock( sequencer->inputMutex );
+  std::map<int, MidiInApi::RtMidiInData *>::iterator input = sequencer->inputs.find( port );
+  if ( input == sequencer->inputs.end() ) return;
+  MidiInApi::RtMidiInData *data = input->second;
+  sequencer->inputs.erase( input );
+  while ( sequencer->delivering == data && !pthread_equal( sequencer->deliverer, pthread_self() ) )
+    sequencer->delivered.wait( lock );
+}
+
+// The options of the shared thread after an input asked for
+// 'requested': the real-time policy with the highest priority asked
+// for so far wins, with its CPU mask, or the first mask given.
+static RtMidi::ThreadOptions alsaMergeThreadOptions( const RtMidi::ThreadOptions &current,
+                                                     const RtMidi::ThreadOptions &requested )
+{
+  RtMidi::ThreadOptions merged = current;
+  if ( requested.policy != RtMidi::THREAD_DEFAULT &&
+       ( current.policy == RtMidi::THREAD_DEFAULT || requested.priority > current.priority ) ) {
+    merged.policy = requested.policy;
+    merged.priority = requested.priority;
+    if ( requested.cpuMask ) merged.cpuMask = requested.cpuMask;
+  }
+  if ( merged.cpuMask == 0 ) merged.cpuMask = requested.cpuMask;
+  return merged;
+}
+
+MidiInAlsa :: MidiInAlsa( const std::string clientName, unsigned int queueSizeLimit )
+  : MidiInApi( queueSizeLimit ), threadless_( false )
 {
   initialize( clientName );
 }
 
 MidiInAlsa :: ~MidiInAlsa()
 {
+  // Stop following port changes.
+  AlsaPortDirectory *directory = AlsaPortDirectory::instance();
+  if ( directory ) directory->removeHandler( this );
+
   // Close a connection if it exists.
   closePort();
 
-  // Shutdown the input thread.
+  // Cleanup.
   AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
-  if ( inputData_.doInput ) {
-    inputData_.doInput = false;
-    int res = write( data->trigger_fds[1], &inputData_.doInput, sizeof(inputData_.doInput) );
-    (void) res;
-    if ( !pthread_equal(data->thread, data->dummy_thread_id) )
-      pthread_join( data->thread, NULL );
+  if ( data->vport >= 0 ) {
+    snd_seq_delete_port( data->sequencer->seq, data->vport );
+    alsaPortsChanged();
   }
-
-  // Cleanup.
-  close ( data->trigger_fds[0] );
-  close ( data->trigger_fds[1] );
-  if ( data->vport >= 0 ) snd_seq_delete_port( data->seq, data->vport );
-#ifndef AVOID_TIMESTAMPING
-  snd_seq_free_queue( data->seq, data->queue_id );
-#endif
-  snd_seq_close( data->seq );
+  alsaSequencerClose( data->sequencer );
   delete data;
 }
 
 void MidiInAlsa :: initialize( const std::string& clientName )
 {
-  // Set up the ALSA sequencer client.
-  snd_seq_t *seq;
-  int result = snd_seq_open(&seq, "default", SND_SEQ_OPEN_DUPLEX, SND_SEQ_NONBLOCK);
-  if ( result < 0 ) {
+  // Use the sequencer client shared by the ports of this client name.
+  AlsaSequencer *sequencer = alsaSequencerOpen( clientName, true );
+  if ( sequencer == 0 ) {
     errorString_ = "MidiInAlsa::initialize: error creating ALSA sequencer client object.";
     error( RtMidiError::DRIVER_ERROR, errorString_ );
     return;
   }
 
-  // Set client name.
-  snd_seq_set_client_name( seq, clientName.c_str() );
-
   // Save our api-specific connection information.
   AlsaMidiData *data = (AlsaMidiData *) new AlsaMidiData;
-  data->seq = seq;
+  data->sequencer = sequencer;
   data->portNum = -1;
   data->vport = -1;
   data->subscription = 0;
-  data->dummy_thread_id = pthread_self();
-  data->thread = data->dummy_thread_id;
-  data->trigger_fds[0] = -1;
-  data->trigger_fds[1] = -1;
+  data->coder = 0;
+  data->bufferSize = 0;
+  data->buffer = 0;
+  data->lastTime = 0;
+  data->batched = 0;
+  data->portLost = false;
   apiData_ = (void *) data;
   inputData_.apiData = (void *) data;
 
-   if ( pipe(data->trigger_fds) == -1 ) {
-    errorString_ = "MidiInAlsa::initialize: error creating pipe objects.";
-    error( RtMidiError::DRIVER_ERROR, errorString_ );
+  // Follow devices that come and go.
+  AlsaPortDirectory *directory = AlsaPortDirectory::instance();
+  if ( directory ) directory->addHandler( &MidiInAlsa::portChanged, this );
+}
+
+unsigned int MidiInAlsa :: getPortCount()
+{
+  AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
+  return alsaPortCount( data->sequencer->seq, true );
+}
+
+std::string MidiInAlsa :: getPortName( unsigned int portNumber )
+{
+  AlsaPort port;
+  AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
+  if ( alsaFindPort( data->sequencer->seq, true, portNumber, port ) )
+    return port.name;
+
+  // If we get here, we didn't find a match.
+  errorString_ = "MidiInAlsa::getPortName: error looking for port name!";
+  error( RtMidiError::WARNING, errorString_ );
+  return std::string();
+}
+
+void MidiInAlsa :: openPort( unsigned int portNumber, const std::string portName )
+{
+  if ( connected_ ) {
+    errorString_ = "MidiInAlsa::openPort: a valid connection already exists!";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+
+  unsigned int nSrc = this->getPortCount();
+  if ( nSrc < 1 ) {
+    errorString_ = "MidiInAlsa::openPort: no MIDI input sources found!";
+    error( RtMidiError::NO_DEVICES_FOUND, errorString_ );
+    return;
+  }
+
+  AlsaPort source;
+  AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
+  if ( !alsaFindPort( data->sequencer->seq, true, portNumber, source ) ) {
+    std::ostringstream ost;
+    ost << "MidiInAlsa::openPort: the 'portNumber' argument (" << portNumber << ") is invalid.";
+    errorString_ = ost.str();
+    error( RtMidiError::INVALID_PARAMETER, errorString_ );
     return;
   }
 
-  // Create the input queue
+  snd_seq_addr_t sender, receiver;
+  sender = source.addr;
+  receiver.client = snd_seq_client_id( data->sequencer->seq );
+
+  snd_seq_port_info_t *pinfo;
+  snd_seq_port_info_alloca( &pinfo );
+  if ( data->vport < 0 ) {
+    snd_seq_port_info_set_client( pinfo, 0 );
+    snd_seq_port_info_set_port( pinfo, 0 );
+    snd_seq_port_info_set_capability( pinfo,
+                                      SND_SEQ_PORT_CAP_WRITE |
+                                      SND_SEQ_PORT_CAP_SUBS_WRITE );
+    snd_seq_port_info_set_type( pinfo,
+                                SND_SEQ_PORT_TYPE_MIDI_GENERIC |
+                                SND_SEQ_PORT_TYPE_APPLICATION );
+    snd_seq_port_info_set_midi_channels(pinfo, 16);
 #ifndef AVOID_TIMESTAMPING
-  data->queue_id = snd_seq_alloc_named_queue(seq, "RtMidi Queue");
-  // Set arbitrary tempo (mm=100) and resolution (240)
-  snd_seq_queue_tempo_t *qtempo;
-  snd_seq_queue_tempo_alloca(&qtempo);
-  snd_seq_queue_tempo_set_tempo(qtempo, 600000);
-  snd_seq_queue_tempo_set_ppq(qtempo, 240);
-  snd_seq_set_queue_tempo(data->seq, data->queue_id, qtempo);
-  snd_seq_drain_output(data->seq);
+    snd_seq_port_info_set_timestamping(pinfo, 1);
+    snd_seq_port_info_set_timestamp_real(pinfo, 1);    
+    snd_seq_port_info_set_timestamp_queue(pinfo, data->sequencer->queue_id);
 #endif
+    snd_seq_port_info_set_name(pinfo,  portName.c_str() );
+    data->vport = snd_seq_create_port(data->sequencer->seq, pinfo);
+  
+    if ( data->vport < 0 ) {
+      errorString_ = "MidiInAlsa::openPort: ALSA error creating input port.";
+      error( RtMidiError::DRIVER_ERROR, errorString_ );
+      return;
+    }
+    data->vport = snd_seq_port_info_get_port(pinfo);
+    alsaPortsChanged();
+  }
+
+  receiver.port = data->vport;
+
+  std::unique_lock<std::mutex> portLock( data->portMutex );
+  if ( !data->subscription ) {
+    // Make subscription
+    if (snd_seq_port_subscribe_malloc( &data->subscription ) < 0) {
+      errorString_ = "MidiInAlsa::openPort: ALSA error allocation port subscription.";
+      error( RtMidiError::DRIVER_ERROR, errorString_ );
+      return;
+    }
+    snd_seq_port_subscribe_set_sender(data->subscription, &sender);
+    snd_seq_port_subscribe_set_dest(data->subscription, &receiver);
+    if ( alsaSubscribe( data->sequencer, data->subscription ) ) {
+      snd_seq_port_subscribe_free( data->subscription );
+      data->subscription = 0;
+      errorString_ = "MidiInAlsa::openPort: ALSA error making port connection.";
+      error( RtMidiError::DRIVER_ERROR, errorString_ );
+      return;
+    }
+    data->peer = source;
+    data->portLost = false;
+  }
+  portLock.unlock();
+
+  if ( inputData_.doInput == false && !startInput( "MidiInAlsa::openPort" ) ) return;
+
+  connected_ = true;
 }
 
-// This function is used to count or get the pinfo structure for a given port number.
-unsigned int portInfo( snd_seq_t *seq, snd_seq_port_info_t *pinfo, unsigned int type, int portNumber )
+void MidiInAlsa :: openVirtualPort( std::string portName )
 {
-  snd_seq_client_info_t *cinfo;
-  int client;
-  int count = 0;
-  snd_seq_client_info_alloca( &cinfo );
+  AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
+  if ( data->vport < 0 ) {
+    snd_seq_port_info_t *pinfo;
+    snd_seq_port_info_alloca( &pinfo );
+    snd_seq_port_info_set_capability( pinfo,
+				      SND_SEQ_PORT_CAP_WRITE |
+				      SND_SEQ_PORT_CAP_SUBS_WRITE );
+    snd_seq_port_info_set_type( pinfo,
+				SND_SEQ_PORT_TYPE_MIDI_GENERIC |
+				SND_SEQ_PORT_TYPE_APPLICATION );
+    snd_seq_port_info_set_midi_channels(pinfo, 16);
+#ifndef AVOID_TIMESTAMPING
+    snd_seq_port_info_set_timestamping(pinfo, 1);
+    snd_seq_port_info_set_timestamp_real(pinfo, 1);    
+    snd_seq_port_info_set_timestamp_queue(pinfo, data->sequencer->queue_id);
+#endif
+    snd_seq_port_info_set_name(pinfo, portName.c_str());
+    data->vport = snd_seq_create_port(data->sequencer->seq, pinfo);
 
-  snd_seq_client_info_set_client( cinfo, -1 );
-  while ( snd_seq_query_next_client( seq, cinfo ) >= 0 ) {
-    client = snd_seq_client_info_get_client( cinfo );
-    if ( client == 0 ) continue;
-    // Reset query info
-    snd_seq_port_info_set_client( pinfo, client );
-    snd_seq_port_info_set_port( pinfo, -1 );
-    while ( snd_seq_query_next_port( seq, pinfo ) >= 0 ) {
-      unsigned int atyp = snd_seq_port_info_get_type( pinfo );
-      if ( ( ( atyp & SND_SEQ_PORT_TYPE_MIDI_GENERIC ) == 0 ) &&
-        ( ( atyp & SND_SEQ_PORT_TYPE_SYNTH ) == 0 ) ) continue;
-      unsigned int caps = snd_seq_port_info_get_capability( pinfo );
-      if ( ( caps & type ) != type ) continue;
-      if ( count == portNumber ) return 1;
-      ++count;
+    if ( data->vport < 0 ) {
+      errorString_ = "MidiInAlsa::openVirtualPort: ALSA error creating virtual port.";
+      error( RtMidiError::DRIVER_ERROR, errorString_ );
+      return;
     }
+    data->vport = snd_seq_port_info_get_port(pinfo);
+    alsaPortsChanged();
   }
 
-  // If a negative portNumber was used, return the port count.
-  if ( portNumber < 0 ) return count;
-  return 0;
+  if ( inputData_.doInput == false ) startInput( "MidiInAlsa::openVirtualPort" );
 }
 
-unsigned int MidiInAlsa :: getPortCount()
+// Start delivering the events sent to our port, from the input thread
+// of the shared client or, in threadless mode, from processPending().
+bool MidiInAlsa :: startInput( const std::string &caller )
 {
-  snd_seq_port_info_t *pinfo;
-  snd_seq_port_info_alloca( &pinfo );
+  AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
+  if ( !alsaMidiStartDecoder( &inputData_ ) ) {
+    errorString_ = caller + ": error initializing MIDI input decoder!";
+    error( RtMidiError::DRIVER_ERROR, errorString_ );
+    return false;
+  }
+
+  inputData_.doInput = true;
+  if ( !alsaSequencerAddInput( data->sequencer, data->vport, &inputData_ ) ) {
+    inputData_.doInput = false;
+    alsaMidiStopDecoder( data );
+    {
+      std::lock_guard<std::mutex> portLock( data->portMutex );
+      if ( data->subscription ) {
+        alsaUnsubscribe( data->sequencer, data->subscription );
+        snd_seq_port_subscribe_free( data->subscription );
+        data->subscription = 0;
+      }
+    }
+    errorString_ = caller + ": error starting MIDI input thread!";
+    error( RtMidiError::THREAD_ERROR, errorString_ );
+    return false;
+  }
+
+  // The thread is shared, so it runs with the most demanding options
+  // of its ports.
+  if ( !threadless_ ) {
+    AlsaSequencer *sequencer = data->sequencer;
+    std::lock_guard<std::mutex> threadLock( sequencer->threadMutex );
+    sequencer->threadOptions = alsaMergeThreadOptions( sequencer->threadOptions, threadOptions_ );
+    std::string problem;
+    if ( !applyThreadOptions( sequencer->thread, sequencer->threadOptions, effectiveThreadOptions_, problem ) ) {
+      errorString_ = caller + ": " + problem;
+      error( RtMidiError::WARNING, errorString_ );
+    }
+  }
+
+  return true;
+}
 
+void MidiInAlsa :: closePort( void )
+{
   AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
-  return portInfo( data->seq, pinfo, SND_SEQ_PORT_CAP_READ|SND_SEQ_PORT_CAP_SUBS_READ, -1 );
+
+  if ( connected_ ) {
+    std::unique_lock<std::mutex> portLock( data->portMutex );
+    if ( data->subscription ) {
+      if ( !data->portLost ) alsaUnsubscribe( data->sequencer, data->subscription );
+      snd_seq_port_subscribe_free( data->subscription );
+      data->subscription = 0;
+    }
+    portLock.unlock();
+    connected_ = false;
+  }
+
+  // Stop delivering input to avoid triggering the callback, while the port is intended to be closed
+  if ( inputData_.doInput ) {
+    inputData_.doInput = false;
+    alsaSequencerRemoveInput( data->sequencer, data->vport );
+    alsaMidiStopDecoder( data );
+  }
 }
 
-std::string MidiInAlsa :: getPortName( unsigned int portNumber )
+void MidiInAlsa :: setThreadless( bool threadless )
 {
-  snd_seq_client_info_t *cinfo;
-  snd_seq_port_info_t *pinfo;
-  snd_seq_client_info_alloca( &cinfo );
-  snd_seq_port_info_alloca( &pinfo );
+  if ( inputData_.doInput ) {
+    errorString_ = "MidiInAlsa::setThreadless: cannot change the input mode while a port is open!";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+  if ( threadless == threadless_ ) return;
 
-  std::string stringName;
+  // A threadless input reads a client of its own, so that its events
+  // are not taken by the input thread of the shared client.
   AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
-  if ( portInfo( data->seq, pinfo, SND_SEQ_PORT_CAP_READ|SND_SEQ_PORT_CAP_SUBS_READ, (int) portNumber ) ) {
-    int cnum = snd_seq_port_info_get_client( pinfo );
-    snd_seq_get_any_client_info( data->seq, cnum, cinfo );
-    std::ostringstream os;
-    os << snd_seq_client_info_get_name( cinfo );
-    os << " ";                                    // These lines added to make sure devices are listed
-    os << snd_seq_port_info_get_client( pinfo );  // with full portnames added to ensure individual device names
-    os << ":";
-    os << snd_seq_port_info_get_port( pinfo );
-    stringName = os.str();
-    return stringName;
+  AlsaSequencer *sequencer = alsaSequencerOpen( data->sequencer->name, !threadless );
+  if ( sequencer == 0 ) {
+    errorString_ = "MidiInAlsa::setThreadless: error creating ALSA sequencer client object.";
+    error( RtMidiError::DRIVER_ERROR, errorString_ );
+    return;
+  }
+  if ( data->vport >= 0 ) {
+    snd_seq_delete_port( data->sequencer->seq, data->vport );
+    alsaPortsChanged();
+  }
+  data->vport = -1;
+  alsaSequencerClose( data->sequencer );
+  data->sequencer = sequencer;
+
+  threadless_ = threadless;
+}
+
+void MidiInAlsa :: getPollDescriptors( std::vector<int> &descriptors )
+{
+  AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
+  descriptors.clear();
+
+  int count = snd_seq_poll_descriptors_count( data->sequencer->seq, POLLIN );
+  if ( count <= 0 ) return;
+  struct pollfd *poll_fds = (struct pollfd *) alloca( count * sizeof( struct pollfd ) );
+  count = snd_seq_poll_descriptors( data->sequencer->seq, poll_fds, count, POLLIN );
+  for ( int i=0; i<count; i++ )
+    descriptors.push_back( poll_fds[i].fd );
+}
+
+void MidiInAlsa :: setPortCallback( RtMidiPortCallback callback, void *userData )
+{
+  if ( AlsaPortDirectory::instance() == 0 ) {
+    errorString_ = "MidiInAlsa::setPortCallback: cannot watch the ALSA system announcements.";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+
+  portCallback_ = callback;
+  portCallbackUserData_ = userData;
+}
+
+void MidiInAlsa :: portChanged( const AlsaPort &port, bool added, void *object )
+{
+  MidiInAlsa *self = static_cast<MidiInAlsa *> (object);
+  AlsaMidiData *data = static_cast<AlsaMidiData *> (self->apiData_);
+
+  int status = alsaFollowPort( data, port, added, true );
+  if ( status == 1 ) {
+    self->errorString_ = "MidiInAlsa: input source " + port.name + " went away, waiting for it to return.";
+    self->error( RtMidiError::WARNING, self->errorString_ );
+  }
+  else if ( status == 2 ) {
+    self->errorString_ = "MidiInAlsa: reconnected to input source " + port.name + ".";
+    self->error( RtMidiError::WARNING, self->errorString_ );
+  }
+
+  if ( self->portCallback_ && ( port.caps & PORT_CAPS_INPUT ) == PORT_CAPS_INPUT )
+    self->portCallback_( port.name, added, self->portCallbackUserData_ );
+}
+
+unsigned int MidiInAlsa :: processPending( void )
+{
+  if ( !threadless_ ) {
+    errorString_ = "MidiInAlsa::processPending: input is serviced by the RtMidi thread (see setThreadless()).";
+    error( RtMidiError::WARNING, errorString_ );
+    return 0;
+  }
+
+  if ( !inputData_.doInput ) return 0;
+  AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
+  return alsaMidiProcess( data->sequencer );
+}
+
+//*********************************************************************//
+//  API: LINUX ALSA
+//  Class Definitions: MidiOutAlsa
+//*********************************************************************//
+
+MidiOutAlsa :: MidiOutAlsa( const std::string clientName ) : MidiOutApi()
+{
+  initialize( clientName );
+}
+
+MidiOutAlsa :: ~MidiOutAlsa()
+{
+  // Stop following port changes.
+  AlsaPortDirectory *directory = AlsaPortDirectory::instance();
+  if ( directory ) directory->removeHandler( this );
+
+  // Close a connection if it exists.
+  closePort();
+
+  // Cleanup.
+  AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
+  if ( data->vport >= 0 ) {
+    snd_seq_delete_port( data->sequencer->seq, data->vport );
+    alsaPortsChanged();
+  }
+  if ( data->coder ) snd_midi_event_free( data->coder );
+  if ( data->buffer ) free( data->buffer );
+  alsaSequencerClose( data->sequencer );
+  delete data;
+}
+
+void MidiOutAlsa :: initialize( const std::string& clientName )
+{
+  // Use the sequencer client shared by the ports of this client name.
+  AlsaSequencer *sequencer = alsaSequencerOpen( clientName, true );
+  if ( sequencer == 0 ) {
+    errorString_ = "MidiOutAlsa::initialize: error creating ALSA sequencer client object.";
+    error( RtMidiError::DRIVER_ERROR, errorString_ );
+    return;
+	}
+
+  // Save our api-specific connection information.
+  AlsaMidiData *data = (AlsaMidiData *) new AlsaMidiData;
+  data->sequencer = sequencer;
+  data->portNum = -1;
+  data->vport = -1;
+  data->subscription = 0;
+  data->bufferSize = 32;
+  data->coder = 0;
+  data->buffer = 0;
+  data->portLost = false;
+  int result = snd_midi_event_new( data->bufferSize, &data->coder );
+  if ( result < 0 ) {
+    alsaSequencerClose( sequencer );
+    delete data;
+    errorString_ = "MidiOutAlsa::initialize: error initializing MIDI event parser!\n\n";
+    error( RtMidiError::DRIVER_ERROR, errorString_ );
+    return;
+  }
+  data->buffer = (unsigned char *) malloc( data->bufferSize );
+  if ( data->buffer == NULL ) {
+    snd_midi_event_free( data->coder );
+    alsaSequencerClose( sequencer );
+    delete data;
+    errorString_ = "MidiOutAlsa::initialize: error allocating buffer memory!\n\n";
+    error( RtMidiError::MEMORY_ERROR, errorString_ );
+    return;
   }
+  snd_midi_event_init( data->coder );
+  apiData_ = (void *) data;
+
+  // Follow devices that come and go.
+  AlsaPortDirectory *directory = AlsaPortDirectory::instance();
+  if ( directory ) directory->addHandler( &MidiOutAlsa::portChanged, this );
+}
+
+unsigned int MidiOutAlsa :: getPortCount()
+{
+  AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
+  return alsaPortCount( data->sequencer->seq, false );
+}
+
+std::string MidiOutAlsa :: getPortName( unsigned int portNumber )
+{
+  AlsaPort port;
+  AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
+  if ( alsaFindPort( data->sequencer->seq, false, portNumber, port ) )
+    return port.name;
+
+  // If we get here, we didn't find a match.
+  errorString_ = "MidiOutAlsa::getPortName: error looking for port name!";
+  error( RtMidiError::WARNING, errorString_ );
+  return std::string();
+}
+
+void MidiOutAlsa :: openPort( unsigned int portNumber, const std::string portName )
+{
+  if ( connected_ ) {
+    errorString_ = "MidiOutAlsa::openPort: a valid connection already exists!";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+
+  unsigned int nSrc = this->getPortCount();
+  if (nSrc < 1) {
+    errorString_ = "MidiOutAlsa::openPort: no MIDI output sources found!";
+    error( RtMidiError::NO_DEVICES_FOUND, errorString_ );
+    return;
+  }
+
+  AlsaPort destination;
+  AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
+  if ( !alsaFindPort( data->sequencer->seq, false, portNumber, destination ) ) {
+    std::ostringstream ost;
+    ost << "MidiOutAlsa::openPort: the 'portNumber' argument (" << portNumber << ") is invalid.";
+    errorString_ = ost.str();
+    error( RtMidiError::INVALID_PARAMETER, errorString_ );
+    return;
+  }
+
+  snd_seq_addr_t sender, receiver;
+  receiver = destination.addr;
+  sender.client = snd_seq_client_id( data->sequencer->seq );
+
+  if ( data->vport < 0 ) {
+    data->vport = snd_seq_create_simple_port( data->sequencer->seq, portName.c_str(),
+                                              SND_SEQ_PORT_CAP_READ|SND_SEQ_PORT_CAP_SUBS_READ,
+                                              SND_SEQ_PORT_TYPE_MIDI_GENERIC|SND_SEQ_PORT_TYPE_APPLICATION );
+    if ( data->vport < 0 ) {
+      errorString_ = "MidiOutAlsa::openPort: ALSA error creating output port.";
+      error( RtMidiError::DRIVER_ERROR, errorString_ );
+      return;
+    }
+    alsaPortsChanged();
+  }
+
+  sender.port = data->vport;
+
+  // Make subscription
+  std::unique_lock<std::mutex> portLock( data->portMutex );
+  if (snd_seq_port_subscribe_malloc( &data->subscription ) < 0) {
+    data->subscription = 0;
+    errorString_ = "MidiOutAlsa::openPort: error allocating port subscription.";
+    error( RtMidiError::DRIVER_ERROR, errorString_ );
+    return;
+  }
+  snd_seq_port_subscribe_set_sender(data->subscription, &sender);
+  snd_seq_port_subscribe_set_dest(data->subscription, &receiver);
+  snd_seq_port_subscribe_set_time_update(data->subscription, 1);
+  snd_seq_port_subscribe_set_time_real(data->subscription, 1);
+  if ( alsaSubscribe( data->sequencer, data->subscription ) ) {
+    snd_seq_port_subscribe_free( data->subscription );
+    data->subscription = 0;
+    errorString_ = "MidiOutAlsa::openPort: ALSA error making port connection.";
+    error( RtMidiError::DRIVER_ERROR, errorString_ );
+    return;
+  }
+  data->peer = destination;
+  data->portLost = false;
+  portLock.unlock();
+
+  connected_ = true;
+}
+
+void MidiOutAlsa :: closePort( void )
+{
+  if ( connected_ ) {
+    AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
+    std::lock_guard<std::mutex> portLock( data->portMutex );
+    if ( !data->portLost ) alsaUnsubscribe( data->sequencer, data->subscription );
+    snd_seq_port_subscribe_free( data->subscription );
+    data->subscription = 0;
+    connected_ = false;
+  }
+}
+
+void MidiOutAlsa :: openVirtualPort( std::string portName )
+{
+  AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
+  if ( data->vport < 0 ) {
+    data->vport = snd_seq_create_simple_port( data->sequencer->seq, portName.c_str(),
+                                              SND_SEQ_PORT_CAP_READ|SND_SEQ_PORT_CAP_SUBS_READ,
+                                              SND_SEQ_PORT_TYPE_MIDI_GENERIC|SND_SEQ_PORT_TYPE_APPLICATION );
+
+    if ( data->vport < 0 ) {
+      errorString_ = "MidiOutAlsa::openVirtualPort: ALSA error creating virtual port.";
+      error( RtMidiError::DRIVER_ERROR, errorString_ );
+    }
+    else alsaPortsChanged();
+  }
+}
+
+void MidiOutAlsa :: setPortCallback( RtMidiPortCallback callback, void *userData )
+{
+  if ( AlsaPortDirectory::instance() == 0 ) {
+    errorString_ = "MidiOutAlsa::setPortCallback: cannot watch the ALSA system announcements.";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+
+  portCallback_ = callback;
+  portCallbackUserData_ = userData;
+}
+
+void MidiOutAlsa :: portChanged( const AlsaPort &port, bool added, void *object )
+{
+  MidiOutAlsa *self = static_cast<MidiOutAlsa *> (object);
+  AlsaMidiData *data = static_cast<AlsaMidiData *> (self->apiData_);
+
+  int status = alsaFollowPort( data, port, added, false );
+  if ( status == 1 ) {
+    self->errorString_ = "MidiOutAlsa: output destination " + port.name + " went away, waiting for it to return.";
+    self->error( RtMidiError::WARNING, self->errorString_ );
+  }
+  else if ( status == 2 ) {
+    self->errorString_ = "MidiOutAlsa: reconnected to output destination " + port.name + ".";
+    self->error( RtMidiError::WARNING, self->errorString_ );
+  }
+
+  if ( self->portCallback_ && ( port.caps & PORT_CAPS_OUTPUT ) == PORT_CAPS_OUTPUT )
+    self->portCallback_( port.name, added, self->portCallbackUserData_ );
+}
+
+void MidiOutAlsa :: sendMessage( std::vector<unsigned char> *message )
+{
+  sendMessageAt( 0, message );
+}
+
+void MidiOutAlsa :: sendMessageAt( long long timeStamp, std::vector<unsigned char> *message )
+{
+  int result;
+  AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
+  unsigned int nBytes = message->size();
+  if ( nBytes > data->bufferSize ) {
+    data->bufferSize = nBytes;
+    result = snd_midi_event_resize_buffer ( data->coder, nBytes);
+    if ( result != 0 ) {
+      errorString_ = "MidiOutAlsa::sendMessage: ALSA error resizing MIDI event buffer.";
+      error( RtMidiError::DRIVER_ERROR, errorString_ );
+      return;
+    }
+    free (data->buffer);
+    data->buffer = (unsigned char *) malloc( data->bufferSize );
+    if ( data->buffer == NULL ) {
+    errorString_ = "MidiOutAlsa::initialize: error allocating buffer memory!\n\n";
+    error( RtMidiError::MEMORY_ERROR, errorString_ );
+    return;
+    }
+  }
+
+  snd_seq_event_t ev;
+  snd_seq_ev_clear(&ev);
+  snd_seq_ev_set_source(&ev, data->vport);
+  snd_seq_ev_set_subs(&ev);
+  for ( unsigned int i=0; i<nBytes; ++i ) data->buffer[i] = message->at(i);
+  result = snd_midi_event_encode( data->coder, data->buffer, (long)nBytes, &ev );
+  if ( result < (int)nBytes ) {
+    errorString_ = "MidiOutAlsa::sendMessage: event parsing error!";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+
+  // Every event goes through the sequencer queue, which delivers it at
+  // the requested time relative to now.  Events that are already due
+  // are scheduled for now rather than sent direct, so that they cannot
+  // overtake earlier events the queue still holds.
+  long long delay = std::max( timeStamp - RtMidi::getTime(), 0LL );
+  snd_seq_real_time_t rtime;
+  rtime.tv_sec = (unsigned int) ( delay / 1000000000LL );
+  rtime.tv_nsec = (unsigned int) ( delay % 1000000000LL );
+  snd_seq_ev_schedule_real( &ev, data->sequencer->queue_id, 1, &rtime );
+
+  // Send the event.  The client may be shared with other ports.
+  std::unique_lock<std::mutex> outputLock( data->sequencer->outputMutex );
+  result = snd_seq_event_output(data->sequencer->seq, &ev);
+  if ( result < 0 ) {
+    outputLock.unlock();
+    errorString_ = "MidiOutAlsa::sendMessage: error sending MIDI message to port.";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+  snd_seq_drain_output(data->sequencer->seq);
+}
+
+#endif // __LINUX_ALSA__
+
+//*********************************************************************//
+//  API: LINUX ALSA RAW MIDI
+//*********************************************************************//
+
+// The ALSA raw MIDI API reads and writes the byte stream of a hardware
+// port (or of the snd-virmidi device) directly, without the sequencer
+// decoding it into events and encoding it again.  Incoming bytes are
+// parsed in user space, including running status.  Raw MIDI devices
+// have no time stamps, so messages are stamped when they are read.
+
+#if defined(__LINUX_ALSA__)
+
+#include <pthread.h>
+
+// ALSA header file.
+#include <alsa/asoundlib.h>
+
+// A raw MIDI port, identified by its ALSA device string.
+struct AlsaRawPort {
+  std::string device; // "hw:card,device,subdevice"
+  std::string name;
+};
+
+// A structure to hold variables related to the ALSA raw MIDI API
+// implementation.
+struct AlsaRawMidiData {
+  snd_rawmidi_t *handle;
+  pthread_t thread;
+  pthread_t dummy_thread_id;
+  int trigger_fds[2];
+  long long lastTime;
+  // Parser state, only used by the input thread.
+  unsigned char runningStatus;  // 0 if none is in effect
+  unsigned int dataBytes;       // data bytes still missing from the current message
+  bool inSysex;
+  unsigned int batched;
+  MidiInApi::MidiMessage batch[ALSA_INPUT_BATCH];
+};
+
+// This function lists every raw MIDI subdevice of every sound card that
+// supports the given stream direction.
+static void alsaRawPorts( snd_rawmidi_stream_t stream, std::vector<AlsaRawPort> &ports )
+{
+  snd_rawmidi_info_t *info;
+  snd_rawmidi_info_alloca( &info );
+
+  ports.clear();
+  int card = -1;
+  while ( snd_card_next( &card ) >= 0 && card >= 0 ) {
+    std::ostringstream cardName;
+    cardName << "hw:" << card;
+    snd_ctl_t *ctl;
+    if ( snd_ctl_open( &ctl, cardName.str().c_str(), 0 ) < 0 ) continue;
+
+    int device = -1;
+    while ( snd_ctl_rawmidi_next_device( ctl, &device ) >= 0 && device >= 0 ) {
+      snd_rawmidi_info_set_device( info, device );
+      snd_rawmidi_info_set_subdevice( info, 0 );
+      snd_rawmidi_info_set_stream( info, stream );
+      if ( snd_ctl_rawmidi_info( ctl, info ) < 0 ) continue;
+
+      unsigned int subdevices = snd_rawmidi_info_get_subdevices_count( info );
+      for ( unsigned int sub=0; sub<subdevices; sub++ ) {
+        snd_rawmidi_info_set_subdevice( info, sub );
+        if ( snd_ctl_rawmidi_info( ctl, info ) < 0 ) continue;
+
+        AlsaRawPort port;
+        std::ostringstream os;
+        os << "hw:" << card << "," << device << "," << sub;
+        port.device = os.str();
+        std::string name = snd_rawmidi_info_get_subdevice_name( info );
+        if ( name.empty() ) name = snd_rawmidi_info_get_name( info );
+        port.name = name + " " + port.device;
+        ports.push_back( port );
+      }
+    }
+    snd_ctl_close( ctl );
+  }
+}
+
+//*********************************************************************//
+//  API: LINUX ALSA RAW MIDI
+//  Class Definitions: MidiInAlsaRaw
+//*********************************************************************//
+
+// Add a complete message to the batch, handing the batch over when it
+// is full.
+static void alsaRawEmit( MidiInApi::RtMidiInData *data, AlsaRawMidiData *apiData,
+                         const unsigned char *bytes, size_t size, long long now )
+{
+  MidiInApi::MidiMessage &message = apiData->batch[apiData->batched++];
+  message.assign( bytes, size );
+  message.absoluteTime = now;
+  if ( data->firstMessage == true ) {
+    message.timeStamp = 0.0;
+    data->firstMessage = false;
+  }
+  else message.timeStamp = ( now - apiData->lastTime ) * 0.000000001;
+  apiData->lastTime = now;
+
+  if ( apiData->batched == ALSA_INPUT_BATCH ) {
+    data->deliver( apiData->batch, apiData->batched );
+    apiData->batched = 0;
+  }
+}
+
+// Parse a chunk of the incoming byte stream.  Channel messages may use
+// running status, and real-time bytes may appear anywhere (even inside
+// a sysex message) without disturbing the message being assembled.
+static void alsaRawParse( MidiInApi::RtMidiInData *data, AlsaRawMidiData *apiData,
+                          const unsigned char *bytes, long count, long long now )
+{
+  // Steady-state input must not allocate.
+  RTMIDI_INPUT_REGION( "ALSA raw MIDI input" );
+  MidiInApi::MidiMessage &message = data->message;
+
+  for ( long i=0; i<count; i++ ) {
+    unsigned char byte = bytes[i];
+
+    if ( byte >= 0xF8 ) { // System real-time
+      if ( byte == 0xFD || data->filter[byte] ) continue; // Undefined or filtered
+      alsaRawEmit( data, apiData, &byte, 1, now );
+      continue;
+    }
+
+    if ( byte & 0x80 ) { // Status byte
+      if ( apiData->inSysex ) {
+        apiData->inSysex = false;
+        if ( byte == 0xF7 ) {
+          if ( !data->filter[0xF0] ) {
+            message.push_back( byte );
+            alsaRawEmit( data, apiData, message.data(), message.size(), now );
+          }
+          message.clear();
+          continue;
+        }
+        // Any other status byte aborts the sysex message.
+        message.clear();
+      }
+
+      if ( byte < 0xF0 ) { // Channel message
+        apiData->runningStatus = byte;
+        apiData->dataBytes = ( ( byte & 0xE0 ) == 0xC0 ) ? 1 : 2;
+      }
+      else {
+        // System common messages cancel running status.
+        apiData->runningStatus = 0;
+        apiData->dataBytes = 0;
+        message.clear();
+        switch ( byte ) {
+        case 0xF0: // Sysex
+          apiData->inSysex = true;
+          break;
+        case 0xF1: // MIDI time code quarter frame
+        case 0xF3: // Song select
+          apiData->dataBytes = 1;
+          break;
+        case 0xF2: // Song position pointer
+          apiData->dataBytes = 2;
+          break;
+        case 0xF6: // Tune request
+          alsaRawEmit( data, apiData, &byte, 1, now );
+          continue;
+        default: // Undefined or a stray end of sysex
+          continue;
+        }
+      }
+      message.assign( &byte, 1 );
+      continue;
+    }
+
+    // Data byte.  Ignored sysex is skipped up to its end rather than
+    // collected, so a large dump does not grow the message.
+    if ( apiData->inSysex ) {
+      if ( !data->filter[0xF0] )
+        message.push_back( byte );
+      continue;
+    }
+    if ( apiData->dataBytes == 0 ) {
+      // Running status: the status byte of the previous message applies.
+      if ( apiData->runningStatus == 0 ) continue; // stray data byte
+      message.assign( &apiData->runningStatus, 1 );
+      apiData->dataBytes = ( ( apiData->runningStatus & 0xE0 ) == 0xC0 ) ? 1 : 2;
+    }
+    message.push_back( byte );
+    if ( --apiData->dataBytes == 0 ) {
+      if ( !data->filter[message[0]] )
+        alsaRawEmit( data, apiData, message.data(), message.size(), now );
+      message.clear();
+    }
+  }
+}
+
+static void *alsaRawMidiHandler( void *ptr )
+{
+  MidiInApi::RtMidiInData *data = static_cast<MidiInApi::RtMidiInData *> (ptr);
+  AlsaRawMidiData *apiData = static_cast<AlsaRawMidiData *> (data->apiData);
+
+  unsigned char buffer[256];
+  int poll_fd_count;
+  struct pollfd *poll_fds;
+
+  poll_fd_count = snd_rawmidi_poll_descriptors_count( apiData->handle ) + 1;
+  poll_fds = (struct pollfd*)alloca( poll_fd_count * sizeof( struct pollfd ));
+  snd_rawmidi_poll_descriptors( apiData->handle, poll_fds + 1, poll_fd_count - 1 );
+  poll_fds[0].fd = apiData->trigger_fds[0];
+  poll_fds[0].events = POLLIN;
+
+  while ( data->doInput ) {
+
+    ssize_t nBytes = snd_rawmidi_read( apiData->handle, buffer, sizeof( buffer ) );
+    if ( nBytes == -EAGAIN ) {
+      // Everything read since the last wakeup is handed over at once.
+      if ( apiData->batched > 0 ) {
+        data->deliver( apiData->batch, apiData->batched );
+        apiData->batched = 0;
+      }
+      if ( poll( poll_fds, poll_fd_count, -1) >= 0 ) {
+        if ( poll_fds[0].revents & POLLIN ) {
+          bool dummy;
+          int res = read( poll_fds[0].fd, &dummy, sizeof(dummy) );
+          (void) res;
+        }
+      }
+      continue;
+    }
+    else if ( nBytes < 0 ) {
+      std::cerr << "\nMidiInAlsaRaw::alsaRawMidiHandler: error reading MIDI input: " << snd_strerror( nBytes ) << "\n\n";
+      data->doInput = false;
+      break;
+    }
+
+    alsaRawParse( data, apiData, buffer, nBytes, RtMidi::getTime() );
+  }
+
+  apiData->thread = apiData->dummy_thread_id;
+  return 0;
+}
+
+MidiInAlsaRaw :: MidiInAlsaRaw( const std::string clientName, unsigned int queueSizeLimit ) : MidiInApi( queueSizeLimit )
+{
+  initialize( clientName );
+}
+
+MidiInAlsaRaw :: ~MidiInAlsaRaw()
+{
+  // Close a connection if it exists.
+  closePort();
+
+  // Cleanup.
+  AlsaRawMidiData *data = static_cast<AlsaRawMidiData *> (apiData_);
+  close ( data->trigger_fds[0] );
+  close ( data->trigger_fds[1] );
+  delete data;
+}
+
+void MidiInAlsaRaw :: initialize( const std::string& /*clientName*/ )
+{
+  // Raw MIDI devices have no client name; save our api-specific
+  // connection information.
+  AlsaRawMidiData *data = (AlsaRawMidiData *) new AlsaRawMidiData;
+  data->handle = 0;
+  data->dummy_thread_id = pthread_self();
+  data->thread = data->dummy_thread_id;
+  data->trigger_fds[0] = -1;
+  data->trigger_fds[1] = -1;
+  data->lastTime = 0;
+  data->batched = 0;
+  apiData_ = (void *) data;
+  inputData_.apiData = (void *) data;
+
+  if ( pipe(data->trigger_fds) == -1 ) {
+    errorString_ = "MidiInAlsaRaw::initialize: error creating pipe objects.";
+    error( RtMidiError::DRIVER_ERROR, errorString_ );
+    return;
+  }
+}
+
+unsigned int MidiInAlsaRaw :: getPortCount()
+{
+  std::vector<AlsaRawPort> ports;
+  alsaRawPorts( SND_RAWMIDI_STREAM_INPUT, ports );
+  return ports.size();
+}
+
+std::string MidiInAlsaRaw :: getPortName( unsigned int portNumber )
+{
+  std::vector<AlsaRawPort> ports;
+  alsaRawPorts( SND_RAWMIDI_STREAM_INPUT, ports );
+  if ( portNumber < ports.size() ) return ports[portNumber].name;
 
   // If we get here, we didn't find a match.
-  errorString_ = "MidiInAlsa::getPortName: error looking for port name!";
+  errorString_ = "MidiInAlsaRaw::getPortName: error looking for port name!";
   error( RtMidiError::WARNING, errorString_ );
-  return stringName;
+  return std::string();
 }
 
-void MidiInAlsa :: openPort( unsigned int portNumber, const std::string portName )
+void MidiInAlsaRaw :: openPort( unsigned int portNumber, const std::string /*portName*/ )
 {
   if ( connected_ ) {
-    errorString_ = "MidiInAlsa::openPort: a valid connection already exists!";
+    errorString_ = "MidiInAlsaRaw::openPort: a valid connection already exists!";
     error( RtMidiError::WARNING, errorString_ );
     return;
   }
 
-  unsigned int nSrc = this->getPortCount();
-  if ( nSrc < 1 ) {
-    errorString_ = "MidiInAlsa::openPort: no MIDI input sources found!";
+  std::vector<AlsaRawPort> ports;
+  alsaRawPorts( SND_RAWMIDI_STREAM_INPUT, ports );
+  if ( ports.size() < 1 ) {
+    errorString_ = "MidiInAlsaRaw::openPort: no MIDI input sources found!";
     error( RtMidiError::NO_DEVICES_FOUND, errorString_ );
     return;
   }
 
-  snd_seq_port_info_t *src_pinfo;
-  snd_seq_port_info_alloca( &src_pinfo );
-  AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
-  if ( portInfo( data->seq, src_pinfo, SND_SEQ_PORT_CAP_READ|SND_SEQ_PORT_CAP_SUBS_READ, (int) portNumber ) == 0 ) {
+  if ( portNumber >= ports.size() ) {
     std::ostringstream ost;
-    ost << "MidiInAlsa::openPort: the 'portNumber' argument (" << portNumber << ") is invalid.";
+    ost << "MidiInAlsaRaw::openPort: the 'portNumber' argument (" << portNumber << ") is invalid.";
     errorString_ = ost.str();
     error( RtMidiError::INVALID_PARAMETER, errorString_ );
     return;
   }
 
-  snd_seq_addr_t sender, receiver;
-  sender.client = snd_seq_port_info_get_client( src_pinfo );
-  sender.port = snd_seq_port_info_get_port( src_pinfo );
-  receiver.client = snd_seq_client_id( data->seq );
-
-  snd_seq_port_info_t *pinfo;
-  snd_seq_port_info_alloca( &pinfo );
-  if ( data->vport < 0 ) {
-    snd_seq_port_info_set_client( pinfo, 0 );
-    snd_seq_port_info_set_port( pinfo, 0 );
-    snd_seq_port_info_set_capability( pinfo,
-                                      SND_SEQ_PORT_CAP_WRITE |
-                                      SND_SEQ_PORT_CAP_SUBS_WRITE );
-    snd_seq_port_info_set_type( pinfo,
-                                SND_SEQ_PORT_TYPE_MIDI_GENERIC |
-                                SND_SEQ_PORT_TYPE_APPLICATION );
-    snd_seq_port_info_set_midi_channels(pinfo, 16);
-#ifndef AVOID_TIMESTAMPING
-    snd_seq_port_info_set_timestamping(pinfo, 1);
-    snd_seq_port_info_set_timestamp_real(pinfo, 1);    
-    snd_seq_port_info_set_timestamp_queue(pinfo, data->queue_id);
-#endif
-    snd_seq_port_info_set_name(pinfo,  portName.c_str() );
-    data->vport = snd_seq_create_port(data->seq, pinfo);
-  
-    if ( data->vport < 0 ) {
-      errorString_ = "MidiInAlsa::openPort: ALSA error creating input port.";
-      error( RtMidiError::DRIVER_ERROR, errorString_ );
-      return;
-    }
-    data->vport = snd_seq_port_info_get_port(pinfo);
+  AlsaRawMidiData *data = static_cast<AlsaRawMidiData *> (apiData_);
+  int result = snd_rawmidi_open( &data->handle, NULL, ports[portNumber].device.c_str(), SND_RAWMIDI_NONBLOCK );
+  if ( result < 0 ) {
+    data->handle = 0;
+    errorString_ = "MidiInAlsaRaw::openPort: error opening ALSA raw MIDI device " + ports[portNumber].device + ".";
+    error( RtMidiError::DRIVER_ERROR, errorString_ );
+    return;
   }
 
-  receiver.port = data->vport;
-
-  if ( !data->subscription ) {
-    // Make subscription
-    if (snd_seq_port_subscribe_malloc( &data->subscription ) < 0) {
-      errorString_ = "MidiInAlsa::openPort: ALSA error allocation port subscription.";
-      error( RtMidiError::DRIVER_ERROR, errorString_ );
-      return;
-    }
-    snd_seq_port_subscribe_set_sender(data->subscription, &sender);
-    snd_seq_port_subscribe_set_dest(data->subscription, &receiver);
-    if ( snd_seq_subscribe_port(data->seq, data->subscription) ) {
-      snd_seq_port_subscribe_free( data->subscription );
-      data->subscription = 0;
-      errorString_ = "MidiInAlsa::openPort: ALSA error making port connection.";
-      error( RtMidiError::DRIVER_ERROR, errorString_ );
-      return;
-    }
+  // Wait for old thread to stop, if still running
+  if ( !pthread_equal(data->thread, data->dummy_thread_id) )
+    pthread_join( data->thread, NULL );
+
+  // Reset the parser.
+  data->runningStatus = 0;
+  data->dataBytes = 0;
+  data->inSysex = false;
+  data->batched = 0;
+  inputData_.message.clear();
+  inputData_.message.reserve( 1024 );
+
+  // Start our MIDI input thread.
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+  pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+
+  inputData_.doInput = true;
+  int err = pthread_create(&data->thread, &attr, alsaRawMidiHandler, &inputData_);
+  pthread_attr_destroy(&attr);
+  if ( err ) {
+    snd_rawmidi_close( data->handle );
+    data->handle = 0;
+    inputData_.doInput = false;
+    errorString_ = "MidiInAlsaRaw::openPort: error starting MIDI input thread!";
+    error( RtMidiError::THREAD_ERROR, errorString_ );
+    return;
   }
 
-  if ( inputData_.doInput == false ) {
-    // Start the input queue
-#ifndef AVOID_TIMESTAMPING
-    snd_seq_start_queue( data->seq, data->queue_id, NULL );
-    snd_seq_drain_output( data->seq );
-#endif
-    // Start our MIDI input thread.
-    pthread_attr_t attr;
-    pthread_attr_init(&attr);
-    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
-    pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
-
-    inputData_.doInput = true;
-    int err = pthread_create(&data->thread, &attr, alsaMidiHandler, &inputData_);
-    pthread_attr_destroy(&attr);
-    if ( err ) {
-      snd_seq_unsubscribe_port( data->seq, data->subscription );
-      snd_seq_port_subscribe_free( data->subscription );
-      data->subscription = 0;
-      inputData_.doInput = false;
-      errorString_ = "MidiInAlsa::openPort: error starting MIDI input thread!";
-      error( RtMidiError::THREAD_ERROR, errorString_ );
-      return;
-    }
+  std::string problem;
+  if ( !applyThreadOptions( data->thread, threadOptions_, effectiveThreadOptions_, problem ) ) {
+    errorString_ = "MidiInAlsaRaw::openPort: " + problem;
+    error( RtMidiError::WARNING, errorString_ );
   }
 
   connected_ = true;
 }
 
-void MidiInAlsa :: openVirtualPort( std::string portName )
+void MidiInAlsaRaw :: openVirtualPort( const std::string /*portName*/ )
 {
-  AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
-  if ( data->vport < 0 ) {
-    snd_seq_port_info_t *pinfo;
-    snd_seq_port_info_alloca( &pinfo );
-    snd_seq_port_info_set_capability( pinfo,
-				      SND_SEQ_PORT_CAP_WRITE |
-				      SND_SEQ_PORT_CAP_SUBS_WRITE );
-    snd_seq_port_info_set_type( pinfo,
-				SND_SEQ_PORT_TYPE_MIDI_GENERIC |
-				SND_SEQ_PORT_TYPE_APPLICATION );
-    snd_seq_port_info_set_midi_channels(pinfo, 16);
-#ifndef AVOID_TIMESTAMPING
-    snd_seq_port_info_set_timestamping(pinfo, 1);
-    snd_seq_port_info_set_timestamp_real(pinfo, 1);    
-    snd_seq_port_info_set_timestamp_queue(pinfo, data->queue_id);
-#endif
-    snd_seq_port_info_set_name(pinfo, portName.c_str());
-    data->vport = snd_seq_create_port(data->seq, pinfo);
-
-    if ( data->vport < 0 ) {
-      errorString_ = "MidiInAlsa::openVirtualPort: ALSA error creating virtual port.";
-      error( RtMidiError::DRIVER_ERROR, errorString_ );
-      return;
-    }
-    data->vport = snd_seq_port_info_get_port(pinfo);
-  }
-
-  if ( inputData_.doInput == false ) {
-    // Wait for old thread to stop, if still running
-    if ( !pthread_equal(data->thread, data->dummy_thread_id) )
-      pthread_join( data->thread, NULL );
-
-    // Start the input queue
-#ifndef AVOID_TIMESTAMPING
-    snd_seq_start_queue( data->seq, data->queue_id, NULL );
-    snd_seq_drain_output( data->seq );
-#endif
-    // Start our MIDI input thread.
-    pthread_attr_t attr;
-    pthread_attr_init(&attr);
-    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
-    pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
-
-    inputData_.doInput = true;
-    int err = pthread_create(&data->thread, &attr, alsaMidiHandler, &inputData_);
-    pthread_attr_destroy(&attr);
-    if ( err ) {
-      if ( data->subscription ) {
-        snd_seq_unsubscribe_port( data->seq, data->subscription );
-        snd_seq_port_subscribe_free( data->subscription );
-        data->subscription = 0;
-      }
-      inputData_.doInput = false;
-      errorString_ = "MidiInAlsa::openPort: error starting MIDI input thread!";
-      error( RtMidiError::THREAD_ERROR, errorString_ );
-      return;
-    }
-  }
+  // Raw MIDI devices are hardware (or snd-virmidi) ports only.
+  errorString_ = "MidiInAlsaRaw::openVirtualPort: cannot be implemented in the ALSA raw MIDI API!";
+  error( RtMidiError::WARNING, errorString_ );
 }
 
-void MidiInAlsa :: closePort( void )
+void MidiInAlsaRaw :: closePort( void )
 {
-  AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
-
-  if ( connected_ ) {
-    if ( data->subscription ) {
-      snd_seq_unsubscribe_port( data->seq, data->subscription );
-      snd_seq_port_subscribe_free( data->subscription );
-      data->subscription = 0;
-    }
-    // Stop the input queue
-#ifndef AVOID_TIMESTAMPING
-    snd_seq_stop_queue( data->seq, data->queue_id, NULL );
-    snd_seq_drain_output( data->seq );
-#endif
-    connected_ = false;
-  }
+  AlsaRawMidiData *data = static_cast<AlsaRawMidiData *> (apiData_);
 
-  // Stop thread to avoid triggering the callback, while the port is intended to be closed
+  // Stop thread before closing the device it reads from
   if ( inputData_.doInput ) {
     inputData_.doInput = false;
     int res = write( data->trigger_fds[1], &inputData_.doInput, sizeof(inputData_.doInput) );
     (void) res;
-    if ( !pthread_equal(data->thread, data->dummy_thread_id) )
-      pthread_join( data->thread, NULL );
   }
+  if ( !pthread_equal(data->thread, data->dummy_thread_id) )
+    pthread_join( data->thread, NULL );
+
+  if ( data->handle ) {
+    snd_rawmidi_close( data->handle );
+    data->handle = 0;
+  }
+  connected_ = false;
 }
 
 //*********************************************************************//
-//  API: LINUX ALSA
-//  Class Definitions: MidiOutAlsa
+//  API: LINUX ALSA RAW MIDI
+//  Class Definitions: MidiOutAlsaRaw
 //*********************************************************************//
 
-MidiOutAlsa :: MidiOutAlsa( const std::string clientName ) : MidiOutApi()
+MidiOutAlsaRaw :: MidiOutAlsaRaw( const std::string clientName ) : MidiOutApi()
 {
   initialize( clientName );
 }
 
-MidiOutAlsa :: ~MidiOutAlsa()
+MidiOutAlsaRaw :: ~MidiOutAlsaRaw()
 {
   // Close a connection if it exists.
   closePort();
-
-  // Cleanup.
-  AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
-  if ( data->vport >= 0 ) snd_seq_delete_port( data->seq, data->vport );
-  if ( data->coder ) snd_midi_event_free( data->coder );
-  if ( data->buffer ) free( data->buffer );
-  snd_seq_close( data->seq );
-  delete data;
 }
 
-void MidiOutAlsa :: initialize( const std::string& clientName )
+void MidiOutAlsaRaw :: initialize( const std::string& /*clientName*/ )
 {
-  // Set up the ALSA sequencer client.
-  snd_seq_t *seq;
-  int result1 = snd_seq_open( &seq, "default", SND_SEQ_OPEN_OUTPUT, SND_SEQ_NONBLOCK );
-  if ( result1 < 0 ) {
-    errorString_ = "MidiOutAlsa::initialize: error creating ALSA sequencer client object.";
-    error( RtMidiError::DRIVER_ERROR, errorString_ );
-    return;
-	}
-
-  // Set client name.
-  snd_seq_set_client_name( seq, clientName.c_str() );
-
-  // Save our api-specific connection information.
-  AlsaMidiData *data = (AlsaMidiData *) new AlsaMidiData;
-  data->seq = seq;
-  data->portNum = -1;
-  data->vport = -1;
-  data->bufferSize = 32;
-  data->coder = 0;
-  data->buffer = 0;
-  int result = snd_midi_event_new( data->bufferSize, &data->coder );
-  if ( result < 0 ) {
-    delete data;
-    errorString_ = "MidiOutAlsa::initialize: error initializing MIDI event parser!\n\n";
-    error( RtMidiError::DRIVER_ERROR, errorString_ );
-    return;
-  }
-  data->buffer = (unsigned char *) malloc( data->bufferSize );
-  if ( data->buffer == NULL ) {
-    delete data;
-    errorString_ = "MidiOutAlsa::initialize: error allocating buffer memory!\n\n";
-    error( RtMidiError::MEMORY_ERROR, errorString_ );
-    return;
-  }
-  snd_midi_event_init( data->coder );
-  apiData_ = (void *) data;
+  // The API data is the open device handle.
+  apiData_ = 0;
 }
 
-unsigned int MidiOutAlsa :: getPortCount()
+unsigned int MidiOutAlsaRaw :: getPortCount()
 {
-	snd_seq_port_info_t *pinfo;
-	snd_seq_port_info_alloca( &pinfo );
-
-  AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
-  return portInfo( data->seq, pinfo, SND_SEQ_PORT_CAP_WRITE|SND_SEQ_PORT_CAP_SUBS_WRITE, -1 );
+  std::vector<AlsaRawPort> ports;
+  alsaRawPorts( SND_RAWMIDI_STREAM_OUTPUT, ports );
+  return ports.size();
 }
 
-std::string MidiOutAlsa :: getPortName( unsigned int portNumber )
+std::string MidiOutAlsaRaw :: getPortName( unsigned int portNumber )
 {
-  snd_seq_client_info_t *cinfo;
-  snd_seq_port_info_t *pinfo;
-  snd_seq_client_info_alloca( &cinfo );
-  snd_seq_port_info_alloca( &pinfo );
-
-  std::string stringName;
-  AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
-  if ( portInfo( data->seq, pinfo, SND_SEQ_PORT_CAP_WRITE|SND_SEQ_PORT_CAP_SUBS_WRITE, (int) portNumber ) ) {
-    int cnum = snd_seq_port_info_get_client(pinfo);
-    snd_seq_get_any_client_info( data->seq, cnum, cinfo );
-    std::ostringstream os;
-    os << snd_seq_client_info_get_name(cinfo);
-    os << " ";                                    // These lines added to make sure devices are listed
-    os << snd_seq_port_info_get_client( pinfo );  // with full portnames added to ensure individual device names
-    os << ":";
-    os << snd_seq_port_info_get_port(pinfo);
-    stringName = os.str();
-    return stringName;
-  }
+  std::vector<AlsaRawPort> ports;
+  alsaRawPorts( SND_RAWMIDI_STREAM_OUTPUT, ports );
+  if ( portNumber < ports.size() ) return ports[portNumber].name;
 
   // If we get here, we didn't find a match.
-  errorString_ = "MidiOutAlsa::getPortName: error looking for port name!";
+  errorString_ = "MidiOutAlsaRaw::getPortName: error looking for port name!";
   error( RtMidiError::WARNING, errorString_ );
-  return stringName;
+  return std::string();
 }
 
-void MidiOutAlsa :: openPort( unsigned int portNumber, const std::string portName )
+void MidiOutAlsaRaw :: openPort( unsigned int portNumber, const std::string /*portName*/ )
 {
   if ( connected_ ) {
-    errorString_ = "MidiOutAlsa::openPort: a valid connection already exists!";
+    errorString_ = "MidiOutAlsaRaw::openPort: a valid connection already exists!";
     error( RtMidiError::WARNING, errorString_ );
     return;
   }
 
-  unsigned int nSrc = this->getPortCount();
-  if (nSrc < 1) {
-    errorString_ = "MidiOutAlsa::openPort: no MIDI output sources found!";
+  std::vector<AlsaRawPort> ports;
+  alsaRawPorts( SND_RAWMIDI_STREAM_OUTPUT, ports );
+  if ( ports.size() < 1 ) {
+    errorString_ = "MidiOutAlsaRaw::openPort: no MIDI output destinations found!";
     error( RtMidiError::NO_DEVICES_FOUND, errorString_ );
     return;
   }
 
-	snd_seq_port_info_t *pinfo;
-	snd_seq_port_info_alloca( &pinfo );
-  AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
-  if ( portInfo( data->seq, pinfo, SND_SEQ_PORT_CAP_WRITE|SND_SEQ_PORT_CAP_SUBS_WRITE, (int) portNumber ) == 0 ) {
+  if ( portNumber >= ports.size() ) {
     std::ostringstream ost;
-    ost << "MidiOutAlsa::openPort: the 'portNumber' argument (" << portNumber << ") is invalid.";
+    ost << "MidiOutAlsaRaw::openPort: the 'portNumber' argument (" << portNumber << ") is invalid.";
     errorString_ = ost.str();
     error( RtMidiError::INVALID_PARAMETER, errorString_ );
     return;
   }
 
-  snd_seq_addr_t sender, receiver;
-  receiver.client = snd_seq_port_info_get_client( pinfo );
-  receiver.port = snd_seq_port_info_get_port( pinfo );
-  sender.client = snd_seq_client_id( data->seq );
-
-  if ( data->vport < 0 ) {
-    data->vport = snd_seq_create_simple_port( data->seq, portName.c_str(),
-                                              SND_SEQ_PORT_CAP_READ|SND_SEQ_PORT_CAP_SUBS_READ,
-                                              SND_SEQ_PORT_TYPE_MIDI_GENERIC|SND_SEQ_PORT_TYPE_APPLICATION );
-    if ( data->vport < 0 ) {
-      errorString_ = "MidiOutAlsa::openPort: ALSA error creating output port.";
-      error( RtMidiError::DRIVER_ERROR, errorString_ );
-      return;
-    }
-  }
-
-  sender.port = data->vport;
-
-  // Make subscription
-  if (snd_seq_port_subscribe_malloc( &data->subscription ) < 0) {
-    snd_seq_port_subscribe_free( data->subscription );
-    errorString_ = "MidiOutAlsa::openPort: error allocating port subscription.";
-    error( RtMidiError::DRIVER_ERROR, errorString_ );
-    return;
-  }
-  snd_seq_port_subscribe_set_sender(data->subscription, &sender);
-  snd_seq_port_subscribe_set_dest(data->subscription, &receiver);
-  snd_seq_port_subscribe_set_time_update(data->subscription, 1);
-  snd_seq_port_subscribe_set_time_real(data->subscription, 1);
-  if ( snd_seq_subscribe_port(data->seq, data->subscription) ) {
-    snd_seq_port_subscribe_free( data->subscription );
-    errorString_ = "MidiOutAlsa::openPort: ALSA error making port connection.";
+  snd_rawmidi_t *handle;
+  int result = snd_rawmidi_open( NULL, &handle, ports[portNumber].device.c_str(), 0 );
+  if ( result < 0 ) {
+    errorString_ = "MidiOutAlsaRaw::openPort: error opening ALSA raw MIDI device " + ports[portNumber].device + ".";
     error( RtMidiError::DRIVER_ERROR, errorString_ );
     return;
   }
 
+  apiData_ = (void *) handle;
   connected_ = true;
 }
 
-void MidiOutAlsa :: closePort( void )
-{
-  if ( connected_ ) {
-    AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
-    snd_seq_unsubscribe_port( data->seq, data->subscription );
-    snd_seq_port_subscribe_free( data->subscription );
-    connected_ = false;
-  }
-}
-
-void MidiOutAlsa :: openVirtualPort( std::string portName )
-{
-  AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
-  if ( data->vport < 0 ) {
-    data->vport = snd_seq_create_simple_port( data->seq, portName.c_str(),
-                                              SND_SEQ_PORT_CAP_READ|SND_SEQ_PORT_CAP_SUBS_READ,
-                                              SND_SEQ_PORT_TYPE_MIDI_GENERIC|SND_SEQ_PORT_TYPE_APPLICATION );
-
-    if ( data->vport < 0 ) {
-      errorString_ = "MidiOutAlsa::openVirtualPort: ALSA error creating virtual port.";
-      error( RtMidiError::DRIVER_ERROR, errorString_ );
-    }
-  }
-}
-
-void MidiOutAlsa :: sendMessage( std::vector<unsigned char> *message )
+void MidiOutAlsaRaw :: openVirtualPort( const std::string /*portName*/ )
 {
-  int result;
-  AlsaMidiData *data = static_cast<AlsaMidiData *> (apiData_);
-  unsigned int nBytes = message->size();
-  if ( nBytes > data->bufferSize ) {
-    data->bufferSize = nBytes;
-    result = snd_midi_event_resize_buffer ( data->coder, nBytes);
-    if ( result != 0 ) {
-      errorString_ = "MidiOutAlsa::sendMessage: ALSA error resizing MIDI event buffer.";
-      error( RtMidiError::DRIVER_ERROR, errorString_ );
-      return;
-    }
-    free (data->buffer);
-    data->buffer = (unsigned char *) malloc( data->bufferSize );
-    if ( data->buffer == NULL ) {
-    errorString_ = "MidiOutAlsa::initialize: error allocating buffer memory!\n\n";
-    error( RtMidiError::MEMORY_ERROR, errorString_ );
-    return;
-    }
+  // Raw MIDI devices are hardware (or snd-virmidi) ports only.
+  errorString_ = "MidiOutAlsaRaw::openVirtualPort: cannot be implemented in the ALSA raw MIDI API!";
+  error( RtMidiError::WARNING, errorString_ );
+}
+
+void MidiOutAlsaRaw :: closePort( void )
+{
+  if ( connected_ ) {
+    snd_rawmidi_close( (snd_rawmidi_t *) apiData_ );
+    apiData_ = 0;
+    connected_ = false;
   }
+}
 
-  snd_seq_event_t ev;
-  snd_seq_ev_clear(&ev);
-  snd_seq_ev_set_source(&ev, data->vport);
-  snd_seq_ev_set_subs(&ev);
-  snd_seq_ev_set_direct(&ev);
-  for ( unsigned int i=0; i<nBytes; ++i ) data->buffer[i] = message->at(i);
-  result = snd_midi_event_encode( data->coder, data->buffer, (long)nBytes, &ev );
-  if ( result < (int)nBytes ) {
-    errorString_ = "MidiOutAlsa::sendMessage: event parsing error!";
+void MidiOutAlsaRaw :: sendMessage( std::vector<unsigned char> *message )
+{
+  unsigned int nBytes = static_cast<unsigned int> (message->size());
+  if ( nBytes == 0 ) {
+    errorString_ = "MidiOutAlsaRaw::sendMessage: message argument is empty!";
     error( RtMidiError::WARNING, errorString_ );
     return;
   }
 
-  // Send the event.
-  result = snd_seq_event_output(data->seq, &ev);
-  if ( result < 0 ) {
-    errorString_ = "MidiOutAlsa::sendMessage: error sending MIDI message to port.";
+  if ( !connected_ ) return;
+
+  // The bytes go to the device as they are; the driver takes them
+  // without any event encoding.
+  ssize_t result = snd_rawmidi_write( (snd_rawmidi_t *) apiData_, &message->at(0), nBytes );
+  if ( result < 0 || (unsigned int) result != nBytes ) {
+    errorString_ = "MidiOutAlsaRaw::sendMessage: error sending MIDI message to port.";
     error( RtMidiError::WARNING, errorString_ );
-    return;
   }
-  snd_seq_drain_output(data->seq);
 }
 
 #endif // __LINUX_ALSA__
@@ -1920,6 +3603,7 @@ struct WinMidiData {
   HMIDIIN inHandle;    // Handle to Midi Input Device
   HMIDIOUT outHandle;  // Handle to Midi Output Device
   DWORD lastTime;
+  long long startTime; // RtMidi::getTime() when midiInStart() was called
   MidiInApi::MidiMessage message;
   LPMIDIHDR sysexBuffer[RT_SYSEX_BUFFER_COUNT];
   CRITICAL_SECTION _mutex; // [Patrice] see https://groups.google.com/forum/#!topic/mididev/6OUjHutMpEo
@@ -1938,6 +3622,8 @@ static void CALLBACK midiInputCallback( HMIDIIN /*hmin*/,
 {
   if ( inputStatus != MIM_DATA && inputStatus != MIM_LONGDATA && inputStatus != MIM_LONGERROR ) return;
 
+  // Steady-state input must not allocate.
+  RTMIDI_INPUT_REGION( "WinMM input" );
   //MidiInApi::RtMidiInData *data = static_cast<MidiInApi::RtMidiInData *> (instancePtr);
   MidiInApi::RtMidiInData *data = (MidiInApi::RtMidiInData *)instancePtr;
   WinMidiData *apiData = static_cast<WinMidiData *> (data->apiData);
@@ -1950,6 +3636,11 @@ static void CALLBACK midiInputCallback( HMIDIIN /*hmin*/,
   else apiData->message.timeStamp = (double) ( timestamp - apiData->lastTime ) * 0.001;
   apiData->lastTime = timestamp;
 
+  // The driver time stamp counts milliseconds from midiInStart().
+  long long now = RtMidi::getTime();
+  apiData->message.absoluteTime = apiData->startTime + (long long) timestamp * 1000000LL;
+  if ( apiData->message.absoluteTime > now ) apiData->message.absoluteTime = now;
+
   if ( inputStatus == MIM_DATA ) { // Channel or system message
 
     // Make sure the first byte is a status byte.
@@ -1975,17 +3666,20 @@ static void CALLBACK midiInputCallback( HMIDIIN /*hmin*/,
       // A MIDI active sensing message and we're ignoring it.
       return;
     }
+    else if ( status < 0xF0 && data->filter[status] ) {
+      // A channel message dropped by the input filter.
+      return;
+    }
 
     // Copy bytes to our MIDI message.
     unsigned char *ptr = (unsigned char *) &midiMessage;
-    for ( int i=0; i<nBytes; ++i ) apiData->message.bytes.push_back( *ptr++ );
+    apiData->message.append( ptr, nBytes );
   }
   else { // Sysex message ( MIM_LONGDATA or MIM_LONGERROR )
     MIDIHDR *sysex = ( MIDIHDR *) midiMessage; 
     if ( !( data->ignoreFlags & 0x01 ) && inputStatus != MIM_LONGERROR ) {  
       // Sysex message and we're not ignoring it
-      for ( int i=0; i<(int)sysex->dwBytesRecorded; ++i )
-        apiData->message.bytes.push_back( sysex->lpData[i] );
+      apiData->message.append( (unsigned char *) sysex->lpData, sysex->dwBytesRecorded );
     }
 
     // The WinMM API requires that the sysex buffer be requeued after
@@ -2009,24 +3703,10 @@ static void CALLBACK midiInputCallback( HMIDIIN /*hmin*/,
     else return;
   }
 
-  if ( data->usingCallback ) {
-    RtMidiIn::RtMidiCallback callback = (RtMidiIn::RtMidiCallback) data->userCallback;
-    callback( apiData->message.timeStamp, &apiData->message.bytes, data->userData );
-  }
-  else {
-    // As long as we haven't reached our queue size limit, push the message.
-    if ( data->queue.size < data->queue.ringSize ) {
-      data->queue.ring[data->queue.back++] = apiData->message;
-      if ( data->queue.back == data->queue.ringSize )
-        data->queue.back = 0;
-      data->queue.size++;
-    }
-    else
-      std::cerr << "\nRtMidiIn: message queue limit reached!!\n\n";
-  }
+  data->deliver( apiData->message );
 
-  // Clear the vector for the next input message.
-  apiData->message.bytes.clear();
+  // Clear the message for the next input message.
+  apiData->message.clear();
 }
 
 MidiInWinMM :: MidiInWinMM( const std::string clientName, unsigned int queueSizeLimit ) : MidiInApi( queueSizeLimit )
@@ -2060,7 +3740,7 @@ void MidiInWinMM :: initialize( const std::string& /*clientName*/ )
   WinMidiData *data = (WinMidiData *) new WinMidiData;
   apiData_ = (void *) data;
   inputData_.apiData = (void *) data;
-  data->message.bytes.clear();  // needs to be empty for first input message
+  data->message.clear();  // needs to be empty for first input message
 
   if ( !InitializeCriticalSectionAndSpinCount(&(data->_mutex), 0x00000400) ) {
     errorString_ = "MidiInWinMM::initialize: InitializeCriticalSectionAndSpinCount failed.";
@@ -2129,6 +3809,7 @@ void MidiInWinMM :: openPort( unsigned int portNumber, const std::string /*portN
     }
   }
 
+  data->startTime = RtMidi::getTime();
   result = midiInStart( data->inHandle );
   if ( result != MMSYSERR_NOERROR ) {
     midiInClose( data->inHandle );
@@ -2437,13 +4118,27 @@ void MidiOutWinMM :: sendMessage( std::vector<unsigned char> *message )
 #include <jack/midiport.h>
 #include <jack/ringbuffer.h>
 
-#define JACK_RINGBUFFER_SIZE 16384 // Default size for ringbuffer
+// Output messages wait in one ring of records, each a JackOutputHeader
+// followed by the message bytes.  The process callback writes at most
+// JACK_OUTPUT_BUDGET events per cycle, and the ring holds
+// JACK_OUTPUT_CYCLES cycles of that budget in three-byte messages.
+#ifndef JACK_OUTPUT_BUDGET
+#define JACK_OUTPUT_BUDGET 256
+#endif
+#define JACK_OUTPUT_CYCLES 8
+
+struct JackOutputHeader {
+  jack_time_t time;   // due time on the JACK clock, 0 for immediate
+  unsigned int size;  // number of message bytes that follow
+};
 
 struct JackMidiData {
   jack_client_t *client;
   jack_port_t *port;
-  jack_ringbuffer_t *buffSize;
-  jack_ringbuffer_t *buffMessage;
+  jack_ringbuffer_t *buffOutput;
+  std::mutex outputMutex;      // serializes senders, the reader is lock-free
+  unsigned long outputDropped; // messages that did not fit in the ring
+  bool outputOverrun;          // the last message did not fit
   jack_time_t lastTime;
   MidiInApi :: RtMidiInData *rtMidiIn;
   };
@@ -2455,6 +4150,8 @@ struct JackMidiData {
 
 static int jackProcessIn( jack_nframes_t nframes, void *arg )
 {
+  // Steady-state input must not allocate.
+  RTMIDI_INPUT_REGION( "JACK input" );
   JackMidiData *jData = (JackMidiData *) arg;
   MidiInApi :: RtMidiInData *rtData = jData->rtMidiIn;
   jack_midi_event_t event;
@@ -2466,14 +4163,29 @@ static int jackProcessIn( jack_nframes_t nframes, void *arg )
 
   // We have midi events in buffer
   int evCount = jack_midi_get_event_count( buff );
-  for (int j = 0; j < evCount; j++) {
-    MidiInApi::MidiMessage message;
-    message.bytes.clear();
+  MidiInApi::MidiMessage &message = rtData->message;
+
+  // JACK time and the RtMidi::getTime() clock are both monotonic but
+  // may have different origins; measure the offset once per cycle.
+  long long now = 0, offset = 0;
+  jack_nframes_t cycleStart = 0;
+  if ( evCount > 0 ) {
+    now = RtMidi::getTime();
+    offset = now - (long long) jack_get_time() * 1000;
+    cycleStart = jack_last_frame_time( jData->client );
+  }
 
+  for (int j = 0; j < evCount; j++) {
     jack_midi_event_get( &event, buff, j );
 
-    for ( unsigned int i = 0; i < event.size; i++ )
-      message.bytes.push_back( event.buffer[i] );
+    // Drop filtered messages before copying them.
+    if ( event.size == 0 || rtData->filter[event.buffer[0]] ) continue;
+
+    message.assign( event.buffer, event.size );
+
+    // Absolute time of the frame the event belongs to.
+    message.absoluteTime = (long long) jack_frames_to_time( jData->client, cycleStart + event.time ) * 1000 + offset;
+    if ( message.absoluteTime > now ) message.absoluteTime = now;
 
     // Compute the delta time.
     time = jack_get_time();
@@ -2484,23 +4196,8 @@ static int jackProcessIn( jack_nframes_t nframes, void *arg )
 
     jData->lastTime = time;
 
-    if ( !rtData->continueSysex ) {
-      if ( rtData->usingCallback ) {
-        RtMidiIn::RtMidiCallback callback = (RtMidiIn::RtMidiCallback) rtData->userCallback;
-        callback( message.timeStamp, &message.bytes, rtData->userData );
-      }
-      else {
-        // As long as we haven't reached our queue size limit, push the message.
-        if ( rtData->queue.size < rtData->queue.ringSize ) {
-          rtData->queue.ring[rtData->queue.back++] = message;
-          if ( rtData->queue.back == rtData->queue.ringSize )
-            rtData->queue.back = 0;
-          rtData->queue.size++;
-        }
-        else
-          std::cerr << "\nMidiInJack: message queue limit reached!!\n\n";
-      }
-    }
+    if ( !rtData->continueSysex )
+      rtData->deliver( message );
   }
 
   return 0;
@@ -2652,12 +4349,31 @@ void MidiInJack :: closePort()
 //  Class Definitions: MidiOutJack
 //*********************************************************************//
 
+// Copy bytes into the free space of a ring, which may wrap around,
+// starting \e offset bytes past the write pointer.
+static void jackCopyToRing( const jack_ringbuffer_data_t *vec, size_t offset,
+                            const char *bytes, size_t count )
+{
+  for ( int i=0; i<2 && count > 0; i++ ) {
+    if ( offset >= vec[i].len ) {
+      offset -= vec[i].len;
+      continue;
+    }
+    size_t n = std::min( count, vec[i].len - offset );
+    memcpy( vec[i].buf + offset, bytes, n );
+    bytes += n;
+    count -= n;
+    offset = 0;
+  }
+}
+
 // Jack process callback
 static int jackProcessOut( jack_nframes_t nframes, void *arg )
 {
   JackMidiData *data = (JackMidiData *) arg;
   jack_midi_data_t *midiData;
-  int space;
+  JackOutputHeader header;
+  jack_nframes_t offset = 0;
 
   // Is port created?
   if ( data->port == NULL ) return 0;
@@ -2665,11 +4381,28 @@ static int jackProcessOut( jack_nframes_t nframes, void *arg )
   void *buff = jack_port_get_buffer( data->port, nframes );
   jack_midi_clear_buffer( buff );
 
-  while ( jack_ringbuffer_read_space( data->buffSize ) > 0 ) {
-    jack_ringbuffer_read( data->buffSize, (char *) &space, (size_t) sizeof(space) );
-    midiData = jack_midi_event_reserve( buff, 0, space );
+  // Each record carries its due time on the JACK clock (zero for
+  // immediate output).  Messages due in this cycle are placed at their
+  // frame; the rest wait for a later cycle.  Offsets must not decrease
+  // within a buffer, so late messages follow earlier ones.  Records are
+  // committed whole, so a header is always followed by its bytes.
+  jack_nframes_t cycleStart = jack_last_frame_time( data->client );
+  for ( unsigned int events=0; events<JACK_OUTPUT_BUDGET; events++ ) {
+    if ( jack_ringbuffer_read_space( data->buffOutput ) < sizeof(header) ) break;
+    std::atomic_thread_fence( std::memory_order_acquire );
+    jack_ringbuffer_peek( data->buffOutput, (char *) &header, sizeof(header) );
+    if ( header.time != 0 ) {
+      int frame = (int) ( jack_time_to_frames( data->client, header.time ) - cycleStart );
+      if ( frame >= (int) nframes ) break;
+      if ( frame > (int) offset ) offset = frame;
+    }
 
-    jack_ringbuffer_read( data->buffMessage, (char *) midiData, (size_t) space );
+    jack_ringbuffer_read_advance( data->buffOutput, sizeof(header) );
+    midiData = jack_midi_event_reserve( buff, offset, header.size );
+    if ( midiData )
+      jack_ringbuffer_read( data->buffOutput, (char *) midiData, header.size );
+    else
+      jack_ringbuffer_read_advance( data->buffOutput, header.size );
   }
 
   return 0;
@@ -2687,6 +4420,9 @@ void MidiOutJack :: initialize( const std::string& clientName )
 
   data->port = NULL;
   data->client = NULL;
+  data->buffOutput = NULL;
+  data->outputDropped = 0;
+  data->outputOverrun = false;
   this->clientName = clientName;
 
   connect();
@@ -2698,9 +4434,12 @@ void MidiOutJack :: connect()
   if ( data->client )
     return;
   
-  // Initialize output ringbuffers  
-  data->buffSize = jack_ringbuffer_create( JACK_RINGBUFFER_SIZE );
-  data->buffMessage = jack_ringbuffer_create( JACK_RINGBUFFER_SIZE );
+  // Initialize the output ring, locked so the process callback never
+  // touches a page that is not resident.
+  if ( data->buffOutput == NULL ) {
+    data->buffOutput = jack_ringbuffer_create( JACK_OUTPUT_BUDGET * JACK_OUTPUT_CYCLES * ( sizeof(JackOutputHeader) + 3 ) );
+    jack_ringbuffer_mlock( data->buffOutput );
+  }
 
   // Initialize JACK client
   if (( data->client = jack_client_open( clientName.c_str(), JackNoStartServer, NULL )) == 0) {
@@ -2719,8 +4458,7 @@ MidiOutJack :: ~MidiOutJack()
   closePort();
   
   // Cleanup
-  jack_ringbuffer_free( data->buffSize );
-  jack_ringbuffer_free( data->buffMessage );
+  if ( data->buffOutput ) jack_ringbuffer_free( data->buffOutput );
   if ( data->client ) {
     jack_client_close( data->client );
   }
@@ -2827,13 +4565,484 @@ void MidiOutJack :: closePort()
 
 void MidiOutJack :: sendMessage( std::vector<unsigned char> *message )
 {
-  int nBytes = message->size();
+  sendMessageAt( 0, message );
+}
+
+void MidiOutJack :: sendMessageAt( long long timeStamp, std::vector<unsigned char> *message )
+{
   JackMidiData *data = static_cast<JackMidiData *> (apiData_);
 
-  // Write full message to buffer
-  jack_ringbuffer_write( data->buffMessage, ( const char * ) &( *message )[0],
-                         message->size() );
-  jack_ringbuffer_write( data->buffSize, ( char * ) &nBytes, sizeof( nBytes ) );
+  // Convert the deadline to the JACK clock, which the process callback
+  // maps to a frame offset.  Zero means "as soon as possible".
+  jack_time_t time = 0;
+  long long delay = timeStamp - RtMidi::getTime();
+  if ( delay > 0 )
+    time = jack_get_time() + (jack_time_t) ( delay / 1000 );
+
+  JackOutputHeader header;
+  header.time = time;
+  header.size = message->size();
+  size_t recordSize = sizeof(header) + header.size;
+
+  std::unique_lock<std::mutex> lock( data->outputMutex );
+  if ( jack_ringbuffer_write_space( data->buffOutput ) < recordSize ) {
+    // Drop the whole message rather than a part of it.  Warn once per
+    // overrun, with the total so far.
+    data->outputDropped++;
+    if ( data->outputOverrun ) return;
+    data->outputOverrun = true;
+    std::ostringstream ost;
+    ost << "MidiOutJack::sendMessage: output ring full, message dropped ("
+        << data->outputDropped << " dropped so far).";
+    lock.unlock();
+    errorString_ = ost.str();
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+  data->outputOverrun = false;
+
+  // Copy the record into the free space, then commit it in one step so
+  // the process callback never sees part of it.
+  jack_ringbuffer_data_t vec[2];
+  jack_ringbuffer_get_write_vector( data->buffOutput, vec );
+  jackCopyToRing( vec, 0, (const char *) &header, sizeof(header) );
+  jackCopyToRing( vec, sizeof(header), (const char *) message->data(), header.size );
+  std::atomic_thread_fence( std::memory_order_release );
+  jack_ringbuffer_write_advance( data->buffOutput, recordSize );
 }
 
+
 #endif  // __UNIX_JACK__
+
+
+//*********************************************************************//
+//  API: LOOPBACK
+//*********************************************************************//
+
+// The loopback API connects RtMidiOut and RtMidiIn instances of this
+// process through named in-memory buses, so that MIDI code can run
+// without hardware or a sequencer.  A message is handed to every input
+// attached to its bus when it is due: on the sending thread if it is
+// due now, otherwise from the bus scheduler thread, which is started
+// the first time a bus has something to deliver later.
+
+#include <memory>
+#include <queue>
+#include <thread>
+
+// An input attached to a bus.  Senders and the scheduler hold their
+// own references, so closing the port only has to detach it; the
+// mutex serializes the threads that produce into the input queue.
+struct LoopbackInput {
+  std::recursive_mutex mutex;
+  MidiInApi::RtMidiInData *data; // 0 once the port has been closed
+  long long lastTime;
+};
+
+typedef std::vector< std::shared_ptr<LoopbackInput> > LoopbackInputList;
+
+// A message waiting in a bus scheduler.
+struct LoopbackPending {
+  long long due;
+  unsigned long long sequence; // keeps messages due at the same time in order
+  MidiInApi::MidiMessage message;
+
+  bool operator>( const LoopbackPending &other ) const
+  {
+    return due > other.due || ( due == other.due && sequence > other.sequence );
+  }
+};
+
+struct LoopbackBus {
+  std::string name;
+  std::mutex mutex;
+  std::condition_variable wakeup;
+  // Replaced, never modified, when an input attaches or detaches, so a
+  // sender can deliver from its own copy without holding the lock.
+  std::shared_ptr<const LoopbackInputList> inputs;
+  long long latency;
+  std::priority_queue< LoopbackPending, std::vector<LoopbackPending>, std::greater<LoopbackPending> > pending;
+  unsigned long long sequence;
+  bool schedulerRunning;
+  bool scheduling; // the scheduler is delivering a message it took from pending
+
+  LoopbackBus( const std::string &busName )
+    : name(busName), inputs(std::make_shared<LoopbackInputList>()), latency(0),
+      sequence(0), schedulerRunning(false), scheduling(false) {}
+};
+
+// The process-wide list of buses, in order of creation.  Buses are
+// never destroyed, so scheduler threads can run detached.
+static std::mutex loopbackRegistryMutex;
+static std::vector<LoopbackBus *> loopbackRegistry;
+
+// Return the bus with the given name, creating it if needed.
+static LoopbackBus *loopbackBus( const std::string &name )
+{
+  std::lock_guard<std::mutex> lock( loopbackRegistryMutex );
+  for ( unsigned int i=0; i<loopbackRegistry.size(); i++ )
+    if ( loopbackRegistry[i]->name == name ) return loopbackRegistry[i];
+  loopbackRegistry.push_back( new LoopbackBus( name ) );
+  return loopbackRegistry.back();
+}
+
+// Return the bus with the given port number, or 0.
+static LoopbackBus *loopbackBusAt( unsigned int portNumber )
+{
+  std::lock_guard<std::mutex> lock( loopbackRegistryMutex );
+  if ( portNumber < loopbackRegistry.size() ) return loopbackRegistry[portNumber];
+  return 0;
+}
+
+static unsigned int loopbackBusCount( void )
+{
+  std::lock_guard<std::mutex> lock( loopbackRegistryMutex );
+  return loopbackRegistry.size();
+}
+
+// Hand a message to every input in the list, stamped with the time it
+// arrives.  Called without the bus lock held.
+static void loopbackDeliver( const LoopbackInputList &inputs, MidiInApi::MidiMessage &message )
+{
+  // Steady-state input must not allocate.
+  RTMIDI_INPUT_REGION( "Loopback input" );
+  unsigned char status = message[0];
+  long long now = RtMidi::getTime();
+  message.absoluteTime = now;
+
+  for ( unsigned int i=0; i<inputs.size(); i++ ) {
+    LoopbackInput &input = *inputs[i];
+    std::lock_guard<std::recursive_mutex> lock( input.mutex );
+    MidiInApi::RtMidiInData *data = input.data;
+    if ( data == 0 ) continue;
+
+    // Apply the same filters as the hardware APIs.
+    if ( data->filter[status] ) continue;
+
+    if ( data->firstMessage == true ) {
+      message.timeStamp = 0.0;
+      data->firstMessage = false;
+    }
+    else message.timeStamp = ( now - input.lastTime ) * 0.000000001;
+    input.lastTime = now;
+
+    data->deliver( message );
+  }
+}
+
+static void loopbackScheduler( LoopbackBus *bus )
+{
+  MidiInApi::MidiMessage message;
+  std::unique_lock<std::mutex> lock( bus->mutex );
+  while ( true ) {
+    if ( bus->pending.empty() ) {
+      bus->wakeup.wait( lock );
+      continue;
+    }
+
+    long long delay = bus->pending.top().due - RtMidi::getTime();
+    if ( delay > 0 ) {
+      bus->wakeup.wait_for( lock, std::chrono::nanoseconds( delay ) );
+      continue;
+    }
+
+    message = bus->pending.top().message;
+    bus->pending.pop();
+    std::shared_ptr<const LoopbackInputList> inputs = bus->inputs;
+    bus->scheduling = true;
+    lock.unlock();
+    loopbackDeliver( *inputs, message );
+    lock.lock();
+    bus->scheduling = false;
+  }
+}
+
+void RtMidiLoopback :: setLatency( const std::string &busName, long long latency )
+{
+  LoopbackBus *bus = loopbackBus( busName );
+  std::lock_guard<std::mutex> lock( bus->mutex );
+  bus->latency = latency > 0 ? latency : 0;
+}
+
+long long RtMidiLoopback :: getLatency( const std::string &busName )
+{
+  std::lock_guard<std::mutex> lock( loopbackRegistryMutex );
+  for ( unsigned int i=0; i<loopbackRegistry.size(); i++ ) {
+    if ( loopbackRegistry[i]->name == busName ) {
+      std::lock_guard<std::mutex> busLock( loopbackRegistry[i]->mutex );
+      return loopbackRegistry[i]->latency;
+    }
+  }
+  return 0;
+}
+
+//*********************************************************************//
+//  API: LOOPBACK
+//  Class Definitions: MidiInLoopback
+//*********************************************************************//
+
+// The api data of a loopback input port.
+struct LoopbackInData {
+  LoopbackBus *bus; // 0 if not attached
+  std::shared_ptr<LoopbackInput> input;
+};
+
+MidiInLoopback :: MidiInLoopback( const std::string clientName, unsigned int queueSizeLimit ) : MidiInApi( queueSizeLimit )
+{
+  initialize( clientName );
+}
+
+MidiInLoopback :: ~MidiInLoopback()
+{
+  // Close a connection if it exists.
+  closePort();
+
+  delete static_cast<LoopbackInData *> (apiData_);
+}
+
+void MidiInLoopback :: initialize( const std::string& /*clientName*/ )
+{
+  LoopbackInData *data = new LoopbackInData;
+  data->bus = 0;
+  apiData_ = (void *) data;
+  inputData_.apiData = (void *) data;
+}
+
+unsigned int MidiInLoopback :: getPortCount()
+{
+  return loopbackBusCount();
+}
+
+std::string MidiInLoopback :: getPortName( unsigned int portNumber )
+{
+  LoopbackBus *bus = loopbackBusAt( portNumber );
+  if ( bus ) return bus->name;
+
+  // If we get here, we didn't find a match.
+  errorString_ = "MidiInLoopback::getPortName: error looking for port name!";
+  error( RtMidiError::WARNING, errorString_ );
+  return std::string();
+}
+
+void MidiInLoopback :: attach( void *ptr )
+{
+  LoopbackBus *bus = static_cast<LoopbackBus *> (ptr);
+  LoopbackInData *data = static_cast<LoopbackInData *> (apiData_);
+
+  data->input = std::make_shared<LoopbackInput>();
+  data->input->data = &inputData_;
+  data->input->lastTime = 0;
+  data->bus = bus;
+
+  std::lock_guard<std::mutex> lock( bus->mutex );
+  std::shared_ptr<LoopbackInputList> inputs = std::make_shared<LoopbackInputList>( *bus->inputs );
+  inputs->push_back( data->input );
+  bus->inputs = inputs;
+}
+
+void MidiInLoopback :: openPort( unsigned int portNumber, const std::string /*portName*/ )
+{
+  if ( connected_ ) {
+    errorString_ = "MidiInLoopback::openPort: a valid connection already exists!";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+
+  if ( loopbackBusCount() < 1 ) {
+    errorString_ = "MidiInLoopback::openPort: no MIDI input sources found!";
+    error( RtMidiError::NO_DEVICES_FOUND, errorString_ );
+    return;
+  }
+
+  LoopbackBus *bus = loopbackBusAt( portNumber );
+  if ( bus == 0 ) {
+    std::ostringstream ost;
+    ost << "MidiInLoopback::openPort: the 'portNumber' argument (" << portNumber << ") is invalid.";
+    errorString_ = ost.str();
+    error( RtMidiError::INVALID_PARAMETER, errorString_ );
+    return;
+  }
+
+  attach( bus );
+  connected_ = true;
+}
+
+void MidiInLoopback :: openVirtualPort( const std::string portName )
+{
+  if ( connected_ ) {
+    errorString_ = "MidiInLoopback::openVirtualPort: a valid connection already exists!";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+
+  attach( loopbackBus( portName ) );
+  connected_ = true;
+}
+
+void MidiInLoopback :: closePort( void )
+{
+  LoopbackInData *data = static_cast<LoopbackInData *> (apiData_);
+  if ( data->bus == 0 ) return;
+
+  {
+    std::lock_guard<std::mutex> lock( data->bus->mutex );
+    std::shared_ptr<LoopbackInputList> inputs = std::make_shared<LoopbackInputList>( *data->bus->inputs );
+    inputs->erase( std::remove( inputs->begin(), inputs->end(), data->input ), inputs->end() );
+    data->bus->inputs = inputs;
+  }
+
+  // Wait for a delivery in progress, then make sure senders holding an
+  // older list no longer reach this port.
+  {
+    std::lock_guard<std::recursive_mutex> lock( data->input->mutex );
+    data->input->data = 0;
+  }
+
+  data->input.reset();
+  data->bus = 0;
+  connected_ = false;
+}
+
+//*********************************************************************//
+//  API: LOOPBACK
+//  Class Definitions: MidiOutLoopback
+//*********************************************************************//
+
+MidiOutLoopback :: MidiOutLoopback( const std::string clientName ) : MidiOutApi()
+{
+  initialize( clientName );
+}
+
+MidiOutLoopback :: ~MidiOutLoopback()
+{
+  // Close a connection if it exists.
+  closePort();
+}
+
+void MidiOutLoopback :: initialize( const std::string& /*clientName*/ )
+{
+  // The api data is the bus the port is attached to.
+  apiData_ = 0;
+}
+
+unsigned int MidiOutLoopback :: getPortCount()
+{
+  return loopbackBusCount();
+}
+
+std::string MidiOutLoopback :: getPortName( unsigned int portNumber )
+{
+  LoopbackBus *bus = loopbackBusAt( portNumber );
+  if ( bus ) return bus->name;
+
+  // If we get here, we didn't find a match.
+  errorString_ = "MidiOutLoopback::getPortName: error looking for port name!";
+  error( RtMidiError::WARNING, errorString_ );
+  return std::string();
+}
+
+void MidiOutLoopback :: openPort( unsigned int portNumber, const std::string /*portName*/ )
+{
+  if ( connected_ ) {
+    errorString_ = "MidiOutLoopback::openPort: a valid connection already exists!";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+
+  if ( loopbackBusCount() < 1 ) {
+    errorString_ = "MidiOutLoopback::openPort: no MIDI output destinations found!";
+    error( RtMidiError::NO_DEVICES_FOUND, errorString_ );
+    return;
+  }
+
+  LoopbackBus *bus = loopbackBusAt( portNumber );
+  if ( bus == 0 ) {
+    std::ostringstream ost;
+    ost << "MidiOutLoopback::openPort: the 'portNumber' argument (" << portNumber << ") is invalid.";
+    errorString_ = ost.str();
+    error( RtMidiError::INVALID_PARAMETER, errorString_ );
+    return;
+  }
+
+  apiData_ = (void *) bus;
+  connected_ = true;
+}
+
+void MidiOutLoopback :: openVirtualPort( const std::string portName )
+{
+  if ( connected_ ) {
+    errorString_ = "MidiOutLoopback::openVirtualPort: a valid connection already exists!";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+
+  apiData_ = (void *) loopbackBus( portName );
+  connected_ = true;
+}
+
+void MidiOutLoopback :: closePort( void )
+{
+  apiData_ = 0;
+  connected_ = false;
+}
+
+void MidiOutLoopback :: sendMessage( std::vector<unsigned char> *message )
+{
+  sendMessageAt( 0, message );
+}
+
+void MidiOutLoopback :: sendMessageAt( long long timeStamp, std::vector<unsigned char> *message )
+{
+  if ( message->size() == 0 ) {
+    errorString_ = "MidiOutLoopback::sendMessage: message argument is empty!";
+    error( RtMidiError::WARNING, errorString_ );
+    return;
+  }
+
+  LoopbackBus *bus = static_cast<LoopbackBus *> (apiData_);
+  if ( bus == 0 ) return;
+
+  long long now = RtMidi::getTime();
+  std::unique_lock<std::mutex> lock( bus->mutex );
+  long long due = std::max( timeStamp, now ) + bus->latency;
+
+  if ( due <= now && bus->pending.empty() && !bus->scheduling ) {
+    // Due now and nothing scheduled ahead of it: deliver on this thread.
+    // Otherwise it waits its turn behind the earlier messages.
+    std::shared_ptr<const LoopbackInputList> inputs = bus->inputs;
+    lock.unlock();
+    MidiInApi::MidiMessage queued;
+    queued.assign( &message->at(0), message->size() );
+    loopbackDeliver( *inputs, queued );
+    return;
+  }
+
+  LoopbackPending pending;
+  pending.due = due;
+  pending.sequence = bus->sequence++;
+  pending.message.assign( &message->at(0), message->size() );
+  bus->pending.push( pending );
+
+  // Claim the start of the scheduler under the lock, but create it and
+  // change its priority after releasing the lock, so other senders on
+  // the bus do not wait for that.  It finds the message once it runs.
+  bool startScheduler = !bus->schedulerRunning;
+  bus->schedulerRunning = true;
+  bus->wakeup.notify_one();
+  lock.unlock();
+
+  std::string problem;
+  if ( startScheduler ) {
+    // The scheduler runs with the thread options of the output that starts it.
+    std::thread scheduler( loopbackScheduler, bus );
+#if !defined(_WIN32)
+    applyThreadOptions( scheduler.native_handle(), threadOptions_, effectiveThreadOptions_, problem );
+#endif
+    scheduler.detach();
+  }
+
+  if ( !problem.empty() ) {
+    errorString_ = "MidiOutLoopback::sendMessage: " + problem;
+    error( RtMidiError::WARNING, errorString_ );
+  }
+}
@@ -45,8 +45,12 @@
 
 #define RTMIDI_VERSION "2.1.1"
 
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
 #include <exception>
 #include <iostream>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -111,6 +115,118 @@ class RtMidiError : public std::exception
  */
 typedef void (*RtMidiErrorCallback)( RtMidiError::Type type, const std::string &errorText, void *userData );
 
+//! RtMidi port change callback function prototype.
+/*!
+    \param portName Name of the port, as returned by getPortName() while it exists.
+    \param added True if the port appeared, false if it went away.
+ */
+typedef void (*RtMidiPortCallback)( const std::string &portName, bool added, void *userData );
+
+/************************************************************************/
+/*! \class RtMidiMessage
+    \brief A single MIDI message with inline storage.
+
+    Channel and system messages fit in an inline buffer, so storing or
+    copying them never touches the heap.  Longer messages (sysex) spill
+    into a heap buffer that is kept and reused by later assignments,
+    so once a message has grown to the largest sysex seen, storing
+    further messages into it does not allocate.
+*/
+/************************************************************************/
+
+class RtMidiMessage
+{
+ public:
+  //! Number of bytes held without a heap allocation.
+  enum { INLINE_SIZE = 16 };
+
+  //! Time stamp of the message (delta time in seconds).
+  double timeStamp;
+
+  //! Absolute arrival time of the message, in nanoseconds on the RtMidi::getTime() clock.
+  long long absoluteTime;
+
+  //! Default constructor (an empty message).
+  RtMidiMessage() : timeStamp(0.0), absoluteTime(0), heap_(0), capacity_(INLINE_SIZE), size_(0) {}
+
+  //! Copy constructor.
+  RtMidiMessage( const RtMidiMessage &other )
+    : timeStamp(other.timeStamp), absoluteTime(other.absoluteTime), heap_(0), capacity_(INLINE_SIZE), size_(0)
+  { assign( other.data(), other.size() ); }
+
+  //! The destructor releases the spill buffer, if any.
+  ~RtMidiMessage() { delete [] heap_; }
+
+  //! Copy assignment, reusing the existing storage when it is large enough.
+  RtMidiMessage &operator=( const RtMidiMessage &other )
+  {
+    if ( this != &other ) {
+      assign( other.data(), other.size() );
+      timeStamp = other.timeStamp;
+      absoluteTime = other.absoluteTime;
+    }
+    return *this;
+  }
+
+  //! Returns a pointer to the message bytes.
+  const unsigned char *data( void ) const { return heap_ ? heap_ : inline_; }
+
+  //! Returns the number of bytes in the message.
+  size_t size( void ) const { return size_; }
+
+  //! Returns true if the message holds no bytes.
+  bool empty( void ) const { return size_ == 0; }
+
+  //! Returns the byte at the given position.
+  unsigned char operator[]( size_t i ) const { return data()[i]; }
+
+  //! Returns the last byte of a non-empty message.
+  unsigned char back( void ) const { return data()[size_ - 1]; }
+
+  //! Empties the message without releasing its storage.
+  void clear( void ) { size_ = 0; }
+
+  //! Ensures that \e n bytes can be held without a further allocation.
+  void reserve( size_t n )
+  {
+    if ( n <= capacity_ ) return;
+    if ( n < 2 * capacity_ ) n = 2 * capacity_;
+    unsigned char *bytes = new unsigned char[n];
+    if ( size_ ) memcpy( bytes, data(), size_ );
+    delete [] heap_;
+    heap_ = bytes;
+    capacity_ = n;
+  }
+
+  //! Replaces the message bytes.
+  void assign( const unsigned char *bytes, size_t n )
+  {
+    size_ = 0;
+    reserve( n );
+    if ( n ) memcpy( buffer(), bytes, n );
+    size_ = n;
+  }
+
+  //! Appends bytes to the message (used to reassemble segmented sysex).
+  void append( const unsigned char *bytes, size_t n )
+  {
+    reserve( size_ + n );
+    if ( n ) memcpy( buffer() + size_, bytes, n );
+    size_ += n;
+  }
+
+  //! Appends a single byte to the message.
+  void push_back( unsigned char byte ) { append( &byte, 1 ); }
+
+ private:
+  unsigned char *buffer( void ) { return heap_ ? heap_ : inline_; }
+
+  unsigned char inline_[INLINE_SIZE];
+  unsigned char *heap_;
+  size_t capacity_;
+  size_t size_;
+};
+
 class MidiApi;
 
 class RtMidi
@@ -124,7 +240,9 @@ class RtMidi
     LINUX_ALSA,     /*!< The Advanced Linux Sound Architecture API. */
     UNIX_JACK,      /*!< The JACK Low-Latency MIDI Server API. */
     WINDOWS_MM,     /*!< The Microsoft Multimedia MIDI API. */
-    RTMIDI_DUMMY    /*!< A compilable but non-functional API. */
+    RTMIDI_DUMMY,   /*!< A compilable but non-functional API. */
+    LINUX_ALSA_RAW, /*!< The ALSA raw MIDI API, bypassing the sequencer. */
+    RTMIDI_LOOPBACK /*!< In-process loopback buses (always compiled, never chosen automatically). */
   };
 
   //! A static function to determine the current RtMidi version.
@@ -138,6 +256,61 @@ class RtMidi
   */
   static void getCompiledApi( std::vector<RtMidi::Api> &apis ) throw();
 
+  //! A static function to read the clock used for scheduled MIDI output.
+  /*!
+    The returned value is in nanoseconds on a monotonic clock
+    (CLOCK_MONOTONIC on Linux, host time on OS-X).  It is the time
+    base expected by RtMidiOut::sendMessageAt().
+  */
+  static long long getTime( void ) throw();
+
+  //! Scheduling policies for the threads started by RtMidi.
+  enum ThreadPolicy {
+    THREAD_DEFAULT, /*!< The normal time-sharing policy (SCHED_OTHER). */
+    THREAD_FIFO,    /*!< First-in, first-out real-time scheduling (SCHED_FIFO). */
+    THREAD_RR       /*!< Round-robin real-time scheduling (SCHED_RR). */
+  };
+
+  //! Scheduling settings for a thread started by RtMidi.
+  struct ThreadOptions {
+    ThreadPolicy policy;        /*!< Scheduling policy. */
+    int priority;               /*!< Priority for the real-time policies, clamped to the range of the policy. */
+    unsigned long long cpuMask; /*!< CPUs the thread may run on, one bit per CPU (0 for no restriction). */
+
+    ThreadOptions() : policy(THREAD_DEFAULT), priority(0), cpuMask(0) {}
+  };
+
+  //! Set the scheduling policy, priority and CPU affinity of the threads this instance starts.
+  /*!
+    The options apply to threads started after the call, which for
+    most APIs means when a port is opened: the ALSA input threads and
+    the loopback bus scheduler.  The ALSA sequencer inputs of one
+    client share a thread, which runs with the most demanding options
+    of its ports: the highest real-time priority asked for.  APIs
+    whose threads are owned by the system (Core MIDI, JACK, Windows
+    MM) ignore them.  If a setting
+    cannot be applied, for instance because the process may not use
+    real-time scheduling, a warning is reported and the thread keeps
+    running with what it could get; see getThreadOptions().
+  */
+  void setThreadOptions( const ThreadOptions &options );
+
+  //! Set a callback function to be invoked when a port of this instance's direction appears or goes away.
+  /*!
+    The callback runs on an RtMidi thread.  Only the ALSA sequencer
+    API watches for port changes; other APIs warn.  With ALSA, an open
+    connection to a device that goes away is also restored when a port
+    with the same client and port name comes back.  The callback may
+    open and close ports, and delete RtMidi instances.
+  */
+  void setPortCallback( RtMidiPortCallback callback = NULL, void *userData = 0 );
+
+  //! Return the settings a thread started by this instance actually runs with.
+  /*!
+    Before any thread has been started, this returns the defaults.
+  */
+  ThreadOptions getThreadOptions( void );
+
   //! Pure virtual openPort() function.
   virtual void openPort( unsigned int portNumber = 0, const std::string portName = std::string( "RtMidi" ) ) = 0;
 
@@ -203,6 +376,34 @@ class RtMidi
 //
 // **************************************************************** //
 
+/**********************************************************************/
+/*! \class RtMidiLoopback
+    \brief Configuration of the in-process loopback API.
+
+    With the RTMIDI_LOOPBACK API, RtMidiOut instances write into named
+    buses and every RtMidiIn instance attached to a bus receives the
+    messages, with real time stamps and the usual queue and callback
+    semantics.  Each open virtual port name is a bus; creating a
+    virtual port with an existing bus name attaches to that bus, and
+    openPort() attaches to an existing bus by number.  Buses live for
+    the rest of the process once created.
+
+    A latency can be set per bus to model a device: every message is
+    then delivered that long after it was sent (or after its
+    sendMessageAt() time stamp) by the bus scheduler thread.
+*/
+/**********************************************************************/
+
+class RtMidiLoopback
+{
+ public:
+  //! Set the latency, in nanoseconds, added to every message on the named bus (created if needed).
+  static void setLatency( const std::string &busName, long long latency );
+
+  //! Return the latency of the named bus in nanoseconds (0 if there is no such bus).
+  static long long getLatency( const std::string &busName );
+};
+
 class RtMidiIn : public RtMidi
 {
  public:
@@ -210,13 +411,31 @@ class RtMidiIn : public RtMidi
   //! User callback function type definition.
   typedef void (*RtMidiCallback)( double timeStamp, std::vector<unsigned char> *message, void *userData);
 
+  //! User callback function type taking the complete message, including its absolute time stamp.
+  typedef void (*RtMidiMessageCallback)( const RtMidiMessage &message, void *userData );
+
+  //! User callback function type taking every message read in one wakeup of the input handler.
+  typedef void (*RtMidiBatchCallback)( const RtMidiMessage *messages, unsigned int count, void *userData );
+
+  //! Statistics of the MIDI input queue, as returned by getQueueStatistics().
+  struct QueueStatistics {
+    unsigned int capacity;        /*!< Number of messages the queue can currently hold. */
+    unsigned int size;            /*!< Number of messages currently waiting in the queue. */
+    unsigned int highWaterMark;   /*!< Largest number of messages ever waiting at once. */
+    unsigned long long dropped;   /*!< Number of messages dropped because the queue was full. */
+  };
+
   //! Default constructor that allows an optional api, client name and queue size.
   /*!
     An exception will be thrown if a MIDI system initialization
     error occurs.  The queue size defines the maximum number of
     messages that can be held in the MIDI queue (when not using a
-    callback function).  If the queue size limit is reached,
-    incoming messages will be ignored.
+    callback function) and is rounded up to a power of two.  If the
+    queue size limit is reached, incoming messages are dropped and
+    counted (see getQueueStatistics()) unless queue growth has been
+    enabled with setQueueGrowth().  A queue size of zero disables
+    queueing: messages are only delivered to a callback, and without
+    one they are dropped, even with growth enabled.
 
     If no API argument is specified and multiple API support has been
     compiled, the default order of use is ALSA, JACK (Linux) and CORE,
@@ -230,7 +449,7 @@ class RtMidiIn : public RtMidi
   */
   RtMidiIn( RtMidi::Api api=UNSPECIFIED,
             const std::string clientName = std::string( "RtMidi Input Client"),
-            unsigned int queueSizeLimit = 100 );
+            unsigned int queueSizeLimit = 1024 );
 
   //! If a MIDI connection is still open, it will be closed by the destructor.
   ~RtMidiIn ( void ) throw();
@@ -271,6 +490,26 @@ class RtMidiIn : public RtMidi
   */
   void setCallback( RtMidiCallback callback, void *userData = 0 );
 
+  //! Set a callback function that receives each message as an RtMidiMessage.
+  /*!
+    This works like setCallback(), but the callback also gets the
+    absolute time stamp of the message and the bytes are passed
+    without copying them into a vector.  Only one callback of either
+    kind can be set at a time; cancelCallback() removes it.
+  */
+  void setMessageCallback( RtMidiMessageCallback callback, void *userData = 0 );
+
+  //! Set a callback function that receives messages in batches.
+  /*!
+    The input handler reads all events that are pending when it wakes
+    up and passes them to the callback in a single call, which saves
+    per-message overhead during dense input.  APIs that receive one
+    message at a time call it with a count of 1.  The array is only
+    valid during the call.  Only one callback of any kind can be set
+    at a time; cancelCallback() removes it.
+  */
+  void setBatchCallback( RtMidiBatchCallback callback, void *userData = 0 );
+
   //! Cancel use of the current callback function (if one exists).
   /*!
     Subsequent incoming MIDI messages will be written to the queue
@@ -307,6 +546,29 @@ class RtMidiIn : public RtMidi
   */
   void ignoreTypes( bool midiSysex = true, bool midiTime = true, bool midiSense = true );
 
+  //! Channel message types for filterMessages(), one bit per status nibble.
+  enum MessageTypeMask {
+    NOTE_OFF = 0x01,          /*!< Note off (0x8n). */
+    NOTE_ON = 0x02,           /*!< Note on (0x9n). */
+    POLY_PRESSURE = 0x04,     /*!< Polyphonic aftertouch (0xAn). */
+    CONTROL_CHANGE = 0x08,    /*!< Control change (0xBn). */
+    PROGRAM_CHANGE = 0x10,    /*!< Program change (0xCn). */
+    CHANNEL_PRESSURE = 0x20,  /*!< Channel aftertouch (0xDn). */
+    PITCH_BEND = 0x40         /*!< Pitch bend (0xEn). */
+  };
+
+  //! Drop channel messages by type and channel before they are queued.
+  /*!
+    \e dropTypes is a combination of MessageTypeMask values that are
+    never delivered.  \e channels has one bit per MIDI channel (bit 0
+    for channel 1); channel messages on the other channels are
+    dropped.  The defaults deliver everything.  The filter and the
+    ignoreTypes() settings are compiled into one table indexed by
+    status byte, which the input handler checks before a message is
+    decoded or stored, so dropped traffic costs a single lookup.
+  */
+  void filterMessages( unsigned int dropTypes = 0, unsigned int channels = 0xFFFF );
+
   //! Fill the user-provided vector with the data bytes for the next available MIDI message in the input queue and return the event delta-time in seconds.
   /*!
     This function returns immediately whether a new message is
@@ -317,6 +579,69 @@ class RtMidiIn : public RtMidi
   */
   double getMessage( std::vector<unsigned char> *message );
 
+  //! Like getMessage(), but also return the absolute arrival time of the message.
+  /*!
+    The absolute time is given in nanoseconds on the RtMidi::getTime()
+    clock and is set to 0 if no message was available.
+  */
+  double getMessage( std::vector<unsigned char> *message, long long *absoluteTime );
+
+  //! Move up to \e maxCount queued messages, with their time stamps, into the caller's array and return how many were moved.
+  /*!
+    This function returns immediately whether messages are available
+    or not.  The array elements keep their storage between calls, so
+    draining channel messages into a reused array does not allocate.
+  */
+  unsigned int getMessages( RtMidiMessage *messages, unsigned int maxCount );
+
+  //! Like getMessages(), but block until at least one message is available or the timeout (in seconds) expires.
+  /*!
+    The calling thread sleeps until the input handler queues a message,
+    then takes every message queued at that point (up to \e maxCount),
+    so a burst is collected in a single call.  A negative timeout waits
+    indefinitely.  Returns 0 on timeout.
+  */
+  unsigned int waitForMessages( RtMidiMessage *messages, unsigned int maxCount, double timeout = -1.0 );
+
+  //! Specify whether the input queue should grow instead of dropping messages when it is full.
+  /*!
+    By default a full queue drops incoming messages.  With growth
+    enabled, the input handler moves on to a queue of twice the size
+    (this allocates memory on the handler thread) and the reader
+    follows once it has drained the old one, so no message is lost.
+  */
+  void setQueueGrowth( bool grow = true );
+
+  //! Return the capacity, fill level, high-water mark and drop count of the input queue.
+  /*!
+    This function may be called from any thread.
+  */
+  QueueStatistics getQueueStatistics( void );
+
+  //! Specify whether input is serviced by the application instead of an RtMidi thread.
+  /*!
+    In threadless mode, opening a port does not start an input thread.
+    The application watches the descriptors returned by
+    getPollDescriptors() in its own event loop and calls
+    processPending() when one becomes readable; callbacks then run on
+    that thread.  This must be set before a port is opened.  Only the
+    ALSA API supports it; other APIs warn and keep their thread.
+  */
+  void setThreadless( bool threadless = true );
+
+  //! Fill \e descriptors with the file descriptors that become readable when input is pending.
+  /*!
+    Only meaningful in threadless mode, once a port has been opened.
+  */
+  void getPollDescriptors( std::vector<int> &descriptors );
+
+  //! Read and dispatch all pending input without blocking and return the number of messages delivered.
+  /*!
+    Messages go to the callback, if one is set, or to the input queue.
+    Only meaningful in threadless mode.
+  */
+  unsigned int processPending( void );
+
   //! Set an error callback function to be invoked when an error has occured.
   /*!
     The callback function will be called whenever an error has occured. It is best
@@ -408,6 +733,24 @@ class RtMidiOut : public RtMidi
   */
   void sendMessage( std::vector<unsigned char> *message );
 
+  //! Schedule a single message to be sent out an open MIDI output port at the given time.
+  /*!
+      The time stamp is given in nanoseconds on the RtMidi::getTime()
+      clock.  Messages whose time has already passed are sent
+      immediately, after any earlier messages still pending.  With the
+      ALSA, JACK and OS-X APIs the message is handed to the system
+      right away and timed by the sequencer queue, the JACK process
+      cycle or CoreMIDI respectively, so the caller does not need to
+      sleep until the deadline.  The loopback API schedules it on its
+      bus, whose thread sends it when it is due.  Other APIs send the
+      message immediately.  Messages with equal time stamps are
+      delivered in the order they are sent; sendMessage() is not
+      ordered against scheduled messages that are still pending.  An
+      exception is thrown if an error occurs during output or an
+      output connection was not previously established.
+  */
+  void sendMessageAt( long long timeStamp, std::vector<unsigned char> *message );
+
   //! Set an error callback function to be invoked when an error has occured.
   /*!
     The callback function will be called whenever an error has occured. It is best
@@ -449,6 +792,9 @@ class MidiApi
 
   inline bool isPortOpen() const { return connected_; }
   void setErrorCallback( RtMidiErrorCallback errorCallback, void *userData );
+  void setThreadOptions( const RtMidi::ThreadOptions &options ) { threadOptions_ = options; }
+  RtMidi::ThreadOptions getThreadOptions( void ) const { return effectiveThreadOptions_; }
+  virtual void setPortCallback( RtMidiPortCallback callback, void *userData );
 
   //! A basic error reporting function for RtMidi classes.
   void error( RtMidiError::Type type, std::string errorString );
@@ -462,6 +808,10 @@ protected:
   RtMidiErrorCallback errorCallback_;
   bool firstErrorOccurred_;
   void *errorCallbackUserData_;
+  RtMidi::ThreadOptions threadOptions_;          // requested for new threads
+  RtMidi::ThreadOptions effectiveThreadOptions_; // of the last thread started
+  RtMidiPortCallback portCallback_;
+  void *portCallbackUserData_;
 };
 
 class MidiInApi : public MidiApi
@@ -471,31 +821,78 @@ class MidiInApi : public MidiApi
   MidiInApi( unsigned int queueSizeLimit );
   virtual ~MidiInApi( void );
   void setCallback( RtMidiIn::RtMidiCallback callback, void *userData );
+  void setMessageCallback( RtMidiIn::RtMidiMessageCallback callback, void *userData );
+  void setBatchCallback( RtMidiIn::RtMidiBatchCallback callback, void *userData );
   void cancelCallback( void );
   virtual void ignoreTypes( bool midiSysex, bool midiTime, bool midiSense );
+  void filterMessages( unsigned int dropTypes, unsigned int channels );
   double getMessage( std::vector<unsigned char> *message );
+  double getMessage( std::vector<unsigned char> *message, long long *absoluteTime );
+  unsigned int getMessages( RtMidiMessage *messages, unsigned int maxCount );
+  unsigned int waitForMessages( RtMidiMessage *messages, unsigned int maxCount, double timeout );
+  void setQueueGrowth( bool grow );
+  RtMidiIn::QueueStatistics getQueueStatistics( void );
+  virtual void setThreadless( bool threadless );
+  virtual void getPollDescriptors( std::vector<int> &descriptors );
+  virtual unsigned int processPending( void );
+
+  // Open a port for RtMidiIn, first naming the input for the probes
+  // after the source it connects to, or the virtual port itself.
+  void openInput( unsigned int portNumber, const std::string &portName );
+  void openVirtualInput( const std::string &portName );
 
   // A MIDI structure used internally by the class to store incoming
   // messages.  Each message represents one and only one MIDI message.
-  struct MidiMessage { 
-    std::vector<unsigned char> bytes; 
-    double timeStamp;
-
-    // Default constructor.
-  MidiMessage()
-  :bytes(0), timeStamp(0.0) {}
-  };
-
+  // Channel messages are stored inline, so queueing them does not
+  // allocate.
+  typedef RtMidiMessage MidiMessage;
+
+  // A lock-free single-producer/single-consumer queue of messages.
+  // The input handler pushes and getMessage() pops, each on its own
+  // thread, and the ring indices are atomic so neither side takes a
+  // lock.  Indices run freely and are masked, so ring sizes are powers
+  // of two.  In grow mode a full ring is not an overrun: the producer
+  // links a ring of twice the size and carries on there, and the
+  // consumer moves over (freeing the old ring) once it has drained it.
+  // A consumer may sleep in wait(); the producer only touches the
+  // mutex to wake it when it is actually waiting.
   struct MidiQueue {
-    unsigned int front;
-    unsigned int back;
-    unsigned int size;
-    unsigned int ringSize;
-    MidiMessage *ring;
+    struct Ring {
+      MidiMessage *slots;
+      unsigned int mask;
+      std::atomic<unsigned int> front;  // written by the consumer
+      std::atomic<unsigned int> back;   // written by the producer
+      std::atomic<Ring *> next;         // set by the producer when it grows
+
+      Ring( unsigned int size );
+      ~Ring();
+    };
+
+    Ring *head;                           // consumer side
+    Ring *tail;                           // producer side
+    std::atomic<bool> grow;
+    std::atomic<unsigned int> capacity;
+    std::atomic<unsigned int> highWaterMark;
+    std::atomic<unsigned long long> pushed;
+    std::atomic<unsigned long long> popped;
+    std::atomic<unsigned long long> dropped;
+    std::atomic<bool> waiting;
+    std::mutex mutex;
+    std::condition_variable ready;
 
     // Default constructor.
   MidiQueue()
-  :front(0), back(0), size(0), ringSize(0) {}
+  :head(0), tail(0), grow(false), capacity(0),
+      highWaterMark(0), pushed(0), popped(0), dropped(0), waiting(false) {}
+    ~MidiQueue();
+
+    void allocate( unsigned int size );
+    bool push( const MidiMessage &message );   // producer
+    void notify( void );                       // producer
+    const MidiMessage *peek( void );           // consumer
+    void pop( void );                          // consumer
+    bool wait( double timeout );               // consumer
+    unsigned int size( void ) const;
   };
 
   // The RtMidiInData structure is used to pass private class data to
@@ -504,19 +901,37 @@ class MidiInApi : public MidiApi
     MidiQueue queue;
     MidiMessage message;
     unsigned char ignoreFlags;
+    unsigned int filterTypes;     // RtMidiIn::MessageTypeMask bits to drop
+    unsigned int filterChannels;  // channels to keep, bit 0 for channel 1
+    unsigned char filter[256];    // non-zero for status bytes to drop
     bool doInput;
     bool firstMessage;
     void *apiData;
     bool usingCallback;
     RtMidiIn::RtMidiCallback userCallback;
+    RtMidiIn::RtMidiMessageCallback messageCallback;
+    RtMidiIn::RtMidiBatchCallback batchCallback;
     void *userData;
     bool continueSysex;
+    std::vector<unsigned char> callbackBytes;
+    std::string portName;         // the source or virtual port, for the input probe
+    unsigned long long sequence;  // messages delivered since the port was opened
 
     // Default constructor.
   RtMidiInData()
-  : ignoreFlags(7), doInput(false), firstMessage(true),
-      apiData(0), usingCallback(false), userCallback(0), userData(0),
-      continueSysex(false) {}
+  : ignoreFlags(7), filterTypes(0), filterChannels(0xFFFF), doInput(false), firstMessage(true),
+      apiData(0), usingCallback(false), userCallback(0), messageCallback(0), batchCallback(0), userData(0),
+      continueSysex(false), sequence(0) { compileFilter(); }
+
+    // Rebuild the status byte table from ignoreFlags and the channel
+    // message filter.
+    void compileFilter( void );
+
+    // Pass complete messages to the user callback or, if none is
+    // set, push them onto the queue and wake a waiting reader once.
+    // Called from the input handler.
+    void deliver( const MidiMessage *messages, unsigned int count );
+    void deliver( const MidiMessage &message ) { deliver( &message, 1 ); }
   };
 
  protected:
@@ -530,6 +945,7 @@ class MidiOutApi : public MidiApi
   MidiOutApi( void );
   virtual ~MidiOutApi( void );
   virtual void sendMessage( std::vector<unsigned char> *message ) = 0;
+  virtual void sendMessageAt( long long timeStamp, std::vector<unsigned char> *message );
 };
 
 // **************************************************************** //
@@ -538,17 +954,32 @@ class MidiOutApi : public MidiApi
 //
 // **************************************************************** //
 
+inline void RtMidi :: setThreadOptions( const ThreadOptions &options ) { rtapi_->setThreadOptions( options ); }
+inline RtMidi::ThreadOptions RtMidi :: getThreadOptions( void ) { return rtapi_->getThreadOptions(); }
+inline void RtMidi :: setPortCallback( RtMidiPortCallback callback, void *userData ) { rtapi_->setPortCallback( callback, userData ); }
+
 inline RtMidi::Api RtMidiIn :: getCurrentApi( void ) throw() { return rtapi_->getCurrentApi(); }
-inline void RtMidiIn :: openPort( unsigned int portNumber, const std::string portName ) { rtapi_->openPort( portNumber, portName ); }
-inline void RtMidiIn :: openVirtualPort( const std::string portName ) { rtapi_->openVirtualPort( portName ); }
+inline void RtMidiIn :: openPort( unsigned int portNumber, const std::string portName ) { ((MidiInApi *)rtapi_)->openInput( portNumber, portName ); }
+inline void RtMidiIn :: openVirtualPort( const std::string portName ) { ((MidiInApi *)rtapi_)->openVirtualInput( portName ); }
 inline void RtMidiIn :: closePort( void ) { rtapi_->closePort(); }
 inline bool RtMidiIn :: isPortOpen() const { return rtapi_->isPortOpen(); }
 inline void RtMidiIn :: setCallback( RtMidiCallback callback, void *userData ) { ((MidiInApi *)rtapi_)->setCallback( callback, userData ); }
+inline void RtMidiIn :: setMessageCallback( RtMidiMessageCallback callback, void *userData ) { ((MidiInApi *)rtapi_)->setMessageCallback( callback, userData ); }
+inline void RtMidiIn :: setBatchCallback( RtMidiBatchCallback callback, void *userData ) { ((MidiInApi *)rtapi_)->setBatchCallback( callback, userData ); }
 inline void RtMidiIn :: cancelCallback( void ) { ((MidiInApi *)rtapi_)->cancelCallback(); }
 inline unsigned int RtMidiIn :: getPortCount( void ) { return rtapi_->getPortCount(); }
 inline std::string RtMidiIn :: getPortName( unsigned int portNumber ) { return rtapi_->getPortName( portNumber ); }
 inline void RtMidiIn :: ignoreTypes( bool midiSysex, bool midiTime, bool midiSense ) { ((MidiInApi *)rtapi_)->ignoreTypes( midiSysex, midiTime, midiSense ); }
+inline void RtMidiIn :: filterMessages( unsigned int dropTypes, unsigned int channels ) { ((MidiInApi *)rtapi_)->filterMessages( dropTypes, channels ); }
 inline double RtMidiIn :: getMessage( std::vector<unsigned char> *message ) { return ((MidiInApi *)rtapi_)->getMessage( message ); }
+inline double RtMidiIn :: getMessage( std::vector<unsigned char> *message, long long *absoluteTime ) { return ((MidiInApi *)rtapi_)->getMessage( message, absoluteTime ); }
+inline unsigned int RtMidiIn :: getMessages( RtMidiMessage *messages, unsigned int maxCount ) { return ((MidiInApi *)rtapi_)->getMessages( messages, maxCount ); }
+inline unsigned int RtMidiIn :: waitForMessages( RtMidiMessage *messages, unsigned int maxCount, double timeout ) { return ((MidiInApi *)rtapi_)->waitForMessages( messages, maxCount, timeout ); }
+inline void RtMidiIn :: setQueueGrowth( bool grow ) { ((MidiInApi *)rtapi_)->setQueueGrowth( grow ); }
+inline RtMidiIn::QueueStatistics RtMidiIn :: getQueueStatistics( void ) { return ((MidiInApi *)rtapi_)->getQueueStatistics(); }
+inline void RtMidiIn :: setThreadless( bool threadless ) { ((MidiInApi *)rtapi_)->setThreadless( threadless ); }
+inline void RtMidiIn :: getPollDescriptors( std::vector<int> &descriptors ) { ((MidiInApi *)rtapi_)->getPollDescriptors( descriptors ); }
+inline unsigned int RtMidiIn :: processPending( void ) { return ((MidiInApi *)rtapi_)->processPending(); }
 inline void RtMidiIn :: setErrorCallback( RtMidiErrorCallback errorCallback, void *userData ) { rtapi_->setErrorCallback(errorCallback, userData); }
 
 inline RtMidi::Api RtMidiOut :: getCurrentApi( void ) throw() { return rtapi_->getCurrentApi(); }
@@ -559,6 +990,7 @@ inline bool RtMidiOut :: isPortOpen() const { return rtapi_->isPortOpen(); }
 inline unsigned int RtMidiOut :: getPortCount( void ) { return rtapi_->getPortCount(); }
 inline std::string RtMidiOut :: getPortName( unsigned int portNumber ) { return rtapi_->getPortName( portNumber ); }
 inline void RtMidiOut :: sendMessage( std::vector<unsigned char> *message ) { ((MidiOutApi *)rtapi_)->sendMessage( message ); }
+inline void RtMidiOut :: sendMessageAt( long long timeStamp, std::vector<unsigned char> *message ) { ((MidiOutApi *)rtapi_)->sendMessageAt( timeStamp, message ); }
 inline void RtMidiOut :: setErrorCallback( RtMidiErrorCallback errorCallback, void *userData ) { rtapi_->setErrorCallback(errorCallback, userData); }
 
 // **************************************************************** //
@@ -601,6 +1033,7 @@ class MidiOutCore: public MidiOutApi
   unsigned int getPortCount( void );
   std::string getPortName( unsigned int portNumber );
   void sendMessage( std::vector<unsigned char> *message );
+  void sendMessageAt( long long timeStamp, std::vector<unsigned char> *message );
 
  protected:
   void initialize( const std::string& clientName );
@@ -641,6 +1074,7 @@ class MidiOutJack: public MidiOutApi
   unsigned int getPortCount( void );
   std::string getPortName( unsigned int portNumber );
   void sendMessage( std::vector<unsigned char> *message );
+  void sendMessageAt( long long timeStamp, std::vector<unsigned char> *message );
 
  protected:
   std::string clientName;
@@ -653,6 +1087,8 @@ class MidiOutJack: public MidiOutApi
 
 #if defined(__LINUX_ALSA__)
 
+struct AlsaPort;
+
 class MidiInAlsa: public MidiInApi
 {
  public:
@@ -664,9 +1100,17 @@ class MidiInAlsa: public MidiInApi
   void closePort( void );
   unsigned int getPortCount( void );
   std::string getPortName( unsigned int portNumber );
+  void setThreadless( bool threadless );
+  void getPollDescriptors( std::vector<int> &descriptors );
+  unsigned int processPending( void );
+  void setPortCallback( RtMidiPortCallback callback, void *userData );
 
  protected:
   void initialize( const std::string& clientName );
+  bool startInput( const std::string &caller );
+  static void portChanged( const AlsaPort &port, bool added, void *object );
+
+  bool threadless_;
 };
 
 class MidiOutAlsa: public MidiOutApi
@@ -681,6 +1125,42 @@ class MidiOutAlsa: public MidiOutApi
   unsigned int getPortCount( void );
   std::string getPortName( unsigned int portNumber );
   void sendMessage( std::vector<unsigned char> *message );
+  void sendMessageAt( long long timeStamp, std::vector<unsigned char> *message );
+  void setPortCallback( RtMidiPortCallback callback, void *userData );
+
+ protected:
+  void initialize( const std::string& clientName );
+  static void portChanged( const AlsaPort &port, bool added, void *object );
+};
+
+class MidiInAlsaRaw: public MidiInApi
+{
+ public:
+  MidiInAlsaRaw( const std::string clientName, unsigned int queueSizeLimit );
+  ~MidiInAlsaRaw( void );
+  RtMidi::Api getCurrentApi( void ) { return RtMidi::LINUX_ALSA_RAW; };
+  void openPort( unsigned int portNumber, const std::string portName );
+  void openVirtualPort( const std::string portName );
+  void closePort( void );
+  unsigned int getPortCount( void );
+  std::string getPortName( unsigned int portNumber );
+
+ protected:
+  void initialize( const std::string& clientName );
+};
+
+class MidiOutAlsaRaw: public MidiOutApi
+{
+ public:
+  MidiOutAlsaRaw( const std::string clientName );
+  ~MidiOutAlsaRaw( void );
+  RtMidi::Api getCurrentApi( void ) { return RtMidi::LINUX_ALSA_RAW; };
+  void openPort( unsigned int portNumber, const std::string portName );
+  void openVirtualPort( const std::string portName );
+  void closePort( void );
+  unsigned int getPortCount( void );
+  std::string getPortName( unsigned int portNumber );
+  void sendMessage( std::vector<unsigned char> *message );
 
  protected:
   void initialize( const std::string& clientName );
@@ -760,4 +1240,39 @@ class MidiOutDummy: public MidiOutApi
 
 #endif
 
+class MidiInLoopback: public MidiInApi
+{
+ public:
+  MidiInLoopback( const std::string clientName, unsigned int queueSizeLimit );
+  ~MidiInLoopback( void );
+  RtMidi::Api getCurrentApi( void ) { return RtMidi::RTMIDI_LOOPBACK; };
+  void openPort( unsigned int portNumber, const std::string portName );
+  void openVirtualPort( const std::string portName );
+  void closePort( void );
+  unsigned int getPortCount( void );
+  std::string getPortName( unsigned int portNumber );
+
+ protected:
+  void initialize( const std::string& clientName );
+  void attach( void *bus );
+};
+
+class MidiOutLoopback: public MidiOutApi
+{
+ public:
+  MidiOutLoopback( const std::string clientName );
+  ~MidiOutLoopback( void );
+  RtMidi::Api getCurrentApi( void ) { return RtMidi::RTMIDI_LOOPBACK; };
+  void openPort( unsigned int portNumber, const std::string portName );
+  void openVirtualPort( const std::string portName );
+  void closePort( void );
+  unsigned int getPortCount( void );
+  std::string getPortName( unsigned int portNumber );
+  void sendMessage( std::vector<unsigned char> *message );
+  void sendMessageAt( long long timeStamp, std::vector<unsigned char> *message );
+
+ protected:
+  void initialize( const std::string& clientName );
+};
+
 #endif
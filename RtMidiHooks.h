@@ -0,0 +1,24 @@
+/********************************
+
+RtMidiHooks.h
+Connects RtMidi's input hooks to the USDT probes and the allocation
+checks of the applications
+
+RtMidi.cpp includes this when it is built with
+-D RTMIDI_HOOKS='"RtMidiHooks.h"' (see the Makefile). Without it,
+RtMidi builds on its own and the hooks are empty.
+
+********************************/
+
+#ifndef NDNMIDI_RTMIDI_HOOKS_H
+#define NDNMIDI_RTMIDI_HOOKS_H
+
+#include "AllocCheck.h"
+#include "Probes.h"
+
+#define RTMIDI_INPUT_REGION(name) ALLOC_REGION(name)
+#define RTMIDI_INPUT_CALLBACK() ALLOC_ALLOWED()
+#define RTMIDI_INPUT_PROBE(port, sequence, bytes, size, time) \
+	NDNMIDI_PROBE5(midi_input, port, sequence, bytes, size, time)
+
+#endif
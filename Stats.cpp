@@ -0,0 +1,123 @@
+/********************************
+
+Stats.cpp
+Counters published under <baseName>/status/stats by ControllerMIDI and
+PlaybackModuleMIDI
+
+********************************/
+
+#include "Stats.h"
+
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+
+static const char *statNames[STAT_COUNTERS] = {
+	"packets_in",
+	"packets_out",
+	"events_in",
+	"events_out",
+	"events_dropped",
+	"out_of_order",
+	"out_of_date",
+	"reexpressed",
+	"timeouts",
+	"nacks",
+	"heartbeats",
+	"rejected"
+};
+
+// The counters of one thread. Only that thread writes them, so plain
+// relaxed stores are enough; the atomics let collectStats() read them
+// at any time.
+struct StatBlock
+{
+	std::atomic<unsigned long long> values[STATS_SLOTS][STAT_COUNTERS];
+};
+
+// Guards the list of blocks, the totals of exited threads and the
+// baselines, none of which are touched while counting
+static std::mutex registryMutex;
+static std::vector<StatBlock *> blocks;
+static StatTotals retired;
+static StatTotals baseline;
+
+static void
+addBlock(StatTotals& totals, const StatBlock& block)
+{
+	for (unsigned int slot = 0; slot < STATS_SLOTS; ++slot)
+		for (unsigned int i = 0; i < STAT_COUNTERS; ++i)
+			totals.values[slot][i] += block.values[slot][i].load(std::memory_order_relaxed);
+}
+
+static void
+sumAll(StatTotals& totals)
+{
+	totals = retired;
+	for (unsigned int b = 0; b < blocks.size(); ++b)
+		addBlock(totals, *blocks[b]);
+}
+
+// Registers the thread's block on first use and folds it into the
+// retired totals when the thread exits
+class ThreadStats
+{
+public:
+	ThreadStats()
+		: m_block(new StatBlock)
+	{
+		for (unsigned int slot = 0; slot < STATS_SLOTS; ++slot)
+			for (unsigned int i = 0; i < STAT_COUNTERS; ++i)
+				m_block->values[slot][i].store(0, std::memory_order_relaxed);
+
+		std::lock_guard<std::mutex> lock(registryMutex);
+		blocks.push_back(m_block);
+	}
+
+	~ThreadStats()
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+		addBlock(retired, *m_block);
+		blocks.erase(std::find(blocks.begin(), blocks.end(), m_block));
+		delete m_block;
+	}
+
+	StatBlock *m_block;
+};
+
+static thread_local ThreadStats threadStats;
+
+void
+countStat(unsigned int slot, StatCounter counter, unsigned long n)
+{
+	std::atomic<unsigned long long>& value = threadStats.m_block->values[slot][counter];
+	value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+void
+resetStats(unsigned int slot)
+{
+	std::lock_guard<std::mutex> lock(registryMutex);
+	StatTotals totals;
+	sumAll(totals);
+	for (unsigned int i = 0; i < STAT_COUNTERS; ++i)
+		baseline.values[slot][i] = totals.values[slot][i];
+}
+
+void
+collectStats(StatTotals& totals)
+{
+	std::lock_guard<std::mutex> lock(registryMutex);
+	sumAll(totals);
+	for (unsigned int slot = 0; slot < STATS_SLOTS; ++slot)
+		for (unsigned int i = 0; i < STAT_COUNTERS; ++i)
+			totals.values[slot][i] -= baseline.values[slot][i];
+}
+
+void
+printStats(std::ostream& out, const StatTotals& totals, unsigned int slot)
+{
+	for (unsigned int i = 0; i < STAT_COUNTERS; ++i)
+		out << (i ? ", " : "") << "\"" << statNames[i] << "\": " << totals.values[slot][i];
+}
@@ -0,0 +1,63 @@
+/********************************
+
+Stats.h
+Counters published under <baseName>/status/stats by ControllerMIDI and
+PlaybackModuleMIDI
+
+Each thread counts into its own block, so counting is a relaxed load
+and store with no lock or shared cache line. The blocks are only summed
+when a stats interest arrives.
+
+Counters are kept per slot: one per connection (the playback module
+uses the connection's MIDI channel, the controller slot 0) and one for
+the process as a whole.
+
+********************************/
+
+#ifndef NDNMIDI_STATS_H
+#define NDNMIDI_STATS_H
+
+#include <ostream>
+
+// Slots 0-15 are connections, the last one the process
+#define STATS_CONNECTIONS 16
+#define STATS_PROCESS_SLOT STATS_CONNECTIONS
+#define STATS_SLOTS (STATS_CONNECTIONS + 1)
+
+enum StatCounter
+{
+	STAT_PACKETS_IN,       // interests or data received
+	STAT_PACKETS_OUT,      // interests or data sent
+	STAT_EVENTS_IN,        // MIDI messages received
+	STAT_EVENTS_OUT,       // MIDI messages sent
+	STAT_EVENTS_DROPPED,   // MIDI messages thrown away
+	STAT_OUT_OF_ORDER,     // data ahead of the interest window
+	STAT_OUT_OF_DATE,      // data behind the interest window
+	STAT_REEXPRESSED,      // interests for sequence numbers already seen
+	STAT_TIMEOUTS,
+	STAT_NACKS,
+	STAT_HEARTBEATS,
+	STAT_REJECTED,         // connections refused
+	STAT_COUNTERS
+};
+
+// Sums of all threads' counters
+struct StatTotals
+{
+	unsigned long long values[STATS_SLOTS][STAT_COUNTERS];
+};
+
+// Adds n to a counter of the calling thread
+void countStat(unsigned int slot, StatCounter counter, unsigned long n = 1);
+
+// Starts the counters of a slot again from zero, when its connection
+// is handed to a new remote
+void resetStats(unsigned int slot);
+
+// Sums the counters of every thread, including threads that have exited
+void collectStats(StatTotals& totals);
+
+// Writes the counters of a slot as JSON members ("name": value, ...)
+void printStats(std::ostream& out, const StatTotals& totals, unsigned int slot);
+
+#endif
@@ -0,0 +1,316 @@
+/********************************
+
+Trace.cpp
+Per-note tracing for ControllerMIDI and PlaybackModuleMIDI, written as
+Chrome trace JSON (chrome://tracing, ui.perfetto.dev)
+
+********************************/
+
+#include "Trace.h"
+#include "Realtime.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+std::atomic<bool> traceOn(false);
+
+static std::string traceFileName;
+static std::string traceProcess;
+static std::atomic<unsigned long long> nextTraceId(1);
+
+struct TraceEvent
+{
+	const char *name;      // slice name or flow category
+	const char *argName;
+	long long start;
+	long long duration;
+	unsigned long long id;
+	long long arg;
+	char phase;            // 'X' slice, or 's', 't', 'f' flow
+};
+
+// The events of one thread. Only that thread writes; head counts every
+// event ever written and is published after the event is filled in.
+struct TraceBuffer
+{
+	std::string thread;
+	unsigned int tid;
+	std::atomic<unsigned long long> head;
+	TraceEvent events[TRACE_BUFFER_EVENTS];
+};
+
+// Guards the list of buffers and the thread names. Buffers stay until
+// the process exits, so threads that ended still show in the trace.
+static std::mutex registryMutex;
+static std::vector<TraceBuffer *> buffers;
+
+static thread_local TraceBuffer *threadBuffer = NULL;
+
+// One file write at a time, from the writer thread or at exit
+static std::mutex fileMutex;
+
+// Requests for the writer thread. Never deleted, since the thread may
+// still be waiting on it when the process exits.
+struct TraceWriter
+{
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::vector<std::function<void(long long)> > requests;
+};
+
+static TraceWriter *writer = NULL;
+
+static TraceBuffer *
+getThreadBuffer()
+{
+	if (threadBuffer != NULL)
+		return threadBuffer;
+
+	TraceBuffer *buffer = new TraceBuffer;
+	memset(buffer->events, 0, sizeof(buffer->events));
+	buffer->head.store(0, std::memory_order_relaxed);
+
+	std::lock_guard<std::mutex> lock(registryMutex);
+	buffer->tid = buffers.size() + 1;
+	buffer->thread = "thread " + std::to_string(buffer->tid);
+	buffers.push_back(buffer);
+	threadBuffer = buffer;
+	return buffer;
+}
+
+static void
+record(char phase, const char *name, long long start, long long duration,
+	   unsigned long long id, const char *argName, long long arg)
+{
+	TraceBuffer *buffer = getThreadBuffer();
+	unsigned long long head = buffer->head.load(std::memory_order_relaxed);
+	TraceEvent& event = buffer->events[head % TRACE_BUFFER_EVENTS];
+	event.name = name;
+	event.argName = argName;
+	event.start = start;
+	event.duration = duration;
+	event.id = id;
+	event.arg = arg;
+	event.phase = phase;
+	buffer->head.store(head + 1, std::memory_order_release);
+}
+
+// Trace times are microseconds; keep the nanoseconds as decimals
+static void
+printMicros(std::ostream& out, long long ns)
+{
+	out << ns / 1000 << "." << std::setw(3) << std::setfill('0') << ns % 1000;
+}
+
+bool
+parseTraceOption(const std::string& option)
+{
+	if (option.compare(0, 8, "--trace=") == 0)
+	{
+		traceFileName = option.substr(8);
+		return true;
+	}
+	return false;
+}
+
+const char *
+traceUsage()
+{
+	return "  --trace=FILE  record each note's path and write it to FILE as Chrome trace JSON\n";
+}
+
+static void
+writeTraceAtExit()
+{
+	writeTrace();
+}
+
+// Writes the file for every request that came in since the last write.
+// The writes take tens of milliseconds and must not hold up the network
+// or MIDI threads.
+static void
+writerLoop()
+{
+	enterThread(ROLE_UI, "trace writer");
+	std::unique_lock<std::mutex> lock(writer->mutex);
+	while (true)
+	{
+		writer->wake.wait(lock, [] { return !writer->requests.empty(); });
+		std::vector<std::function<void(long long)> > requests;
+		requests.swap(writer->requests);
+		lock.unlock();
+
+		long long events = writeTrace();
+		for (unsigned int i = 0; i < requests.size(); ++i)
+			requests[i](events);
+
+		lock.lock();
+	}
+}
+
+void
+startTrace(const std::string& processName)
+{
+	if (traceFileName.empty())
+		return;
+
+	traceProcess = processName;
+	// Note ids start from the process id, so they differ between
+	// processes whose traces are put together
+	nextTraceId = ((unsigned long long) getpid() << 32) + 1;
+	writer = new TraceWriter;
+	traceOn = true;
+	atexit(writeTraceAtExit);
+	std::thread(writerLoop).detach();
+}
+
+void
+traceThread(const char *name)
+{
+	if (!tracing())
+		return;
+
+	TraceBuffer *buffer = getThreadBuffer();
+	std::lock_guard<std::mutex> lock(registryMutex);
+	buffer->thread = name;
+}
+
+unsigned long long
+newTraceId()
+{
+	return nextTraceId.fetch_add(1, std::memory_order_relaxed);
+}
+
+void
+traceSlice(const char *name, long long start, long long end,
+		   const char *argName, long long arg)
+{
+	record('X', name, start, end - start, 0, argName, arg);
+}
+
+void
+traceFlow(char phase, const char *category, long long time, unsigned long long id)
+{
+	record(phase, category, time, 0, id, NULL, 0);
+}
+
+// Copies the events of a buffer that are not being overwritten. The
+// owner keeps recording while they are copied, so an event only counts
+// if head shows its slot was not reused before the copy finished.
+static void
+copyEvents(TraceBuffer *buffer, std::vector<TraceEvent>& events)
+{
+	unsigned long long head = buffer->head.load(std::memory_order_acquire);
+	unsigned long long first = head > TRACE_BUFFER_EVENTS ? head - TRACE_BUFFER_EVENTS : 0;
+	events.clear();
+	for (unsigned long long i = first; i < head; ++i)
+		events.push_back(buffer->events[i % TRACE_BUFFER_EVENTS]);
+
+	// The slot of event i is written again as event i + TRACE_BUFFER_EVENTS,
+	// which may be under way while head equals its index
+	std::atomic_thread_fence(std::memory_order_acquire);
+	unsigned long long after = buffer->head.load(std::memory_order_relaxed);
+	if (after >= first + TRACE_BUFFER_EVENTS)
+	{
+		unsigned long long lost = after - (first + TRACE_BUFFER_EVENTS) + 1;
+		events.erase(events.begin(), events.begin() + std::min<unsigned long long>(lost, events.size()));
+	}
+}
+
+long long
+writeTrace()
+{
+	if (!tracing())
+		return -1;
+
+	// The buffer list is copied, so threads that start recording do
+	// not wait on the file
+	std::vector<TraceBuffer *> traced;
+	std::vector<std::string> threads;
+	{
+		std::lock_guard<std::mutex> lock(registryMutex);
+		traced = buffers;
+		for (unsigned int b = 0; b < buffers.size(); ++b)
+			threads.push_back(buffers[b]->thread);
+	}
+
+	std::lock_guard<std::mutex> lock(fileMutex);
+	std::ofstream out(traceFileName.c_str());
+	if (!out)
+		return -1;
+
+	long long pid = getpid();
+	long long written = 0;
+	out << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [" << std::endl
+		<< "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": " << pid
+		<< ", \"args\": {\"name\": \"" << traceProcess << "\"}}";
+
+	std::vector<TraceEvent> events;
+	events.reserve(TRACE_BUFFER_EVENTS);
+	for (unsigned int b = 0; b < traced.size(); ++b)
+	{
+		TraceBuffer *buffer = traced[b];
+		out << "," << std::endl
+			<< "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": " << pid
+			<< ", \"tid\": " << buffer->tid
+			<< ", \"args\": {\"name\": \"" << threads[b] << "\"}}";
+
+		copyEvents(buffer, events);
+		for (unsigned int i = 0; i < events.size(); ++i)
+		{
+			const TraceEvent& event = events[i];
+			out << "," << std::endl << "{\"ph\": \"" << event.phase << "\", \"ts\": ";
+			printMicros(out, event.start);
+			out << ", \"pid\": " << pid << ", \"tid\": " << buffer->tid;
+			if (event.phase == 'X')
+			{
+				out << ", \"name\": \"" << event.name << "\", \"dur\": ";
+				printMicros(out, event.duration);
+				if (event.argName != NULL)
+					out << ", \"args\": {\"" << event.argName << "\": " << event.arg << "}";
+			}
+			else
+			{
+				// Flows bind to the slice that encloses them
+				out << ", \"name\": \"note\", \"cat\": \"" << event.name << "\""
+					<< ", \"id\": \"0x" << std::hex << event.id << std::dec << "\"";
+				if (event.phase == 'f')
+					out << ", \"bp\": \"e\"";
+			}
+			out << "}";
+			++written;
+		}
+	}
+	out << std::endl << "]}" << std::endl;
+
+	return out ? written : -1;
+}
+
+void
+requestTraceWrite(const std::function<void(long long)>& done)
+{
+	if (!tracing())
+	{
+		done(-1);
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(writer->mutex);
+	writer->requests.push_back(done);
+	writer->wake.notify_one();
+}
+
+const std::string&
+traceFile()
+{
+	return traceFileName;
+}
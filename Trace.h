@@ -0,0 +1,97 @@
+/********************************
+
+Trace.h
+Per-note tracing for ControllerMIDI and PlaybackModuleMIDI, written as
+Chrome trace JSON (chrome://tracing, ui.perfetto.dev)
+
+With --trace=<file>, each thread records slices and flow events into
+its own ring buffer, keeping the latest TRACE_BUFFER_EVENTS. Recording
+takes no lock. The buffers are written to the file when a
+<baseName>/status/trace interest arrives, by a low-priority thread of
+their own, and when the process exits. Events still being recorded
+while the buffers are read are left out.
+Without --trace, every trace point costs one relaxed load.
+
+Times come from RtMidi::getTime(), a monotonic clock shared by all
+processes on a host. Traces of a controller and a playback module on
+the same host therefore line up once their traceEvents are
+concatenated. A note is linked across the two processes by a flow id
+made from the controller name, the Data sequence number and the
+note's place in the packet, which both sides know.
+
+********************************/
+
+#ifndef NDNMIDI_TRACE_H
+#define NDNMIDI_TRACE_H
+
+#include <atomic>
+#include <functional>
+#include <string>
+
+// Events kept per thread
+#ifndef TRACE_BUFFER_EVENTS
+#define TRACE_BUFFER_EVENTS 65536
+#endif
+
+extern std::atomic<bool> traceOn;
+
+// Whether trace points should record, checked before taking timestamps
+inline bool tracing()
+{
+	return traceOn.load(std::memory_order_relaxed);
+}
+
+// Handles "--trace=<file>" and returns true,
+// or returns false if the option is not a trace option
+bool parseTraceOption(const std::string& option);
+
+// Usage lines for the trace options
+const char *traceUsage();
+
+// Turns tracing on if --trace was given, naming the process in the
+// trace. Call once from main before starting threads.
+void startTrace(const std::string& processName);
+
+// Names the calling thread in the trace and allocates its buffer up
+// front, so the first event does not fault in memory
+void traceThread(const char *name);
+
+// A new id for a note, also unique among processes on the host
+unsigned long long newTraceId();
+
+// Records a slice from start to end (RtMidi::getTime() nanoseconds),
+// with an optional named argument
+void traceSlice(const char *name, long long start, long long end,
+				const char *argName = NULL, long long arg = 0);
+
+// Records a flow event: 's' starts a flow, 't' is a step, 'f' ends it.
+// Each is bound to the slice around it on the same thread.
+void traceFlow(char phase, const char *category, long long time, unsigned long long id);
+
+// Flow id of a note in the processes on both sides of the network,
+// from the controller name, Data sequence number and note index
+inline unsigned long long traceFlowId(const std::string& source, int seqNo, int index)
+{
+	// FNV-1a, the same in every build
+	unsigned long long hash = 14695981039346656037ULL;
+	for (unsigned int i = 0; i < source.size(); ++i)
+		hash = (hash ^ (unsigned char) source[i]) * 1099511628211ULL;
+	hash = (hash ^ (unsigned int) seqNo) * 1099511628211ULL;
+	hash = (hash ^ (unsigned int) index) * 1099511628211ULL;
+	return hash;
+}
+
+// Writes every buffer to the trace file. Returns the number of events
+// written, or -1 if tracing is off or the file cannot be written.
+long long writeTrace();
+
+// Has the trace writer thread write the file, then call done with what
+// writeTrace() returned. done runs on the writer thread, or right away
+// with -1 if tracing is off. Requests made during a write are answered
+// by the next one.
+void requestTraceWrite(const std::function<void(long long)>& done);
+
+// The file given with --trace
+const std::string& traceFile();
+
+#endif
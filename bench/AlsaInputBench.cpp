@@ -0,0 +1,174 @@
+/********************************
+
+AlsaInputBench.cpp
+Requires ALSA, RtMidi.cpp, and RtMidi.h to compile
+
+Measures the cost of RtMidi input during dense MIDI traffic
+
+Opens a virtual RtMidiIn port, connects an RtMidiOut port to it and
+sends bursts of control change messages through the ALSA sequencer.
+Reports the process CPU time per event (sender included) and the
+number of events per hand-off, once with the input queue
+(waitForMessages) and once with a batch callback, then the heap
+allocations the input handler made after warm-up (see AllocCheck.h)
+
+Usage: AlsaInputBench [events] [burst size]
+
+********************************/
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../RtMidi.h"
+#include "../AllocCheck.h"
+
+using steadyclock = std::chrono::steady_clock;
+
+const std::string BENCH_PORT_NAME = "RtMidi Bench In";
+
+// Most messages taken from the input queue per call
+const unsigned int DRAIN_SIZE = 256;
+
+// Counts what the batch callback receives
+struct BatchCounter
+{
+	std::atomic<unsigned long> events;
+	std::atomic<unsigned long> batches;
+};
+
+void countBatch(const RtMidiMessage */*messages*/, unsigned int count, void *userData)
+{
+	BatchCounter *counter = static_cast<BatchCounter*>(userData);
+	counter->events += count;
+	++counter->batches;
+}
+
+// Connects midiout to the virtual input port of the benchmark
+bool connectToBenchPort(RtMidiOut& midiout)
+{
+	for (unsigned int i = 0; i < midiout.getPortCount(); ++i)
+	{
+		if (midiout.getPortName(i).find(BENCH_PORT_NAME) != std::string::npos)
+		{
+			midiout.openPort(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+// Sends events as bursts of control changes (a CC sweep)
+void sendBursts(RtMidiOut& midiout, unsigned long events, unsigned int burstSize)
+{
+	std::vector<unsigned char> message(3);
+	message[0] = 0xB0;
+	message[1] = 74;
+	for (unsigned long sent = 0; sent < events; )
+	{
+		for (unsigned int i = 0; i < burstSize && sent < events; ++i, ++sent)
+		{
+			message[2] = sent & 0x7F;
+			midiout.sendMessage(&message);
+		}
+		std::this_thread::sleep_for(std::chrono::microseconds(200));
+	}
+}
+
+// CPU time is used rather than wall time, which is dominated by the
+// pauses between bursts
+void report(const std::string& mode, unsigned long events, unsigned long handoffs,
+			std::clock_t cpuTime)
+{
+	double ns = 1e9 * cpuTime / CLOCKS_PER_SEC;
+	std::cout << mode << ": " << events << " events, "
+			  << (events ? ns / events : 0.0) << " CPU ns/event, "
+			  << (handoffs ? (double) events / handoffs : 0.0) << " events/hand-off" << std::endl;
+}
+
+// Drains the input queue with getMessages()
+void benchQueue(RtMidiIn& midiin, RtMidiOut& midiout, unsigned long events, unsigned int burstSize)
+{
+	std::vector<RtMidiMessage> drained(DRAIN_SIZE);
+	unsigned long received = 0, handoffs = 0;
+
+	std::clock_t start = std::clock();
+	std::thread sender(sendBursts, std::ref(midiout), events, burstSize);
+	while (received < events)
+	{
+		unsigned int count = midiin.waitForMessages(drained.data(), DRAIN_SIZE, 1.0);
+		if (count == 0)
+			break;
+		received += count;
+		++handoffs;
+	}
+	sender.join();
+	std::clock_t cpuTime = std::clock() - start;
+
+	report("queue", received, handoffs, cpuTime);
+}
+
+// Receives the events through a batch callback
+void benchBatchCallback(RtMidiIn& midiin, RtMidiOut& midiout, unsigned long events, unsigned int burstSize)
+{
+	BatchCounter counter;
+	counter.events = 0;
+	counter.batches = 0;
+	midiin.setBatchCallback(&countBatch, &counter);
+
+	std::clock_t start = std::clock();
+	sendBursts(midiout, events, burstSize);
+	steadyclock::time_point deadline = steadyclock::now() + std::chrono::seconds(1);
+	while (counter.events < events && steadyclock::now() < deadline)
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+	std::clock_t cpuTime = std::clock() - start;
+
+	midiin.cancelCallback();
+	report("batch callback", counter.events, counter.batches, cpuTime);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned long events = 100000;
+	unsigned int burstSize = 64;
+	if (argc > 1)
+		events = strtoul(argv[1], NULL, 10);
+	if (argc > 2)
+		burstSize = strtoul(argv[2], NULL, 10);
+
+	// Report allocations in the input handler instead of aborting
+	allocCheckFatal(false);
+
+	try
+	{
+		RtMidiIn midiin(RtMidi::LINUX_ALSA, "RtMidi Bench", 4096);
+		RtMidiOut midiout(RtMidi::LINUX_ALSA, "RtMidi Bench");
+
+		midiin.ignoreTypes(true, true, true);
+		midiin.openVirtualPort(BENCH_PORT_NAME);
+		if (!connectToBenchPort(midiout))
+		{
+			std::cerr << "Could not find the benchmark input port!" << std::endl;
+			return 1;
+		}
+
+		std::cout << events << " events in bursts of " << burstSize << std::endl;
+		benchQueue(midiin, midiout, events, burstSize);
+		benchBatchCallback(midiin, midiout, events, burstSize);
+
+		std::cout << "Steady-state regions: ";
+		printAllocReport(std::cout);
+		std::cout << std::endl;
+	}
+	catch (const RtMidiError& e)
+	{
+		e.printMessage();
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,183 @@
+/********************************
+
+BenchSupport.h
+Helpers shared by the benchmarks that run the applications in process
+
+********************************/
+
+#ifndef NDNMIDI_BENCH_SUPPORT_H
+#define NDNMIDI_BENCH_SUPPORT_H
+
+#include <ndn-cxx/util/dummy-client-face.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "../RtMidi.h"
+#include "../Controller.h"
+#include "../PlaybackModule.h"
+
+// Warm-up notes use another status so they are not measured
+const unsigned char NOTE_STATUS = 0x90;
+const unsigned char WARMUP_STATUS = 0xA0;
+
+// Notes carry their number in the two data bytes
+const unsigned int MAX_NOTES = 1 << 14;
+
+// Exposes the packet handlers of the applications and what their own
+// threads would do
+class BenchController : public Controller
+{
+public:
+	using Controller::Controller;
+	using Controller::onInterest;
+	using Controller::onData;
+	using Controller::sendData;
+	using Controller::heartbeat;
+};
+
+class BenchPlaybackModule : public PlaybackModule
+{
+public:
+	using PlaybackModule::PlaybackModule;
+	using PlaybackModule::onInterest;
+	using PlaybackModule::onData;
+	using PlaybackModule::requestNext;
+	using PlaybackModule::findConnection;
+	using PlaybackModule::checkConnections;
+};
+
+// The packets are logged through the logger, which the benchmarks do
+// not start, but connection setup still prints to std::cout. While a
+// ResultStream exists, std::cout is discarded and the results go where
+// std::cout went before.
+class ResultStream : public std::ostream
+{
+public:
+	ResultStream()
+		: std::ostream(std::cout.rdbuf())
+		, m_discard("/dev/null")
+	{
+		std::cout.rdbuf(m_discard.rdbuf());
+	}
+
+	~ResultStream()
+	{
+		std::cout.rdbuf(rdbuf());
+	}
+
+private:
+	std::ofstream m_discard;
+};
+
+// A note carrying its number in the two data bytes
+inline RtMidiMessage makeNote(unsigned char status, unsigned int note)
+{
+	RtMidiMessage message;
+	unsigned char bytes[3] = { status, (unsigned char)((note >> 7) & 0x7F), (unsigned char)(note & 0x7F) };
+	message.assign(bytes, 3);
+	return message;
+}
+
+// When each note arrived on the output bus, -1 until it does, and
+// whether a warm-up note came through
+struct Arrivals
+{
+	Arrivals(unsigned int notes)
+		: times(notes, -1)
+		, count(0)
+		, warm(false)
+	{
+	}
+
+	std::vector<long long> times;
+	std::atomic<unsigned int> count;
+	std::atomic<bool> warm;
+	// The clock arrivals are timed on, if not the messages' time stamps
+	std::function<long long()> now;
+};
+
+// Message callback of the output bus, with Arrivals as its user data
+inline void recordArrival(const RtMidiMessage& message, void *userData)
+{
+	Arrivals *arrivals = static_cast<Arrivals*>(userData);
+	if (message.size() < 3)
+		return;
+
+	if ((message[0] & 0xF0) == WARMUP_STATUS)
+	{
+		arrivals->warm = true;
+		return;
+	}
+
+	unsigned int note = (message[1] << 7) | message[2];
+	if (note < arrivals->times.size() && arrivals->times[note] < 0)
+	{
+		arrivals->times[note] = arrivals->now ? arrivals->now() : message.absoluteTime;
+		++arrivals->count;
+	}
+}
+
+// Hands the packets one face sends to the other, as the forwarder
+// between the two applications would
+inline void linkFaces(boost::asio::io_service& io, ndn::util::DummyClientFace& from,
+					  ndn::util::DummyClientFace& to)
+{
+	ndn::Name localhost("/localhost");
+	from.onSendInterest.connect([&io, &to, localhost] (const ndn::Interest& interest) {
+		// Prefix registrations are answered by the face itself
+		if (!localhost.isPrefixOf(interest.getName()))
+			io.post([&to, interest] { to.receive(interest); });
+	});
+	from.onSendData.connect([&io, &to] (const ndn::Data& data) {
+		io.post([&to, data] { to.receive(data); });
+	});
+}
+
+// Sleeps until the given RtMidi::getTime() time
+inline void sleepUntil(long long time)
+{
+	long long delay = time - RtMidi::getTime();
+	if (delay > 0)
+		std::this_thread::sleep_for(std::chrono::nanoseconds(delay));
+}
+
+// Nearest-rank percentile of sorted values, in microseconds
+inline double percentile(const std::vector<long long>& sorted, double p)
+{
+	if (sorted.empty())
+		return 0.0;
+	size_t rank = (size_t)(p * sorted.size() + 0.999999);
+	if (rank < 1)
+		rank = 1;
+	return sorted[std::min(rank, sorted.size()) - 1] / 1000.0;
+}
+
+// Prints a JSON object summarizing values given in nanoseconds, in
+// microseconds; sorts the values
+inline void printSummary(std::ostream& out, std::vector<long long>& values)
+{
+	std::sort(values.begin(), values.end());
+	double mean = 0.0;
+	for (size_t i = 0; i < values.size(); ++i)
+		mean += values[i] / 1000.0;
+	if (!values.empty())
+		mean /= values.size();
+
+	out << "{\"samples\": " << values.size()
+		<< ", \"min\": " << (values.empty() ? 0.0 : values.front() / 1000.0)
+		<< ", \"mean\": " << mean
+		<< ", \"p50\": " << percentile(values, 0.5)
+		<< ", \"p99\": " << percentile(values, 0.99)
+		<< ", \"p99_9\": " << percentile(values, 0.999)
+		<< ", \"max\": " << (values.empty() ? 0.0 : values.back() / 1000.0)
+		<< "}";
+}
+
+#endif
@@ -0,0 +1,455 @@
+/********************************
+
+ControllerSwarm.cpp
+Requires ndn-cxx, RtMidi.cpp, and RtMidi.h to compile
+
+Load generator: many simulated controllers against one playback module
+
+Runs N Controllers in one process, each fed by its own player that
+plays notes, chords, control changes and bursts into a loopback bus
+at configurable rates.  By default the playback module runs in the
+same process on DummyClientFaces and its output is read back from a
+loopback bus; with --remote the controllers use the local forwarder
+to reach a running PlaybackModuleMIDI, whose output can be read from
+a MIDI port given with --listen.  Reports throughput, drops and the
+latency of each controller as one JSON object, with the heap
+allocations the steady-state regions of AllocCheck.h made after
+warm-up.  Exits with status 2 if there were any.
+
+Every message carries its controller and a sequence number in its two
+data bytes, so messages still in flight after SEQUENCE_SIZE newer ones
+from the same controller are counted as dropped.
+
+Usage: ControllerSwarm [--controllers=N] [--note-rate=HZ] [--chord=K]
+                       [--cc-rate=HZ] [--burst=B] [--duration=S]
+                       [--remote=NAME] [--listen=PORT] [--realtime] [--cores=LIST]
+
+********************************/
+
+#include <ndn-cxx/util/dummy-client-face.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../Controller.h"
+#include "../PlaybackModule.h"
+#include "../AllocCheck.h"
+#include "BenchSupport.h"
+
+const std::string PLAYBACK_NAME = "swarm-playback";
+const std::string PROJECT_NAME = "swarm-proj";
+
+// Loopback buses into the controllers and out of the playback module
+const std::string KEYS_BUS = "NDN-MIDI Swarm Keys ";
+const std::string SOUND_BUS = "NDN-MIDI Swarm Sound";
+
+// Control changes are sent beside the notes of BenchSupport.h
+const unsigned char CC_STATUS = 0xB0;
+
+// Sequence numbers per controller that fit beside the controller number
+const unsigned int SEQUENCE_SIZE = 1 << 10;
+
+struct SwarmOptions
+{
+	unsigned int controllers = 4;
+	double noteRate = 10.0;     // onsets per second
+	unsigned int chord = 1;     // notes per onset
+	double ccRate = 0.0;        // control changes per second
+	unsigned int burst = 1;     // onsets played at once
+	double duration = 10.0;     // seconds
+	std::string remote;         // playback module to use instead of our own
+	std::string listen;         // port to read the remote playback module from
+};
+
+// One simulated controller and what happened to its messages
+struct Player
+{
+	unsigned int id;
+	std::string name;
+	Controller *controller;
+	RtMidiOut *keys;
+	std::atomic<bool> warm;
+
+	// Send times by sequence number, 0 once received
+	std::atomic<long long> sent[SEQUENCE_SIZE];
+	unsigned int nextSequence;
+	unsigned long sentCount;
+
+	std::mutex latencyMutex;
+	std::vector<long long> latency;
+};
+
+typedef std::vector<std::unique_ptr<Player>> PlayerList;
+
+void send(Player& player, unsigned char status)
+{
+	unsigned int sequence = player.nextSequence++ % SEQUENCE_SIZE;
+	std::vector<unsigned char> message(3);
+	message[0] = status;
+	message[1] = (player.id << 3) | (sequence >> 7);
+	message[2] = sequence & 0x7F;
+	player.sent[sequence] = RtMidi::getTime();
+	player.keys->sendMessage(&message);
+	++player.sentCount;
+}
+
+void onSound(const RtMidiMessage& message, void *userData)
+{
+	PlayerList& players = *static_cast<PlayerList*>(userData);
+	if (message.size() < 3)
+		return;
+
+	unsigned int id = message[1] >> 3;
+	if (id >= players.size())
+		return;
+	Player& player = *players[id];
+
+	if ((message[0] & 0xF0) == WARMUP_STATUS)
+	{
+		player.warm = true;
+		return;
+	}
+
+	unsigned int sequence = ((message[1] & 0x07) << 7) | message[2];
+	long long sent = player.sent[sequence].exchange(0);
+	if (sent == 0)
+		return;
+	std::lock_guard<std::mutex> lock(player.latencyMutex);
+	player.latency.push_back(message.absoluteTime - sent);
+}
+
+// Plays the configured pattern from start to end.  Onsets come in
+// bursts of options.burst, spaced to keep the average note rate, and
+// control changes are interleaved at their own rate.
+void play(Player& player, const SwarmOptions& options, long long start, long long end)
+{
+	enterThread(ROLE_MIDI, player.name.c_str());
+	long long burstSpacing = (long long)(1e9 * options.burst / options.noteRate);
+	long long ccSpacing = options.ccRate > 0 ? (long long)(1e9 / options.ccRate) : 0;
+
+	// Spread the controllers over the first period
+	long long nextBurst = start + burstSpacing * player.id / options.controllers;
+	long long nextCC = ccSpacing ? start + ccSpacing * player.id / options.controllers : end;
+
+	while (true)
+	{
+		long long due = std::min(nextBurst, nextCC);
+		if (due >= end)
+			break;
+		sleepUntil(due);
+
+		if (due == nextBurst)
+		{
+			for (unsigned int onset = 0; onset < options.burst; ++onset)
+				for (unsigned int note = 0; note < options.chord; ++note)
+					send(player, NOTE_STATUS);
+			nextBurst += burstSpacing;
+		}
+		else
+		{
+			send(player, CC_STATUS);
+			nextCC += ccSpacing;
+		}
+	}
+}
+
+bool openListenPort(RtMidiIn& midiin, const std::string& name)
+{
+	for (unsigned int i = 0; i < midiin.getPortCount(); ++i)
+	{
+		if (midiin.getPortName(i).find(name) != std::string::npos)
+		{
+			midiin.openPort(i);
+			return true;
+		}
+	}
+	return false;
+}
+
+void printUsage(const char *program)
+{
+	std::cerr << "Usage: " << program << " [options]" << std::endl
+			  << "  --controllers=N  simulated controllers, 1 to " << MAX_CHANNELS << " (default 4)" << std::endl
+			  << "  --note-rate=HZ   note onsets per second per controller (default 10)" << std::endl
+			  << "  --chord=K        notes per onset (default 1)" << std::endl
+			  << "  --cc-rate=HZ     control changes per second per controller (default 0)" << std::endl
+			  << "  --burst=B        play onsets in bursts of B at the same average rate (default 1)" << std::endl
+			  << "  --duration=S     seconds to play (default 10)" << std::endl
+			  << "  --remote=NAME    use the running playback module NAME instead of an in-process one" << std::endl
+			  << "  --listen=PORT    with --remote, measure on the MIDI port it plays to" << std::endl
+			  << realtimeUsage();
+}
+
+bool parseOption(const std::string& option, SwarmOptions& options)
+{
+	size_t equals = option.find('=');
+	if (equals == std::string::npos)
+		return false;
+	std::string key = option.substr(0, equals);
+	const char *value = option.c_str() + equals + 1;
+
+	if (key == "--controllers")
+		options.controllers = strtoul(value, NULL, 10);
+	else if (key == "--note-rate")
+		options.noteRate = strtod(value, NULL);
+	else if (key == "--chord")
+		options.chord = strtoul(value, NULL, 10);
+	else if (key == "--cc-rate")
+		options.ccRate = strtod(value, NULL);
+	else if (key == "--burst")
+		options.burst = strtoul(value, NULL, 10);
+	else if (key == "--duration")
+		options.duration = strtod(value, NULL);
+	else if (key == "--remote")
+		options.remote = value;
+	else if (key == "--listen")
+		options.listen = value;
+	else
+		return false;
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	SwarmOptions options;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string option = argv[i];
+		if (!parseOption(option, options) && !parseRealtimeOption(option))
+		{
+			std::cerr << "Unknown option " << option << std::endl;
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+	if (options.controllers < 1 || options.controllers > MAX_CHANNELS
+		|| options.noteRate <= 0 || options.chord < 1 || options.burst < 1
+		|| options.ccRate < 0 || options.duration <= 0)
+	{
+		printUsage(argv[0]);
+		return 1;
+	}
+	bool inProcess = options.remote.empty();
+	bool measured = inProcess || !options.listen.empty();
+
+	ResultStream results;
+
+	// Count allocations in the steady-state regions instead of aborting,
+	// so the results still get printed
+	allocCheckFatal(false);
+
+	startRealtime();
+	enterThread(ROLE_TIMER, "main");
+
+	try
+	{
+		PlayerList players;
+		std::string playbackName = inProcess ? PLAYBACK_NAME : options.remote;
+
+		// Where the playback module's output is read
+		std::unique_ptr<RtMidiIn> sound;
+		if (inProcess)
+		{
+			sound.reset(new RtMidiIn(RtMidi::RTMIDI_LOOPBACK, "NDN-MIDI Swarm"));
+			sound->setMessageCallback(&onSound, &players);
+			sound->openVirtualPort(SOUND_BUS);
+		}
+		else if (measured)
+		{
+			sound.reset(new RtMidiIn(RtMidi::UNSPECIFIED, "NDN-MIDI Swarm"));
+			sound->setMessageCallback(&onSound, &players);
+			if (!openListenPort(*sound, options.listen))
+			{
+				std::cerr << "No MIDI input port named " << options.listen << std::endl;
+				return 1;
+			}
+		}
+
+		// Faces: linked DummyClientFaces on one io_service, or one face
+		// to the forwarder per controller
+		boost::asio::io_service io;
+		ndn::util::DummyClientFace::Options faceOptions(false, true);
+		std::unique_ptr<ndn::util::DummyClientFace> playbackFace;
+		std::vector<std::unique_ptr<ndn::Face>> faces;
+		std::unique_ptr<PlaybackModule> playbackModule;
+		if (inProcess)
+		{
+			playbackFace.reset(new ndn::util::DummyClientFace(io, faceOptions));
+			playbackModule.reset(new PlaybackModule(*playbackFace, PLAYBACK_NAME, PROJECT_NAME));
+			playbackModule->setViewingMenu();
+			playbackModule->midiout = new RtMidiOut(RtMidi::RTMIDI_LOOPBACK);
+			playbackModule->midiout->setThreadOptions(realtimeMidiOptions());
+			playbackModule->midiout->openVirtualPort(SOUND_BUS);
+			playbackModule->message.assign(3, 0);
+		}
+
+		std::vector<std::thread> threads;
+		for (unsigned int i = 0; i < options.controllers; ++i)
+		{
+			players.push_back(std::unique_ptr<Player>(new Player));
+			Player& player = *players.back();
+			player.id = i;
+			player.name = "swarm-" + std::to_string(i);
+			player.warm = false;
+			for (unsigned int s = 0; s < SEQUENCE_SIZE; ++s)
+				player.sent[s] = 0;
+			player.nextSequence = 0;
+			player.sentCount = 0;
+
+			if (inProcess)
+			{
+				ndn::util::DummyClientFace *face = new ndn::util::DummyClientFace(io, faceOptions);
+				linkFaces(io, *face, *playbackFace);
+				linkFaces(io, *playbackFace, *face);
+				faces.push_back(std::unique_ptr<ndn::Face>(face));
+			}
+			else
+				faces.push_back(std::unique_ptr<ndn::Face>(new ndn::Face()));
+
+			player.controller = new Controller(*faces.back(), playbackName, player.name, PROJECT_NAME);
+			player.controller->midiin = new RtMidiIn(RtMidi::RTMIDI_LOOPBACK);
+			player.controller->midiin->ignoreTypes(true, true, true);
+			player.controller->midiin->openVirtualPort(KEYS_BUS + std::to_string(i));
+			player.keys = new RtMidiOut(RtMidi::RTMIDI_LOOPBACK);
+			player.keys->openVirtualPort(KEYS_BUS + std::to_string(i));
+			threads.push_back(std::thread(midiLoopBurst, player.controller->midiin, std::ref(*player.controller)));
+			// Each sender sleeps until its controller has something to send,
+			// as in ControllerMIDI
+			threads.push_back(std::thread(output_sender, std::ref(*player.controller)));
+
+			if (!inProcess)
+			{
+				ndn::Face *face = faces.back().get();
+				threads.push_back(std::thread([face] {
+					enterThread(ROLE_NETWORK, "face");
+					face->processEvents();
+				}));
+			}
+		}
+
+		boost::asio::io_service::work work(io);
+		if (inProcess)
+		{
+			threads.push_back(std::thread([&io] {
+				enterThread(ROLE_NETWORK, "network");
+				io.run();
+			}));
+		}
+
+		// Wait for every controller to connect: warm-up messages come
+		// through once its heartbeat was answered and interests are out
+		if (measured)
+		{
+			std::vector<unsigned char> message(3);
+			message[0] = WARMUP_STATUS;
+			message[2] = 0;
+			long long giveUp = RtMidi::getTime() + 15000000000LL;
+			unsigned int connected = 0;
+			while (connected < players.size() && RtMidi::getTime() < giveUp)
+			{
+				connected = 0;
+				for (unsigned int i = 0; i < players.size(); ++i)
+				{
+					if (players[i]->warm)
+						++connected;
+					else
+					{
+						message[1] = i << 3;
+						players[i]->keys->sendMessage(&message);
+					}
+				}
+				std::this_thread::sleep_for(std::chrono::milliseconds(20));
+			}
+			if (connected < players.size())
+			{
+				std::cerr << "Only " << connected << " of " << players.size()
+						  << " controllers connected" << std::endl;
+				_exit(1);
+			}
+		}
+		else
+			std::this_thread::sleep_for(std::chrono::seconds(2));
+
+		long long start = RtMidi::getTime() + 100000000LL;
+		long long end = start + (long long)(options.duration * 1e9);
+		std::vector<std::thread> playing;
+		for (unsigned int i = 0; i < players.size(); ++i)
+			playing.push_back(std::thread(play, std::ref(*players[i]), std::cref(options), start, end));
+		for (unsigned int i = 0; i < playing.size(); ++i)
+			playing[i].join();
+
+		// Give the stragglers a second
+		std::this_thread::sleep_for(std::chrono::seconds(1));
+
+		unsigned long sent = 0, received = 0;
+		std::vector<long long> latency;
+		std::ostringstream perController;
+		for (unsigned int i = 0; i < players.size(); ++i)
+		{
+			Player& player = *players[i];
+			std::lock_guard<std::mutex> lock(player.latencyMutex);
+			sent += player.sentCount;
+			received += player.latency.size();
+			latency.insert(latency.end(), player.latency.begin(), player.latency.end());
+
+			perController << (i ? ", " : "") << "{\"name\": \"" << player.name << "\""
+						  << ", \"sent\": " << player.sentCount;
+			if (measured)
+			{
+				perController << ", \"received\": " << player.latency.size()
+							  << ", \"dropped\": " << player.sentCount - player.latency.size()
+							  << ", \"latency_us\": ";
+				printSummary(perController, player.latency);
+			}
+			perController << "}";
+		}
+
+		results << "{\"benchmark\": \"controller_swarm\""
+				<< ", \"mode\": \"" << (inProcess ? "in-process" : "remote") << "\""
+				<< ", \"controllers\": " << options.controllers
+				<< ", \"note_rate\": " << options.noteRate
+				<< ", \"chord\": " << options.chord
+				<< ", \"cc_rate\": " << options.ccRate
+				<< ", \"burst\": " << options.burst
+				<< ", \"duration_s\": " << options.duration
+				<< ", \"sent\": " << sent
+				<< ", \"sent_per_s\": " << sent / options.duration;
+		if (measured)
+		{
+			results << ", \"received\": " << received
+					<< ", \"dropped\": " << sent - received
+					<< ", \"received_per_s\": " << received / options.duration
+					<< ", \"latency_us\": ";
+			printSummary(results, latency);
+		}
+		results << ", \"allocations_per_message\": " << (sent > 0 ? (double) regionAllocations() / sent : 0.0)
+				<< ", \"allocations\": ";
+		printAllocReport(results);
+		results << ", \"per_controller\": [" << perController.str() << "]}" << std::endl;
+
+		// The application threads never return, so leave without
+		// unwinding them
+		if (allocViolations() > 0)
+		{
+			std::cerr << "Steady-state regions allocated after warm-up" << std::endl;
+			_exit(2);
+		}
+		_exit(0);
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,241 @@
+/********************************
+
+EndToEndBench.cpp
+Requires ndn-cxx, RtMidi.cpp, and RtMidi.h to compile
+
+Measures note latency and jitter through Controller and PlaybackModule
+
+Runs both in one process.  Their faces are two DummyClientFaces that
+hand each other the packets they send on one io_service, standing in
+for the forwarder, and MIDI goes through loopback buses: the benchmark
+plays notes into the controller's input bus and listens on the playback
+module's output bus.  Latency is the time from a note entering the
+controller to the playback module sending it; jitter is how much the
+spacing of consecutive notes changed on the way.  Prints one JSON
+object so that builds can be compared, including the heap allocations
+the steady-state regions of AllocCheck.h made after warm-up.  Exits
+with status 2 if there were any.
+
+Usage: EndToEndBench [--notes=N] [--interval=US] [--pattern=steady|chord|burst]
+                     [--realtime] [--cores=LIST] [--trace=FILE]
+
+With --trace, both sides record into one trace, so each note's path
+from the input bus to the output bus is on a single timeline.
+
+********************************/
+
+#include <ndn-cxx/util/dummy-client-face.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../Controller.h"
+#include "../PlaybackModule.h"
+#include "../AllocCheck.h"
+#include "BenchSupport.h"
+
+const std::string CONTROLLER_NAME = "bench-controller";
+const std::string PLAYBACK_NAME = "bench-playback";
+const std::string PROJECT_NAME = "bench-proj";
+
+// Loopback buses into the controller and out of the playback module
+const std::string KEYS_BUS = "NDN-MIDI Bench Keys";
+const std::string SOUND_BUS = "NDN-MIDI Bench Sound";
+
+void printUsage(const char *program)
+{
+	std::cerr << "Usage: " << program << " [options]" << std::endl
+			  << "  --notes=N     number of notes to measure (default 2000)" << std::endl
+			  << "  --interval=US time between note onsets in microseconds (default 5000)" << std::endl
+			  << "  --pattern=P   steady: one note per onset, chord: four notes per onset," << std::endl
+			  << "                burst: sixteen notes every sixteen intervals" << std::endl
+			  << realtimeUsage()
+			  << traceUsage();
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int notes = 2000;
+	long long interval = 5000;
+	std::string pattern = "steady";
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string option = argv[i];
+		if (option.compare(0, 8, "--notes=") == 0)
+			notes = strtoul(option.c_str() + 8, NULL, 10);
+		else if (option.compare(0, 11, "--interval=") == 0)
+			interval = strtoll(option.c_str() + 11, NULL, 10);
+		else if (option.compare(0, 10, "--pattern=") == 0)
+			pattern = option.substr(10);
+		else if (!parseRealtimeOption(option) && !parseTraceOption(option))
+		{
+			std::cerr << "Unknown option " << option << std::endl;
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+
+	unsigned int groupSize = 1;
+	long long groupSpacing = interval;
+	if (pattern == "chord")
+		groupSize = 4;
+	else if (pattern == "burst")
+	{
+		groupSize = 16;
+		groupSpacing = interval * 16;
+	}
+	else if (pattern != "steady")
+	{
+		std::cerr << "Unknown pattern " << pattern << std::endl;
+		printUsage(argv[0]);
+		return 1;
+	}
+	if (notes == 0 || notes > MAX_NOTES || interval <= 0)
+	{
+		std::cerr << "Need 1 to " << MAX_NOTES << " notes and a positive interval" << std::endl;
+		return 1;
+	}
+
+	ResultStream results;
+
+	// Count allocations in the steady-state regions instead of aborting,
+	// so the results still get printed
+	allocCheckFatal(false);
+
+	startRealtime();
+	startTrace("EndToEndBench");
+	enterThread(ROLE_MIDI, "main");
+
+	try
+	{
+		boost::asio::io_service io;
+		ndn::util::DummyClientFace::Options options(false, true);
+		ndn::util::DummyClientFace controllerFace(io, options);
+		ndn::util::DummyClientFace playbackFace(io, options);
+		linkFaces(io, controllerFace, playbackFace);
+		linkFaces(io, playbackFace, controllerFace);
+
+		Arrivals arrivals(notes);
+
+		// Output side first, so the buses exist when the apps attach
+		RtMidiIn sound(RtMidi::RTMIDI_LOOPBACK, "NDN-MIDI Bench");
+		sound.setMessageCallback(&recordArrival, &arrivals);
+		sound.openVirtualPort(SOUND_BUS);
+		RtMidiOut keys(RtMidi::RTMIDI_LOOPBACK, "NDN-MIDI Bench");
+		keys.openVirtualPort(KEYS_BUS);
+
+		PlaybackModule playbackModule(playbackFace, PLAYBACK_NAME, PROJECT_NAME);
+		playbackModule.setViewingMenu();
+		playbackModule.midiout = new RtMidiOut(RtMidi::RTMIDI_LOOPBACK);
+		playbackModule.midiout->setThreadOptions(realtimeMidiOptions());
+		playbackModule.midiout->openVirtualPort(SOUND_BUS);
+		playbackModule.message.assign(3, 0);
+
+		Controller controller(controllerFace, PLAYBACK_NAME, CONTROLLER_NAME, PROJECT_NAME);
+		controller.midiin = new RtMidiIn(RtMidi::RTMIDI_LOOPBACK);
+		controller.midiin->ignoreTypes(true, true, true);
+		controller.midiin->openVirtualPort(KEYS_BUS);
+
+		boost::asio::io_service::work work(io);
+		std::thread network([&io] {
+			enterThread(ROLE_NETWORK, "network");
+			io.run();
+		});
+		std::thread midiThread(midiLoopBurst, controller.midiin, std::ref(controller));
+		std::thread outputThread(output_sender, std::ref(controller));
+
+		// Play warm-up notes until one comes through, which means the
+		// heartbeat connected the two and the first interests are out
+		std::vector<unsigned char> message(3);
+		message[0] = WARMUP_STATUS;
+		long long giveUp = RtMidi::getTime() + 10000000000LL;
+		while (!arrivals.warm && RtMidi::getTime() < giveUp)
+		{
+			keys.sendMessage(&message);
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		}
+		if (!arrivals.warm)
+		{
+			std::cerr << "Controller and playback module did not connect" << std::endl;
+			_exit(1);
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+		// Play the pattern, noting when each note entered the controller
+		std::vector<long long> sent(notes);
+		long long due = RtMidi::getTime() + interval * 1000;
+		message[0] = NOTE_STATUS;
+		for (unsigned int note = 0; note < notes; due += groupSpacing * 1000)
+		{
+			sleepUntil(due);
+			for (unsigned int i = 0; i < groupSize && note < notes; ++i, ++note)
+			{
+				message[1] = (note >> 7) & 0x7F;
+				message[2] = note & 0x7F;
+				sent[note] = RtMidi::getTime();
+				keys.sendMessage(&message);
+			}
+		}
+
+		// Wait for the stragglers
+		long long deadline = RtMidi::getTime() + 2000000000LL;
+		while (arrivals.count < notes && RtMidi::getTime() < deadline)
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+		// Latency of each note, and the change in spacing between
+		// consecutive notes that both arrived
+		std::vector<long long> latency, jitter;
+		for (unsigned int note = 0; note < notes; ++note)
+		{
+			if (arrivals.times[note] < 0)
+				continue;
+			latency.push_back(arrivals.times[note] - sent[note]);
+			if (note > 0 && arrivals.times[note - 1] >= 0)
+			{
+				long long change = (arrivals.times[note] - arrivals.times[note - 1])
+					- (sent[note] - sent[note - 1]);
+				jitter.push_back(change < 0 ? -change : change);
+			}
+		}
+
+		results << "{\"benchmark\": \"end_to_end\""
+				<< ", \"pattern\": \"" << pattern << "\""
+				<< ", \"notes\": " << notes
+				<< ", \"interval_us\": " << interval
+				<< ", \"received\": " << latency.size()
+				<< ", \"lost\": " << notes - latency.size()
+				<< ", ";
+		results << "\"latency_us\": ";
+		printSummary(results, latency);
+		results << ", \"jitter_us\": ";
+		printSummary(results, jitter);
+		results << ", \"allocations_per_note\": " << (double) regionAllocations() / notes
+				<< ", \"allocations\": ";
+		printAllocReport(results);
+		results << "}" << std::endl;
+
+		// The application threads never return, so leave without
+		// unwinding them
+		writeTrace();
+		if (allocViolations() > 0)
+		{
+			std::cerr << "Steady-state regions allocated after warm-up" << std::endl;
+			_exit(2);
+		}
+		_exit(0);
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,197 @@
+/********************************
+
+HotPathBench.cpp
+Requires ndn-cxx, RtMidi.cpp, and RtMidi.h to compile
+
+Measures the stages that run for every note on their own
+
+Calls the Controller and PlaybackModule packet handlers directly on
+DummyClientFaces (running the face's io_service after each call, so
+queued sends are included), and the RtMidi input queue, and reports
+the wall time and the number of heap allocations per operation, then
+the allocations each steady-state region of AllocCheck.h made after
+warm-up. When end-to-end latency regresses, this tells which stage to
+blame.
+
+Usage: HotPathBench [milliseconds per benchmark]
+
+Keep each benchmark under MAX_INACTIVE_TIME seconds, or the playback
+module drops the controller's connection while it is being measured.
+
+********************************/
+
+#include <ndn-cxx/util/dummy-client-face.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "../Controller.h"
+#include "../PlaybackModule.h"
+#include "../AllocCheck.h"
+#include "BenchSupport.h"
+
+using steadyclock = std::chrono::steady_clock;
+
+const std::string CONTROLLER_NAME = "bench-controller";
+const std::string PLAYBACK_NAME = "bench-playback";
+const std::string PROJECT_NAME = "bench-proj";
+
+// Notes per data packet, the most replyInterest() sends at once
+const unsigned int NOTES_PER_PACKET = 10;
+
+// Results, while std::cout is discarded
+static ResultStream results;
+
+// Runs op in growing rounds until the rounds together took at least
+// the given time, then prints the cost of one call
+template <class Op>
+void measure(const char *name, long long milliseconds, Op op)
+{
+	unsigned long total = 0;
+	unsigned long rounds = 1;
+	steadyclock::duration elapsed(0);
+	unsigned long long allocations = 0;
+	while (elapsed < std::chrono::milliseconds(milliseconds))
+	{
+		unsigned long long before = threadAllocations();
+		steadyclock::time_point start = steadyclock::now();
+		for (unsigned long i = 0; i < rounds; ++i)
+			op();
+		elapsed += steadyclock::now() - start;
+		allocations += threadAllocations() - before;
+		total += rounds;
+		rounds *= 2;
+	}
+
+	double ns = std::chrono::duration<double, std::nano>(elapsed).count();
+	results << name << ": " << ns / total << " ns/op, "
+		<< (double) allocations / total << " allocs/op ("
+		<< total << " ops)" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+	long long milliseconds = 500;
+	if (argc > 1)
+		milliseconds = strtoll(argv[1], NULL, 10);
+
+	// Report allocations in the steady-state regions at the end
+	// instead of aborting on the first
+	allocCheckFatal(false);
+
+	try
+	{
+		boost::asio::io_service io;
+		ndn::util::DummyClientFace::Options options(false, false);
+		ndn::util::DummyClientFace controllerFace(io, options);
+		ndn::util::DummyClientFace playbackFace(io, options);
+		ndn::Name controllerPrefix("/topo-prefix/" + CONTROLLER_NAME + "/midi-ndn/" + PROJECT_NAME);
+		ndn::Name playbackPrefix("/topo-prefix/" + PLAYBACK_NAME + "/midi-ndn/" + PROJECT_NAME);
+
+		// Controller, connected by a heartbeat reply
+		BenchController controller(controllerFace, PLAYBACK_NAME, CONTROLLER_NAME, PROJECT_NAME);
+		controller.onData(ndn::Data(ndn::Name(playbackPrefix).append(CONTROLLER_NAME + "/heartbeat")));
+		io.poll();
+
+		// Playback module with a connection from the controller,
+		// playing into a loopback bus nobody listens to
+		BenchPlaybackModule playbackModule(playbackFace, PLAYBACK_NAME, PROJECT_NAME);
+		playbackModule.setViewingMenu();
+		playbackModule.midiout = new RtMidiOut(RtMidi::RTMIDI_LOOPBACK);
+		playbackModule.midiout->openVirtualPort("NDN-MIDI Hot Path Bench");
+		playbackModule.message.assign(3, 0);
+
+		// The controller's heartbeat sets up the connection and keeps
+		// the connection monitor from closing it
+		ndn::Interest heartbeat(ndn::Name(playbackPrefix).append(CONTROLLER_NAME + "/heartbeat"));
+		playbackModule.onInterest(heartbeat);
+		io.poll();
+
+		// A full packet of notes, as the controller sends them
+		char content[NOTES_PER_PACKET * 3];
+		for (unsigned int i = 0; i < NOTES_PER_PACKET; ++i)
+		{
+			content[i * 3] = (char) 0x90;
+			content[i * 3 + 1] = (char)(60 + i);
+			content[i * 3 + 2] = 100;
+		}
+
+		int controllerSeqNo = 0;
+		measure("Controller::replyInterest (10 notes, includes sendData)", milliseconds, [&] {
+			controller.onInterest(ndn::Interest(ndn::Name(controllerPrefix).appendSequenceNumber(controllerSeqNo++)));
+			for (unsigned int i = 0; i < NOTES_PER_PACKET; ++i)
+				controller.addInput(makeNote(NOTE_STATUS, i));
+			controller.replyInterest();
+			io.poll();
+		});
+
+		int dataSeqNo = 0;
+		measure("Controller::sendData (name, content, sign, put)", milliseconds, [&] {
+			controller.sendData(ndn::Name(controllerPrefix).appendSequenceNumber(dataSeqNo++),
+								content, sizeof(content));
+			io.poll();
+		});
+
+		// Each packet advances the window by one, so the next expected
+		// sequence number is always the count of packets so far
+		int playbackSeqNo = 0;
+		playbackModule.onInterest(heartbeat);
+		measure("PlaybackModule::onData (10 notes, includes requestNext)", milliseconds, [&] {
+			ndn::Data data(ndn::Name(controllerPrefix).appendSequenceNumber(playbackSeqNo++));
+			data.setContent(reinterpret_cast<const uint8_t*>(content), sizeof(content));
+			playbackModule.onData(data);
+			io.poll();
+		});
+
+		playbackModule.onInterest(heartbeat);
+		MIDIControlBlock& connection = *playbackModule.findConnection(controllerPrefix.get(-3));
+		measure("PlaybackModule::requestNext", milliseconds, [&] {
+			playbackModule.requestNext(connection);
+			io.poll();
+		});
+
+		// RtMidi input queue on its own
+		MidiInApi::MidiQueue queue;
+		queue.allocate(1024);
+		RtMidiMessage note = makeNote(NOTE_STATUS, 0);
+		measure("MidiQueue push + peek + pop", milliseconds, [&] {
+			queue.push(note);
+			queue.peek();
+			queue.pop();
+		});
+
+		// And behind the API, fed through a loopback bus
+		RtMidiIn midiin(RtMidi::RTMIDI_LOOPBACK, "NDN-MIDI Hot Path Bench", 1024);
+		RtMidiOut midiout(RtMidi::RTMIDI_LOOPBACK, "NDN-MIDI Hot Path Bench");
+		midiin.openVirtualPort("NDN-MIDI Hot Path Bench Input");
+		midiout.openVirtualPort("NDN-MIDI Hot Path Bench Input");
+		std::vector<unsigned char> bytes(note.data(), note.data() + note.size());
+		std::vector<unsigned char> received;
+		received.reserve(16);
+		measure("RtMidiOut::sendMessage + RtMidiIn::getMessage (loopback)", milliseconds, [&] {
+			midiout.sendMessage(&bytes);
+			midiin.getMessage(&received);
+		});
+
+		results << "Steady-state regions: ";
+		printAllocReport(results);
+		results << std::endl;
+
+		// The application threads never return, so leave without
+		// unwinding them
+		results.flush();
+		_exit(0);
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,267 @@
+/********************************
+
+ImpairedNetwork.h
+An in-process network between DummyClientFaces that loses, delays,
+reorders and duplicates packets, on a virtual clock
+
+The faces send into ImpairedLinks, one per direction, which decide the
+fate of each packet from a seeded random stream of their own. Packets
+that get through are queued on the VirtualNetwork with their arrival
+time. The VirtualNetwork owns ndn-cxx's steady clock, so interest
+lifetimes expire in virtual time too, and it only moves that clock when
+it is told to run. Given the same seed and the same calls, a run
+delivers the same packets at the same virtual times on every machine.
+
+The applications must not start threads of their own that use the
+faces (see the heartbeatThread and monitorThread constructor options).
+
+********************************/
+
+#ifndef NDNMIDI_IMPAIRED_NETWORK_H
+#define NDNMIDI_IMPAIRED_NETWORK_H
+
+#include <ndn-cxx/lp/nack.hpp>
+#include <ndn-cxx/util/dummy-client-face.hpp>
+#include <ndn-cxx/util/time-unit-test-clock.hpp>
+
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <queue>
+#include <vector>
+
+#include <stdint.h>
+
+// What a link does to the packets it carries; times in nanoseconds
+struct Impairment
+{
+	double loss = 0.0;             // probability a packet is lost
+	long long delay = 0;           // fixed one-way delay
+	long long jitter = 0;          // added to the delay, see exponential
+	bool exponential = false;      // jitter exponential with this mean,
+	                               // otherwise uniform up to it
+	double reorder = 0.0;          // probability a packet is held back
+	long long reorderDelay = 0;    // by this much more
+	double duplicate = 0.0;        // probability of a second copy
+	double nack = 0.0;             // probability a lost interest comes
+	                               // back to its sender as a Nack
+};
+
+// Owns the virtual clock and the packets in flight
+class VirtualNetwork
+{
+public:
+	VirtualNetwork(boost::asio::io_service& io)
+		: m_io(io)
+		, m_clock(std::make_shared<ndn::time::UnitTestSteadyClock>())
+		, m_now(0)
+		, m_sequence(0)
+	{
+		m_clock->setNow(ndn::time::nanoseconds(0));
+		ndn::time::setCustomClocks(m_clock);
+	}
+
+	~VirtualNetwork()
+	{
+		ndn::time::setCustomClocks();
+	}
+
+	// Virtual nanoseconds since the network was created
+	long long
+	now() const
+	{
+		return m_now;
+	}
+
+	// Calls deliver once the clock reaches now() + delay
+	void
+	schedule(long long delay, const std::function<void()>& deliver)
+	{
+		m_queue.push({m_now + delay, m_sequence++, deliver});
+	}
+
+	// Moves the clock to time, delivering the packets due on the way in
+	// order. After every delivery, and at time, the faces' handlers run
+	// and then step, which lets the applications react at that instant.
+	template <class Step>
+	void
+	runUntil(long long time, Step step)
+	{
+		while (!m_queue.empty() && m_queue.top().time <= time)
+		{
+			Pending pending = m_queue.top();
+			m_queue.pop();
+			setNow(pending.time);
+			pending.deliver();
+			poll();
+			step();
+		}
+		setNow(time);
+		poll();
+		step();
+	}
+
+	// Runs the handlers the faces queued, including expired timers
+	size_t
+	poll()
+	{
+		m_io.reset();
+		return m_io.poll();
+	}
+
+private:
+	void
+	setNow(long long time)
+	{
+		if (time > m_now)
+		{
+			m_now = time;
+			m_clock->setNow(ndn::time::nanoseconds(time));
+		}
+	}
+
+	struct Pending
+	{
+		long long time;
+		unsigned long long sequence;   // keeps ties in sending order
+		std::function<void()> deliver;
+
+		bool
+		operator<(const Pending& other) const
+		{
+			// std::priority_queue puts the largest first
+			if (time != other.time)
+				return time > other.time;
+			return sequence > other.sequence;
+		}
+	};
+
+	boost::asio::io_service& m_io;
+	std::shared_ptr<ndn::time::UnitTestSteadyClock> m_clock;
+	long long m_now;
+	unsigned long long m_sequence;
+	std::priority_queue<Pending> m_queue;
+};
+
+// Carries what one face sends to another through the impairment.
+// Prefix registrations are answered by the faces themselves.
+class ImpairedLink
+{
+public:
+	ImpairedLink(VirtualNetwork& network, ndn::util::DummyClientFace& from,
+				 ndn::util::DummyClientFace& to, const Impairment& impairment, uint64_t seed)
+		: m_network(network)
+		, m_impairment(impairment)
+		, m_random(seed)
+	{
+		ndn::Name localhost("/localhost");
+		from.onSendInterest.connect([this, &from, &to, localhost] (const ndn::Interest& interest) {
+			if (localhost.isPrefixOf(interest.getName()))
+				return;
+			++interests;
+			if (lost())
+			{
+				// The Nack comes back over the same path
+				if (chance(m_impairment.nack))
+				{
+					++nacks;
+					ndn::lp::Nack nack(interest);
+					nack.setReason(ndn::lp::NackReason::CONGESTION);
+					m_network.schedule(delay(), [&from, nack] { from.receive(nack); });
+				}
+				return;
+			}
+			send([&to, interest] { to.receive(interest); });
+		});
+		from.onSendData.connect([this, &to] (const ndn::Data& data) {
+			++datas;
+			if (!lost())
+				send([&to, data] { to.receive(data); });
+		});
+	}
+
+	// Writes the link's counters as a JSON object
+	void
+	print(std::ostream& out) const
+	{
+		out << "{\"interests\": " << interests
+			<< ", \"data\": " << datas
+			<< ", \"lost\": " << losses
+			<< ", \"nacked\": " << nacks
+			<< ", \"reordered\": " << reorders
+			<< ", \"duplicated\": " << duplicates << "}";
+	}
+
+	unsigned long interests = 0;
+	unsigned long datas = 0;
+	unsigned long losses = 0;
+	unsigned long nacks = 0;
+	unsigned long reorders = 0;
+	unsigned long duplicates = 0;
+
+private:
+	bool
+	lost()
+	{
+		if (!chance(m_impairment.loss))
+			return false;
+		++losses;
+		return true;
+	}
+
+	void
+	send(const std::function<void()>& deliver)
+	{
+		m_network.schedule(delay(), deliver);
+		if (chance(m_impairment.duplicate))
+		{
+			++duplicates;
+			m_network.schedule(delay(), deliver);
+		}
+	}
+
+	// One-way delay of a packet
+	long long
+	delay()
+	{
+		long long delay = m_impairment.delay;
+		if (m_impairment.jitter > 0)
+		{
+			if (m_impairment.exponential)
+				delay += (long long)(-std::log(1.0 - uniform()) * m_impairment.jitter);
+			else
+				delay += (long long)(uniform() * m_impairment.jitter);
+		}
+		if (chance(m_impairment.reorder))
+		{
+			++reorders;
+			delay += m_impairment.reorderDelay;
+		}
+		return delay;
+	}
+
+	bool
+	chance(double probability)
+	{
+		return probability > 0.0 && uniform() < probability;
+	}
+
+	// Uniform in [0, 1) from splitmix64, the same on every platform
+	// (unlike the std:: distributions)
+	double
+	uniform()
+	{
+		uint64_t z = (m_random += 0x9E3779B97F4A7C15ULL);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		z ^= z >> 31;
+		return (z >> 11) * (1.0 / 9007199254740992.0);
+	}
+
+	VirtualNetwork& m_network;
+	Impairment m_impairment;
+	uint64_t m_random;
+};
+
+#endif
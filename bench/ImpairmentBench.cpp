@@ -0,0 +1,311 @@
+/********************************
+
+ImpairmentBench.cpp
+Requires ndn-cxx, RtMidi.cpp, and RtMidi.h to compile
+
+Measures note latency and loss through Controller and PlaybackModule
+over a lossy network, deterministically
+
+Runs both in one thread, connected by an ImpairedNetwork that loses,
+delays, reorders, duplicates and nacks packets as configured, all on a
+virtual clock. Notes go straight into the controller's input queue and
+come out of the playback module on a loopback bus. The heartbeats and
+the connection monitor run on the virtual clock too, and interests
+expire in it, so the same seed gives the same result on every run and
+every machine, and a run of minutes takes about a second. This is what
+exercises onTimeout, onNack, the controller's out-of-order interest
+drop and the playback module's sequence number window.
+
+Prints one JSON object with the latency (in virtual time) and loss of
+the notes, what the network did to the packets and the counters of
+both applications.
+
+Usage: ImpairmentBench [--notes=N] [--interval=US] [--seed=N]
+                       [--loss=P] [--delay=US] [--jitter=US]
+                       [--distribution=uniform|exponential]
+                       [--reorder=P] [--reorder-delay=US]
+                       [--duplicate=P] [--nack=P]
+
+********************************/
+
+// Both applications count into the same stats; the playback module's
+// first connection is slot 0
+#include "../Stats.h"
+#define CONTROLLER_STATS_SLOT (STATS_CONNECTIONS - 1)
+
+#include <ndn-cxx/util/dummy-client-face.hpp>
+
+#include <algorithm>
+#include <climits>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../Controller.h"
+#include "../PlaybackModule.h"
+#include "../AllocCheck.h"
+#include "BenchSupport.h"
+#include "ImpairedNetwork.h"
+
+const std::string CONTROLLER_NAME = "bench-controller";
+const std::string PLAYBACK_NAME = "bench-playback";
+const std::string PROJECT_NAME = "bench-proj";
+
+// Loopback bus out of the playback module
+const std::string SOUND_BUS = "NDN-MIDI Impairment Bench Sound";
+
+const long long SECOND = 1000000000LL;
+
+// Virtual time to wait for the connection, and for stragglers
+const long long CONNECT_TIMEOUT = 60 * SECOND;
+const long long WARMUP_SPACING = SECOND / 10;
+const long long DRAIN_TIME = 10 * SECOND;
+
+void printUsage(const char *program)
+{
+	std::cerr << "Usage: " << program << " [options]" << std::endl
+			  << "  --notes=N         number of notes to measure (default 2000)" << std::endl
+			  << "  --interval=US     time between notes in microseconds (default 5000)" << std::endl
+			  << "  --seed=N          seed of the network's random decisions (default 1)" << std::endl
+			  << "  --loss=P          probability a packet is lost (default 0)" << std::endl
+			  << "  --delay=US        one-way delay in microseconds (default 5000)" << std::endl
+			  << "  --jitter=US       random delay added to it in microseconds (default 0)" << std::endl
+			  << "  --distribution=D  uniform: jitter up to --jitter, exponential: with mean --jitter" << std::endl
+			  << "  --reorder=P       probability a packet is held back (default 0)" << std::endl
+			  << "  --reorder-delay=US  by how long in microseconds (default 20000)" << std::endl
+			  << "  --duplicate=P     probability a packet arrives twice (default 0)" << std::endl
+			  << "  --nack=P          probability a lost interest is nacked (default 0)" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int notes = 2000;
+	long long interval = 5000;
+	unsigned long long seed = 1;
+	std::string distribution = "uniform";
+	Impairment impairment;
+	impairment.delay = 5000;
+	impairment.reorderDelay = 20000;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string option = argv[i];
+		std::string value = option.substr(option.find('=') + 1);
+		if (option.compare(0, 8, "--notes=") == 0)
+			notes = strtoul(value.c_str(), NULL, 10);
+		else if (option.compare(0, 11, "--interval=") == 0)
+			interval = strtoll(value.c_str(), NULL, 10);
+		else if (option.compare(0, 7, "--seed=") == 0)
+			seed = strtoull(value.c_str(), NULL, 10);
+		else if (option.compare(0, 7, "--loss=") == 0)
+			impairment.loss = strtod(value.c_str(), NULL);
+		else if (option.compare(0, 8, "--delay=") == 0)
+			impairment.delay = strtoll(value.c_str(), NULL, 10);
+		else if (option.compare(0, 9, "--jitter=") == 0)
+			impairment.jitter = strtoll(value.c_str(), NULL, 10);
+		else if (option.compare(0, 15, "--distribution=") == 0)
+			distribution = value;
+		else if (option.compare(0, 10, "--reorder=") == 0)
+			impairment.reorder = strtod(value.c_str(), NULL);
+		else if (option.compare(0, 16, "--reorder-delay=") == 0)
+			impairment.reorderDelay = strtoll(value.c_str(), NULL, 10);
+		else if (option.compare(0, 12, "--duplicate=") == 0)
+			impairment.duplicate = strtod(value.c_str(), NULL);
+		else if (option.compare(0, 7, "--nack=") == 0)
+			impairment.nack = strtod(value.c_str(), NULL);
+		else
+		{
+			std::cerr << "Unknown option " << option << std::endl;
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+
+	if (distribution != "uniform" && distribution != "exponential")
+	{
+		std::cerr << "Unknown distribution " << distribution << std::endl;
+		printUsage(argv[0]);
+		return 1;
+	}
+	if (notes == 0 || notes > MAX_NOTES || interval <= 0)
+	{
+		std::cerr << "Need 1 to " << MAX_NOTES << " notes and a positive interval" << std::endl;
+		return 1;
+	}
+	impairment.exponential = distribution == "exponential";
+
+	// Options are in microseconds, the network works in nanoseconds
+	Impairment link = impairment;
+	link.delay *= 1000;
+	link.jitter *= 1000;
+	link.reorderDelay *= 1000;
+
+	ResultStream results;
+
+	// This benchmark is about the network, the others check allocations
+	allocCheckFatal(false);
+
+	try
+	{
+		boost::asio::io_service io;
+		VirtualNetwork network(io);
+		ndn::util::DummyClientFace::Options options(false, true);
+		ndn::util::DummyClientFace controllerFace(io, options);
+		ndn::util::DummyClientFace playbackFace(io, options);
+		ImpairedLink up(network, controllerFace, playbackFace, link, seed);
+		ImpairedLink down(network, playbackFace, controllerFace, link, seed + 1);
+
+		// Arrivals are timed in virtual time
+		Arrivals arrivals(notes);
+		arrivals.now = [&network] { return network.now(); };
+
+		RtMidiIn sound(RtMidi::RTMIDI_LOOPBACK, "NDN-MIDI Bench");
+		sound.setMessageCallback(&recordArrival, &arrivals);
+		sound.openVirtualPort(SOUND_BUS);
+
+		// Without their timer threads; the loop below drives the timers
+		BenchPlaybackModule playbackModule(playbackFace, PLAYBACK_NAME, PROJECT_NAME, false);
+		playbackModule.setViewingMenu();
+		playbackModule.midiout = new RtMidiOut(RtMidi::RTMIDI_LOOPBACK);
+		playbackModule.midiout->openVirtualPort(SOUND_BUS);
+		playbackModule.message.assign(3, 0);
+
+		BenchController controller(controllerFace, PLAYBACK_NAME, CONTROLLER_NAME, PROJECT_NAME, false);
+
+		// The output sender runs replyInterest() whenever there is
+		// something to send; here it runs after every event, until it
+		// has nothing left
+		auto serve = [&] {
+			do
+			{
+				controller.replyInterest();
+			} while (network.poll() > 0);
+		};
+
+		// Prefix registrations
+		serve();
+
+		// Until every note is played and the stragglers are in, run the
+		// timers of both applications and play notes when they are due,
+		// delivering packets in between
+		long long nextHeartbeat = 0;
+		long long nextCheck = SECOND;
+		long long nextNote = 0;
+		long long end = LLONG_MAX;
+		long long firstNote = 0;
+		unsigned int note = 0;
+		std::vector<long long> sent(notes);
+		while (true)
+		{
+			long long next = std::min(std::min(nextHeartbeat, nextCheck), nextNote);
+			if (next > end)
+			{
+				network.runUntil(end, serve);
+				break;
+			}
+			network.runUntil(next, serve);
+
+			if (next == nextHeartbeat)
+			{
+				controller.heartbeat();
+				nextHeartbeat += HEARTBEAT_PERIOD_S * SECOND;
+			}
+			if (next == nextCheck)
+			{
+				playbackModule.checkConnections();
+				nextCheck += SECOND;
+			}
+			if (next == nextNote)
+			{
+				if (!arrivals.warm)
+				{
+					// Warm-up notes until one comes through, which means
+					// the two are connected and the first interests are out
+					if (next > CONNECT_TIMEOUT)
+					{
+						std::cerr << "Controller and playback module did not connect" << std::endl;
+						_exit(1);
+					}
+					controller.addInput(makeNote(WARMUP_STATUS, 0));
+					nextNote += WARMUP_SPACING;
+					firstNote = nextNote;
+				}
+				else
+				{
+					sent[note] = next;
+					controller.addInput(makeNote(NOTE_STATUS, note));
+					if (++note < notes)
+						nextNote += interval * 1000;
+					else
+					{
+						nextNote = LLONG_MAX;
+						end = next + DRAIN_TIME;
+					}
+				}
+			}
+			serve();
+		}
+
+		// Latency of each note, and the change in spacing between
+		// consecutive notes that both arrived
+		std::vector<long long> latency, jitter;
+		for (unsigned int i = 0; i < notes; ++i)
+		{
+			if (arrivals.times[i] < 0)
+				continue;
+			latency.push_back(arrivals.times[i] - sent[i]);
+			if (i > 0 && arrivals.times[i - 1] >= 0)
+			{
+				long long change = (arrivals.times[i] - arrivals.times[i - 1]) - (sent[i] - sent[i - 1]);
+				jitter.push_back(change < 0 ? -change : change);
+			}
+		}
+
+		StatTotals totals;
+		collectStats(totals);
+
+		double playTime = (double) notes * interval / 1000000;
+		results << "{\"benchmark\": \"impairment\""
+				<< ", \"seed\": " << seed
+				<< ", \"impairment\": {\"loss\": " << impairment.loss
+				<< ", \"delay_us\": " << impairment.delay
+				<< ", \"jitter_us\": " << impairment.jitter
+				<< ", \"distribution\": \"" << distribution << "\""
+				<< ", \"reorder\": " << impairment.reorder
+				<< ", \"reorder_delay_us\": " << impairment.reorderDelay
+				<< ", \"duplicate\": " << impairment.duplicate
+				<< ", \"nack\": " << impairment.nack << "}"
+				<< ", \"notes\": " << notes
+				<< ", \"interval_us\": " << interval
+				<< ", \"connected_after_s\": " << (double) firstNote / SECOND
+				<< ", \"received\": " << arrivals.count
+				<< ", \"lost\": " << notes - arrivals.count
+				<< ", \"received_per_s\": " << arrivals.count / playTime
+				<< ", \"latency_us\": ";
+		printSummary(results, latency);
+		results << ", \"jitter_us\": ";
+		printSummary(results, jitter);
+		results << ", \"controller_to_playback\": ";
+		up.print(results);
+		results << ", \"playback_to_controller\": ";
+		down.print(results);
+		results << ", \"controller\": {";
+		printStats(results, totals, CONTROLLER_STATS_SLOT);
+		results << "}, \"playback\": {";
+		printStats(results, totals, 0);
+		results << "}}" << std::endl;
+
+		// The playback module's MIDI output is never closed, so leave
+		// without unwinding
+		_exit(0);
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}